@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 import re
+import ctypes
 from pathlib import Path
 
 HEADER_FILE = "dataobjects.h"
@@ -8,24 +9,32 @@ HEADER_FILE = "dataobjects.h"
 # Welche Strukturen in welche Datei
 # --------------------------
 CONF_STRUCTS = ["GLOBAL_CONF_t","PACK_USERCONF_t","PACK_GENERALCONF_t","PACK_CALIBRATION_t"]
-WEBSERVER_STRUCTS = ["GLOBAL_PDO_t","PACK_PDO_t","PACK_SDO_t"]
+WEBSERVER_STRUCTS = ["GLOBAL_PDO_t","PACK_PDO_t","PACK_SDO_t","TIMING_GLOBAL_t","TIMING_PHASE_t","HISTORY_HEADER_t","HISTORY_RECORD_t",
+                     "SDO_QUEUE_t","SDO_CMD_t","SDO_ACK_t","PDO_HEADER_t","PDO_FIELD_t"]
 
 OUTPUT_FILES = {
     "conf/dataobjects.py": CONF_STRUCTS,
     "webserver/dataobjects.py": WEBSERVER_STRUCTS,
 }
 
+# Konstanten, die zusätzlich als Python-Variablen ausgegeben werden
+OUTPUT_DEFINES = {
+    "webserver/dataobjects.py": ["PDO_MAGIC", "PDO_LAYOUT_VERSION"],
+}
+
+ALIGNED_RE = r'__attribute__\(\(aligned\((\w+)\)\)\)'
+
 # --------------------------
 # 1️⃣ #define Konstanten extrahieren
 # --------------------------
 def extract_defines(content: str):
     defines = {}
-    for m in re.finditer(r'#define\s+([A-Za-z_]\w+)\s+([0-9]+)', content):
-        defines[m.group(1)] = int(m.group(2))
+    for m in re.finditer(r'#define\s+([A-Za-z_]\w+)\s+(0x[0-9a-fA-F]+|[0-9]+)\b', content):
+        defines[m.group(1)] = int(m.group(2), 0)
     return defines
 
 # --------------------------
-# 2️⃣ typedef struct parsen, auch __attribute__((packed))
+# 2️⃣ typedef struct parsen, auch __attribute__((packed)) und __attribute__((aligned(n)))
 # --------------------------
 def extract_all_typedef_structs(content: str):
     results = {}
@@ -56,11 +65,13 @@ def extract_all_typedef_structs(content: str):
         if semi == -1:
             break
         tail = content[brace_close + 1 : semi]
+        al_m = re.search(ALIGNED_RE, tail)
+        tail = re.sub(r'__attribute__\(\(.*?\)\)\)*', '', tail)
         nm_m = re.search(r'([A-Za-z_]\w+)', tail)
         if nm_m:
             name = nm_m.group(1)
             body = content[brace_open + 1 : brace_close]
-            results[name] = (body, packed)
+            results[name] = (body, packed, al_m.group(1) if al_m else None)
         i = semi + 1
     return results
 
@@ -71,11 +82,25 @@ def parse_struct_body(struct_body: str):
     fields = []
     seen = set()
     lines = struct_body.splitlines()
+    blocks = []  # offene union/struct, Ausrichtung für anonyme aligned-Blöcke
 
     for line in lines:
         line = line.strip()
         if not line or line.startswith("//") or line.startswith("/*"):
             continue
+        # Anonymer, ausgerichteter Block: Marker für Beginn/Ende (Felder bleiben flach)
+        if line.startswith(("union", "struct")) and line.endswith("{"):
+            al_m = re.search(ALIGNED_RE, line)
+            blocks.append(al_m.group(1) if al_m else None)
+            if al_m:
+                fields.append(("__align__", al_m.group(1)))
+            if line.startswith("struct"):
+                continue
+        elif line.startswith("}"):
+            align = blocks.pop() if blocks else None
+            if align:
+                fields.append(("__end__", align))
+            continue
         # Union überspringen, aber erste Variable aufnehmen
         if line.startswith("union"):
             m = re.search(r'(\w+)\s*;', line)
@@ -107,9 +132,11 @@ def parse_struct_body(struct_body: str):
 # 4️⃣ CType Mapping
 # --------------------------
 CTYPE_MAP = {
+    "uint64_t": "c_uint64",
     "uint32_t": "c_uint32",
     "int32_t": "c_int32",
     "float": "c_float",
+    "char": "c_char",
     "double": "c_double",
     "uint16_t": "c_uint16",
     "int16_t": "c_int16",
@@ -140,14 +167,42 @@ def map_to_ctype(typ: str, defines: dict):
 # --------------------------
 # 5️⃣ Klassen generieren
 # --------------------------
-def generate_ctypes_class(name, fields, defines, packed=False):
+def ctype_layout(ctype: str):
+    """Größe und Ausrichtung eines erzeugten ctypes-Ausdrucks"""
+    t = eval(ctype, vars(ctypes))
+    return ctypes.sizeof(t), ctypes.alignment(t)
+
+def generate_ctypes_class(name, fields, defines, packed=False, align=None):
+    """ctypes kennt kein aligned(n): Offsets mitrechnen und Füllbytes als _padN einfügen"""
     out = [f"class {name}(Structure):"]
     if packed:
         out.append("    _pack_ = 1")
     out.append("    _fields_ = [")
+    offset = 0
+    pads = 0
+
+    def pad_to(n):
+        nonlocal offset, pads
+        n = defines.get(n, n) if isinstance(n, str) else n
+        n = int(n)
+        if offset % n:
+            size = n - offset % n
+            out.append(f'        ("_pad{pads}", (c_uint8 * {size})),')
+            offset += size
+            pads += 1
+
     for typ, field in fields:
+        if typ in ("__align__", "__end__"):
+            pad_to(field)
+            continue
         ctype = map_to_ctype(typ, defines)
+        size, al = ctype_layout(ctype)
+        if not packed and offset % al:
+            offset += al - offset % al
         out.append(f'        ("{field}", {ctype}),')
+        offset += size
+    if align:
+        pad_to(align)
     out.append("    ]\n")
     return "\n".join(out)
 
@@ -169,12 +224,16 @@ def main():
 
     for out_file, struct_list in OUTPUT_FILES.items():
         text = "from ctypes import *\n\n"
+        for name in OUTPUT_DEFINES.get(out_file, []):
+            text += f"{name} = {defines[name]}\n"
+        if OUTPUT_DEFINES.get(out_file):
+            text += "\n"
 
         for name in struct_list:
             if name in structs:
-                body, packed = structs[name]
+                body, packed, align = structs[name]
                 fields = parse_struct_body(body)
-                text += generate_ctypes_class(name, fields, defines, packed)
+                text += generate_ctypes_class(name, fields, defines, packed, align)
                 print(f"✓ {name} für {out_file}")
             else:
                 print(f"✗ {name} nicht gefunden!")
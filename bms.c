@@ -1,10 +1,12 @@
 #include <stdint.h>
 #include <float.h>
 #include <stdio.h>
-#include <syslog.h>
+#include <string.h>
 
 #include "globalconst.h"
 #include "spi.h"
+#include "timing.h"
+#include "event.h"
 #include "dataobjects.h"
 #include "aux.c"
 
@@ -14,13 +16,57 @@
 #define PACK_PDO_HWALERTFLAG_BITS g_PackPdoData[id].hwAlertFlags_bits
 #define PACK_PDO_HWALERTSTATE_BITS g_PackPdoData[id].hwAlertState_bits
 #define PACK_SDO g_PackSdoData[id]
+// Ereignis mit aktuellem Zustand an den Housekeeping-Thread, blockiert nie
+#define PACK_EVENT(code, arg) evt_Post(code, PACK_PDO.id, PACK_PDO.stateMachine, PACK_PDO.swAlertFlags, arg)
 
 static uint32_t diagLock = 0;
 static uint16_t diagData[NUMBER_OF_CELLS * 3];
 
-static inline void AFESafeMode() {
-    spi_AFEWriteRegister(0x13, 0); // Alle MOSFETs aus
-    spi_AFEWriteRegister(0x0c, 0); // Alle Balancer aus
+/*
+ * Scheduler: jeder Job hat eine eigene Periode in Ticks (TICK_TIME_MS) und
+ * ist je Pack phasenversetzt, damit die SPI-Last pro Tick gleichmäßig bleibt.
+ * States außerhalb von RUN laufen im Raster von JOB_MEAS (CYCLE_TIME_MS).
+ */
+#define TICKS(ms) (((ms) + TICK_TIME_MS / 2) / TICK_TIME_MS)
+#define JOB(j) (1u << (j))
+
+typedef enum {
+    JOB_FAST = 0,   // Strom, Flags, Fehler, MosControl
+    JOB_MEAS,       // Zell-/Packspannung, Limits
+    JOB_TEMP,       // NTC, Chiptemperatur
+    JOB_BALANCE,    // Balancer planen
+    JOB_VERIFY,     // Userconfig prüfen
+    JOB_COUNT
+} EJob_t;
+
+static const uint32_t s_jobPeriod[JOB_COUNT] = {
+    [JOB_FAST] = TICKS(FAST_TIME_MS),
+    [JOB_MEAS] = TICKS(CYCLE_TIME_MS),
+    [JOB_TEMP] = TICKS(TEMP_TIME_MS),
+    [JOB_BALANCE] = TICKS(BALANCE_TIME_MS),
+    [JOB_VERIFY] = TICKS(VERIFY_TIME_MS),
+};
+static uint32_t s_tick;
+
+// Messdaten-Burst je Pack, im RUN-Mode vorab vom I/O-Thread geholt
+typedef struct {
+    uint16_t status[16];
+    uint16_t data[PDO_RAW_CODES];   // ab 0x84, nur die Blöcke der Jobs
+    int err;
+    uint32_t jobs;                  // Jobs, für die gelesen wurde
+    uint32_t fresh;
+    uint32_t primed;                // alle Messwerte mindestens einmal gelesen
+    uint32_t shadowEvents;          // Bits aus AFEReadData der letzten Lesung
+} AFE_RAW_t;
+static AFE_RAW_t s_afeRaw[MAX_BATTERY_PACKS];
+
+static inline void AFESafeMode(int id) {
+    spi_ShadowInvalidate(); // Zustand des AFE unbekannt, alles schreiben
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x13, 0); // Alle MOSFETs aus
+    spi_TransactionWrite(0x0c, 0); // Alle Balancer aus
+    spi_TransactionCommit();
+    PACK_PDO.mosfetStatus = 0;
 }
 
 static inline void AFEDiagUnlock() {
@@ -28,28 +74,36 @@ static inline void AFEDiagUnlock() {
 }
 
 static inline void AFEDiagPullUp() {
-    spi_AFEWriteRegister(0x50,0xffff);
-    spi_AFEWriteRegister(0x51,0x0000);
-    spi_AFEWriteRegister(0x52,0x0004);
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x50,0xffff);
+    spi_TransactionWrite(0x51,0x0000);
+    spi_TransactionWrite(0x52,0x0004);
+    spi_TransactionCommit();
 }
 
 static inline void AFEDiagPullDown() {
-    spi_AFEWriteRegister(0x50,0x0000);
-    spi_AFEWriteRegister(0x51,0xffff);
-    spi_AFEWriteRegister(0x52,0x0001);
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x50,0x0000);
+    spi_TransactionWrite(0x51,0xffff);
+    spi_TransactionWrite(0x52,0x0001);
+    spi_TransactionCommit();
 }
 
 static inline void AFEDiagClearLock() {
-    spi_AFEWriteRegister(0x50,0x0000);
-    spi_AFEWriteRegister(0x51,0x0000);
-    spi_AFEWriteRegister(0x52,0x0000);
-    spi_AFEWriteRegister(0x43,0x0);
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x50,0x0000);
+    spi_TransactionWrite(0x51,0x0000);
+    spi_TransactionWrite(0x52,0x0000);
+    spi_TransactionWrite(0x43,0x0);
+    spi_TransactionCommit();
 }
 
 static inline void AFEClearAllErrors() {
-    spi_AFEWriteRegister(0x02,0xFFFF);
-    spi_AFEWriteRegister(0x03,0xFFFF);
-    spi_AFEWriteRegister(0x05,0xC000);
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x02,0xFFFF);
+    spi_TransactionWrite(0x03,0xFFFF);
+    spi_TransactionWrite(0x05,0xC000);
+    spi_TransactionCommit();
 }
 
 static inline void AFEWatchdogEnable() {
@@ -147,8 +201,23 @@ static void ErrorHandler(int id) {
         PACK_PDO_SWALERTFLAG_BITS.PRECHARGE_FAIL = 1;
 }
 
+// Ticks mit eingeschaltetem Vorlade-MOSFET je Pack
+static uint32_t s_prechargeTicks[MAX_BATTERY_PACKS];
+
+// Hat ein Pack Lade- oder Entlade-MOSFET geschlossen (Bus versorgt, Busspannung gültig)?
+static int BusClosed(void) {
+    for (uint32_t id = 0; id < g_GlobalConfig.numberOfPacks; id++)
+        if ((g_packEnabled & (1 << id)) &&
+            (PACK_PDO.mosfetStatus_bits.CHARGE || PACK_PDO.mosfetStatus_bits.DISCHARGE))
+            return 1;
+    return 0;
+}
+
 /**********************************************************************************************************
  * Setzt Lade Entlade und Vorlade Mosfets (UNITTEST)
+ * Vorladung beendet: ist schon ein Pack am Bus, wenn die Packspannung auf prechargeDeltaVoltage an
+ * der Busspannung liegt. Sonst gibt es keine Busmessung, das erste Pack schließt nach
+ * PRECHARGE_TIME_MS, der Vorladewiderstand bleibt über prechargeResistorI2t geschützt.
  **********************************************************************************************************/
 static void MosControl(int id) {
     uint16_t mosVal = 0;
@@ -178,7 +247,16 @@ static void MosControl(int id) {
     uint8_t allowCharge    = PACK_SDO.ChargeEnable && !(errorAll || errorCharge);
     uint8_t allowDischarge = PACK_SDO.DischargeEnable && !(errorAll || errorDischarge);
 
-    if(PACK_PDO.mosfetStatus_bits.PRECHARGE && (__builtin_fabsf(PACK_PDO.voltage - g_GlobalPdoData->voltage) <= g_GlobalConfig.prechargeDeltaVoltage)) {
+    uint8_t precharged = 0;
+    if (PACK_PDO.mosfetStatus_bits.PRECHARGE) {
+        s_prechargeTicks[id]++;
+        precharged = BusClosed()
+            ? __builtin_fabsf(PACK_PDO.voltage - g_GlobalPdoData->voltage) <= g_GlobalConfig.prechargeDeltaVoltage
+            : s_prechargeTicks[id] >= TICKS(PRECHARGE_TIME_MS);
+    } else {
+        s_prechargeTicks[id] = 0;
+    }
+    if (precharged) {
         if (allowDischarge) mosVal |= (1 << 0);
         if (allowCharge)    mosVal |= (1 << 1);
     }
@@ -188,19 +266,56 @@ static void MosControl(int id) {
     if (allowCharge)
         mosVal |= (PACK_PDO.mosfetStatus_bits.CHARGE ? (1 << 1) : (1 << 2));
 
-    spi_AFEWriteRegister(0x13, mosVal);
+    // wird nur bei Änderung übertragen (Registerschatten). Das AFE meldet den Zustand der
+    // FETs nicht zurück, mosfetStatus ist daher das zuletzt erfolgreich geschriebene MOS_TRIG
+    if (spi_AFEWriteRegister(0x13, mosVal) == 0) {
+        PACK_PDO.mosfetStatus_bits.DISCHARGE = (mosVal >> 0) & 1;
+        PACK_PDO.mosfetStatus_bits.CHARGE = (mosVal >> 1) & 1;
+        PACK_PDO.mosfetStatus_bits.PRECHARGE = (mosVal >> 2) & 1;
+    }
 }
 
 static void AFEWriteUser(int id) {
-    spi_AFEWriteRegister(0x45,0x95); // USER Unlock
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x45,0x95); // USER Unlock
     uint32_t i=0;
     while (g_PackUserConfig[id][i].address > 0) {
-        spi_AFEWriteRegister(
+        spi_TransactionWrite(
             g_PackUserConfig[id][i].address,
             g_PackUserConfig[id][i].data);
         i++;
     }
-    spi_AFEWriteRegister(0x45,0x00); // USER Lock
+    spi_TransactionWrite(0x45,0x00); // USER Lock
+    spi_TransactionCommit();
+}
+
+/**********************************************************************************************************
+ * SPI Fehlerzählung ins PDO übernehmen, bei Fehlerhäufung COMM_ERR setzen
+ **********************************************************************************************************/
+static void SpiAccounting(int id) {
+    const SPI_STATS_t *st = spi_GetStats();
+    PACK_PDO.spiRetries = st->retries;
+    PACK_PDO.spiCrcErrors = st->crcErrors;
+    PACK_PDO.spiIoctlErrors = st->ioctlErrors;
+    PACK_PDO.spiFailedCalls = st->failedCalls;
+    PACK_PDO.spiMaxTransferUs = st->maxTransferUs;
+    PACK_PDO.spiSpeedHz = st->speedHz;
+
+    // In WAIT_INIT sind Fehler nur ein Suchen nach dem AFE (fehlt/startet spät), weiter pollen
+    if (g_GlobalConfig.spiErrorBurst == 0 || st->errorBurst < g_GlobalConfig.spiErrorBurst ||
+        PACK_PDO_SWALERTFLAG_BITS.COMM_ERR || PACK_PDO.stateMachine == AFE_STATE_WAIT_INIT)
+        return;
+
+    PACK_PDO_SWALERTFLAG_BITS.COMM_ERR = 1;
+    PACK_EVENT(EVT_SPI_ERROR_BURST, st->errorBurst);
+
+    // Während Init/Diagnose abbrechen, Diagnose-Sperre freigeben
+    if (PACK_PDO.stateMachine >= AFE_STATE_DIAG0 && PACK_PDO.stateMachine <= AFE_STATE_DIAG2) {
+        AFEDiagClearLock();
+        diagLock = 0;
+    }
+    if (PACK_PDO.stateMachine < AFE_STATE_RUN_WARNING)
+        PACK_PDO.stateMachine = AFE_STATE_ERROR;
 }
 
 static uint32_t AFEVerifyUser(int id) {
@@ -218,11 +333,12 @@ static uint32_t AFEVerifyUser(int id) {
 
         // Lese den ganzen Block auf einmal
         uint16_t readback[32]; // max Blockgröße
-        spi_AFEReadRegister(
+        if (spi_AFEReadRegister(
                 g_PackUserConfig[id][start].address,
                 readback,
                 len
-            );
+            ))
+            return 1; // nicht lesbar, nicht verifiziert
 
         // Vergleiche jedes Register im Block
         for (uint32_t j = 0; j < len; j++)
@@ -238,35 +354,110 @@ static uint32_t AFEInit(int id) {
     AFEWriteUser(id);
     if(AFEVerifyUser(id))
         return 1;
-    spi_AFEWriteRegister(0x05,0x4000); //Clear RESET Flag
-    spi_AFEWriteRegister(0x0d,31); //Setup Balancer
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x05,0x4000); //Clear RESET Flag
+    spi_TransactionWrite(0x0d,31); //Setup Balancer
+    spi_TransactionCommit();
     return 0;
 }
 
-static void AFEReadData(int id) {
-    uint16_t data[28];
+static uint32_t JobsDue(int id) {
+    uint32_t jobs = 0;
+    for (int j = 0; j < JOB_COUNT; j++) {
+        uint32_t phase = id * s_jobPeriod[j] / g_GlobalConfig.numberOfPacks;
+        if ((s_tick + phase) % s_jobPeriod[j] == 0)
+            jobs |= JOB(j);
+    }
+    return jobs;
+}
+
+// Jobs im RUN-Mode, bis alle Messwerte einmal gelesen sind wird alles gelesen
+static uint32_t RunJobs(int id) {
+    uint32_t jobs = JobsDue(id);
+    if (!s_afeRaw[id].primed)
+        jobs |= JOB(JOB_MEAS) | JOB(JOB_TEMP);
+    return jobs;
+}
 
-    spi_AFEReadRegister(0x01, data, 16);
-    PACK_PDO.hwStatus = data[0];
-    PACK_PDO.hwAlertFlags = (data[2] << 16) | data[1];
-    PACK_PDO.hwAlertState = (data[5] << 16) | data[4];
-    PACK_PDO.hwAlertCellUnderOvervoltage = (data[7] << 16) | data[6];
-    PACK_PDO.hwAlertAux = data[9];
-    PACK_PDO.hwBalancerTimer = data[14];
-    PACK_PDO.hwBalancerStatus = data[15];
+static void AFEFetchData(int id, uint32_t jobs) {
+    AFE_RAW_t *raw = &s_afeRaw[id];
+
+    spi_TransactionBegin();
+    spi_TransactionRead(0x01, raw->status, 16);
+    spi_TransactionRead(0x84, &raw->data[0], 1);           // CADC Strom
+    spi_TransactionRead(0x9f, &raw->data[27], 1);          // VADC Strom
+    if (jobs & JOB(JOB_MEAS))
+        spi_TransactionRead(0x85, &raw->data[1], 18);      // Pack, PVDD, Zellen
+    if (jobs & JOB(JOB_TEMP))
+        spi_TransactionRead(0x98, &raw->data[20], 7);      // NTC, Chiptemperatur
+    uint64_t t0 = tim_Now();
+    raw->err = spi_TransactionCommit();
+    tim_Pack(id, TIMING_BURST, t0);
+    raw->jobs = jobs;
+    raw->fresh = 1;
+}
 
-    spi_AFEReadRegister(0x84, data, 28);
+static int AFEReadData(int id, uint32_t jobs) {
+    AFE_RAW_t *raw = &s_afeRaw[id];
+    const uint16_t *status = raw->status;
+    const uint16_t *data = raw->data;
+
+    if (!raw->fresh || raw->jobs != jobs)
+        AFEFetchData(id, jobs); // nicht vorab vom I/O-Thread geholt
+    raw->fresh = 0;
+    if (raw->err)
+        return -1; // letzte gültige Werte im PDO behalten
+
+    uint64_t t0 = tim_Now();
+
+    PACK_PDO.hwStatus = status[0];
+    PACK_PDO.hwAlertFlags = (status[2] << 16) | status[1];
+    PACK_PDO.hwAlertState = (status[5] << 16) | status[4];
+    PACK_PDO.hwAlertCellUnderOvervoltage = (status[7] << 16) | status[6];
+    PACK_PDO.hwAlertAux = status[9];
+    PACK_PDO.hwBalancerTimer = status[14];
+    PACK_PDO.hwBalancerStatus = status[15];
+
+    // AFE hat Register selbst verändert (Reset/Schutzabschaltung) oder
+    // ein Schreibframe mit CRC-Fehler verworfen, Registerschatten verwerfen
+    // damit MosControl & Co. neu schreiben. Die Bits bleiben bis zum Löschen
+    // stehen, daher nur beim Setzen (Flanke), nicht in jedem Zyklus
+    uint32_t shadowEvents = PACK_PDO_HWALERTSTATE_BITS.RESET << 0 |
+                            PACK_PDO_HWALERTFLAG_BITS.SPI_CRC_ERR << 1 |
+                            PACK_PDO_HWALERTFLAG_BITS.CHARGE_OC << 2 |
+                            PACK_PDO_HWALERTFLAG_BITS.DISCHARGE_OC << 3 |
+                            PACK_PDO_HWALERTFLAG_BITS.SHORT << 4 |
+                            PACK_PDO_HWALERTFLAG_BITS.WDT_OVF << 5 |
+                            PACK_PDO_HWALERTFLAG_BITS.EXT_PROT << 6 |
+                            PACK_PDO_HWALERTFLAG_BITS.CELL_UV << 7 |
+                            PACK_PDO_HWALERTFLAG_BITS.CELL_OV << 8 |
+                            PACK_PDO_HWALERTFLAG_BITS.LV << 9 |
+                            PACK_PDO_HWALERTFLAG_BITS.THERM_SD << 10;
+    if (shadowEvents & ~raw->shadowEvents)
+        spi_ShadowInvalidate();
+    raw->shadowEvents = shadowEvents;
+
+    memcpy(PACK_PDO.rawCodes, data, sizeof(PACK_PDO.rawCodes));
     PACK_PDO.current = (float)((int16_t)data[0]) * PACK_GENERALCONFIG->cadcCurrentFactor;
-    PACK_PDO.voltage = (float)data[1] * 1.6e-3;
-    PACK_PDO.pvddVoltage = (float)data[2] * 2.5e-3;
-    for(int i=0; i < NUMBER_OF_CELLS; i++)
-        PACK_PDO.cells[i] = (float)data[3 + i] * 100e-6;
-    for(int i=0; i < 4; i++)
-        PACK_PDO.ntcTemperature[i] = NtcToTemperature((float)data[20 + i], PACK_GENERALCONFIG->ntcPolynom, 11);
-    PACK_PDO.dieTemperature = (float)(25437 - data[26]) / 59.17 - 64.5;
     PACK_PDO.fastCurrent = (float)(data[27] & 0x7fff) * PACK_GENERALCONFIG->vadcCurrentFactor;
     if (data[27] & 0x8000)
         PACK_PDO.fastCurrent = -PACK_PDO.fastCurrent;
+
+    if (jobs & JOB(JOB_MEAS)) {
+        PACK_PDO.voltage = (float)data[1] * 1.6e-3;
+        PACK_PDO.pvddVoltage = (float)data[2] * 2.5e-3;
+        for(int i=0; i < NUMBER_OF_CELLS; i++)
+            PACK_PDO.cells[i] = (float)data[3 + i] * 100e-6;
+    }
+    if (jobs & JOB(JOB_TEMP)) {
+        for(int i=0; i < 4; i++)
+            PACK_PDO.ntcTemperature[i] = NtcToTemperature((float)data[20 + i], PACK_GENERALCONFIG->ntcPolynom, 11);
+        PACK_PDO.dieTemperature = (float)(25437 - data[26]) / 59.17 - 64.5;
+    }
+    if ((jobs & JOB(JOB_MEAS)) && (jobs & JOB(JOB_TEMP)))
+        raw->primed = 1;
+    tim_Pack(id, TIMING_CONVERT, t0);
+    return 0;
 }
 
 static uint32_t AFEWireDiag(uint16_t *data)
@@ -292,20 +483,180 @@ static uint32_t AFEBalancer (int id) {
         if((PACK_PDO.cells[i] - avg_vcell) > PACK_GENERALCONFIG->balancerDiffVoltage)
             new_balance |= (1 << i);
 
-    spi_AFEWriteRegister(0x0c,new_balance);
-    spi_AFEWriteRegister(0x0f,40); //40 * 0,25 -> 10sek
+    spi_TransactionBegin();
+    spi_TransactionWrite(0x0c,new_balance);
+    spi_TransactionWrite(0x0f,40); //40 * 0,25 -> 10sek
+    spi_TransactionCommit();
 
     return (new_balance>0);
 }
 
 static uint32_t AFECheckPowerupComplete() {
     uint16_t data;
-    spi_AFEReadRegister(0x00, &data, 1);
+    if (spi_AFEReadRegister(0x00, &data, 1))
+        return 0;
     return data == 0x6000; /* TOP_STATUS muss auf Power-up Complete sein */
 }
 
 
+/**********************************************************************************************************
+ * Pack neu initialisieren (SDO ResetStateMachine): Userconfig und Diagnose wie nach dem Power-up
+ **********************************************************************************************************/
+static void ResetStateMachine(int id) {
+    if (PACK_PDO.stateMachine >= AFE_STATE_DIAG0 && PACK_PDO.stateMachine <= AFE_STATE_DIAG2) {
+        AFEDiagClearLock();
+        diagLock = 0;
+    }
+    AFESafeMode(id);
+    s_afeRaw[id].primed = 0;
+    PACK_PDO.swAlertFlags = 0;
+    PACK_PDO.stateMachine = AFE_STATE_INIT;
+    PACK_EVENT(EVT_RESET, 0);
+}
+
+/**********************************************************************************************************
+ * Kommando aus der SDO-Queue in PACK_SDO übernehmen, pack 0 = alle aktiven Packs.
+ * Quittieren und Zurücksetzen wirken im folgenden bms_CyclicTask desselben Ticks.
+ **********************************************************************************************************/
+uint32_t bms_Command(uint32_t cmd, uint32_t pack, uint32_t arg) {
+    if (cmd == SDO_CMD_NONE || cmd >= SDO_CMD_COUNT)
+        return SDO_STATUS_BAD_COMMAND;
+    if (pack > g_GlobalConfig.numberOfPacks || (pack && !(g_packEnabled & (1 << (pack - 1)))))
+        return SDO_STATUS_BAD_PACK;
+
+    for (uint32_t id = 0; id < g_GlobalConfig.numberOfPacks; id++) {
+        if (!(g_packEnabled & (1 << id)) || (pack && pack != PACK_PDO.id))
+            continue;
+        switch (cmd) {
+            case SDO_CMD_CHARGE_ENABLE:
+                PACK_SDO.ChargeEnable = arg != 0;
+                break;
+            case SDO_CMD_DISCHARGE_ENABLE:
+                PACK_SDO.DischargeEnable = arg != 0;
+                break;
+            case SDO_CMD_CLEAR_ALERTS:
+                PACK_SDO.swAlertFlagsClear |= arg ? arg : UINT32_MAX;
+                break;
+            case SDO_CMD_RESET:
+                PACK_SDO.ResetStateMachine = 1;
+                break;
+        }
+    }
+    return SDO_STATUS_DONE;
+}
+
+/**********************************************************************************************************
+ * Systemweite Werte in GLOBAL_PDO_t, ein Durchlauf über alle aktiven Packs am Ende des Zyklus.
+ * Busspannung für MosControl (Vorladen) aus den zugeschalteten Packs, gilt ab dem nächsten Zyklus.
+ **********************************************************************************************************/
+void bms_Aggregate(void) {
+    GLOBAL_PDO_t *glob = g_GlobalPdoData;
+    float busVoltage = 0, cellSum = 0, tempSum = 0, socSum = 0, sohSum = 0;
+    uint32_t busPacks = 0, cellCount = 0, tempCount = 0, packs = 0;
+
+    glob->runPacks = glob->errorPacks = glob->warningPacks = 0;
+    glob->current = glob->availableChargeCurrent = glob->availableDischargeCurrent = 0;
+    glob->cellMin = glob->temperatureMin = FLT_MAX;
+    glob->cellMax = glob->temperatureMax = -FLT_MAX;
+    glob->cellMinPack = glob->cellMinCell = glob->cellMaxPack = glob->cellMaxCell = 0;
+    glob->temperatureMinPack = glob->temperatureMaxPack = 0;
+
+    for (uint32_t id = 0; id < g_GlobalConfig.numberOfPacks; id++) {
+        if (!(g_packEnabled & (1 << id)))
+            continue;
+        packs++;
+        glob->current += PACK_PDO.current;
+        glob->availableChargeCurrent += PACK_PDO.availableChargeCurrent;
+        glob->availableDischargeCurrent += PACK_PDO.availableDischargeCurrent;
+        socSum += PACK_PDO.stateOfCharge;
+        sohSum += PACK_PDO.stateOfHealth;
+        if (PACK_PDO.swAlertFlags)
+            glob->errorPacks |= 1 << id;
+        if (PACK_PDO.swWarningFlags)
+            glob->warningPacks |= 1 << id;
+        if (PACK_PDO.mosfetStatus_bits.CHARGE || PACK_PDO.mosfetStatus_bits.DISCHARGE) {
+            busVoltage += PACK_PDO.voltage;
+            busPacks++;
+        }
+        if (PACK_PDO.stateMachine != AFE_STATE_RUN && PACK_PDO.stateMachine != AFE_STATE_RUN_WARNING)
+            continue;
+
+        glob->runPacks |= 1 << id;
+        for (uint32_t c = 0; c < NUMBER_OF_CELLS; c++) {
+            float v = PACK_PDO.cells[c];
+            cellSum += v;
+            if (v < glob->cellMin) {
+                glob->cellMin = v;
+                glob->cellMinPack = PACK_PDO.id;
+                glob->cellMinCell = c;
+            }
+            if (v > glob->cellMax) {
+                glob->cellMax = v;
+                glob->cellMaxPack = PACK_PDO.id;
+                glob->cellMaxCell = c;
+            }
+        }
+        cellCount += NUMBER_OF_CELLS;
+        for (uint32_t n = 0; n < 4; n++) {
+            float t = PACK_PDO.ntcTemperature[n];
+            tempSum += t;
+            if (t < glob->temperatureMin) {
+                glob->temperatureMin = t;
+                glob->temperatureMinPack = PACK_PDO.id;
+            }
+            if (t > glob->temperatureMax) {
+                glob->temperatureMax = t;
+                glob->temperatureMaxPack = PACK_PDO.id;
+            }
+        }
+        tempCount += 4;
+    }
+
+    glob->voltage = busPacks ? busVoltage / busPacks : 0;
+    glob->stateOfCharge = packs ? socSum / packs : 0;
+    glob->stateOfHealth = packs ? sohSum / packs : 0;
+    glob->cellAvg = cellCount ? cellSum / cellCount : 0;
+    glob->temperatureAvg = tempCount ? tempSum / tempCount : 0;
+    if (!cellCount)
+        glob->cellMin = glob->cellMax = glob->temperatureMin = glob->temperatureMax = 0;
+}
+
+/**********************************************************************************************************
+ * Messdaten des Packs vorab lesen (I/O-Thread), während das vorherige Pack gerechnet wird.
+ * Nur im RUN-Mode, alle anderen States greifen selbst auf das AFE zu.
+ **********************************************************************************************************/
+void bms_Prefetch(uint32_t id) {
+    if (PACK_PDO.stateMachine == AFE_STATE_RUN || PACK_PDO.stateMachine == AFE_STATE_RUN_WARNING)
+        AFEFetchData(id, RunJobs(id));
+}
+
+// Zu Beginn jedes Ticks, vor bms_Prefetch und bms_CyclicTask
+void bms_Tick(void) {
+    s_tick++;
+}
+
 void bms_CyclicTask(uint32_t id) {
+    uint32_t jobs;
+    uint64_t t0;
+
+    // Kommandos (bms_Command) in jedem Zustand übernehmen
+    if (PACK_SDO.swAlertFlagsClear) {
+        uint32_t cleared = PACK_PDO.swAlertFlags & PACK_SDO.swAlertFlagsClear;
+        PACK_PDO.swAlertFlags &= ~PACK_SDO.swAlertFlagsClear;
+        PACK_SDO.swAlertFlagsClear = 0;
+        PACK_EVENT(EVT_ALERTS_CLEARED, cleared);
+    }
+    if (PACK_SDO.ResetStateMachine) {
+        PACK_SDO.ResetStateMachine = 0;
+        ResetStateMachine(id);
+    }
+
+    if (PACK_PDO.stateMachine != AFE_STATE_RUN && PACK_PDO.stateMachine != AFE_STATE_RUN_WARNING &&
+        !(JobsDue(id) & JOB(JOB_MEAS)))
+        return; // Init und Diagnose im Zyklus CYCLE_TIME_MS
+    uint64_t tTask = tim_Now();
+    int accounted = 0;              // SpiAccounting einmal je Aufruf
+
     switch(PACK_PDO.stateMachine)
     {
         case AFE_STATE_WAIT_INIT:
@@ -315,8 +666,14 @@ void bms_CyclicTask(uint32_t id) {
              * NEIN -> Warte
              *********************************************/
             if (AFECheckPowerupComplete()) { 
-                syslog(LOG_INFO, "PACK%u: PB7170 gefunden, initialisiere...", PACK_PDO.id);
-                AFESafeMode();
+                PACK_EVENT(EVT_AFE_FOUND, 0);
+                if (g_GlobalConfig.spiMaxSpeedHz) {
+                    if (spi_Calibrate(g_GlobalConfig.spiMaxSpeedHz))
+                        PACK_EVENT(EVT_CALIBRATION_FAILED, 0);
+                    PACK_EVENT(EVT_SPI_SPEED, spi_GetStats()->speedHz / 1000);
+                }
+                AFESafeMode(id);
+                s_afeRaw[id].primed = 0;
                 PACK_PDO.stateMachine = AFE_STATE_INIT;
             }
             break;
@@ -327,11 +684,11 @@ void bms_CyclicTask(uint32_t id) {
              * NEIN -> Fehler
              *********************************************/
             if (AFEInit(id) == 0) {
-                syslog(LOG_INFO, "PACK%u: Userconfig erfolgreich geschrieben", PACK_PDO.id);
                 PACK_PDO.stateMachine = AFE_STATE_WAIT_DIAG0;
+                PACK_EVENT(EVT_USER_WRITTEN, 0);
             } else {
-                syslog(LOG_INFO, "PACK%u: Fehler beim Schreiben der Userconfig", PACK_PDO.id);
                 PACK_PDO.stateMachine = AFE_STATE_ERROR;
+                PACK_EVENT(EVT_USER_WRITE_FAILED, 0);
                 break;
             }
             break;
@@ -354,7 +711,8 @@ void bms_CyclicTask(uint32_t id) {
              * Merke Werte für Standard
              * Setze alle Zellen auf Diagnose-Pullup
              *********************************************/
-            spi_AFEReadRegister(0x87,&diagData[0],NUMBER_OF_CELLS); //Werte Standard
+            if (spi_AFEReadRegister(0x87,&diagData[0],NUMBER_OF_CELLS)) //Werte Standard
+                break; // im nächsten Zyklus erneut
             AFEDiagPullUp();
             PACK_PDO.stateMachine = AFE_STATE_WAIT_DIAG1;
             break;
@@ -366,7 +724,8 @@ void bms_CyclicTask(uint32_t id) {
              * Merke Werte für Pullup
              * Setze alle Zellen auf Diagnose-Pulldown
              *********************************************/
-            spi_AFEReadRegister(0x87,&diagData[NUMBER_OF_CELLS],NUMBER_OF_CELLS); //Werte Pullup
+            if (spi_AFEReadRegister(0x87,&diagData[NUMBER_OF_CELLS],NUMBER_OF_CELLS)) //Werte Pullup
+                break; // im nächsten Zyklus erneut
             AFEDiagPullDown();
             PACK_PDO.stateMachine = AFE_STATE_WAIT_DIAG2;
             break;
@@ -379,17 +738,18 @@ void bms_CyclicTask(uint32_t id) {
              * Setze alle Zellen auf Standard
              * Kabelbrucherkennung
              *********************************************/
-            spi_AFEReadRegister(0x87,&diagData[2 * NUMBER_OF_CELLS],NUMBER_OF_CELLS); //Werte Pulldown
+            if (spi_AFEReadRegister(0x87,&diagData[2 * NUMBER_OF_CELLS],NUMBER_OF_CELLS)) //Werte Pulldown
+                break; // im nächsten Zyklus erneut
             AFEDiagClearLock();
             diagLock = 0;
 
             if(AFEWireDiag(diagData)) {
-                syslog(LOG_ALERT, "PACK%u: Diagnose fehlerhaft, deaktiviere Pack", PACK_PDO.id);
                 PACK_PDO_SWALERTFLAG_BITS.DIAG_ERR = 1;
                 PACK_PDO.stateMachine = AFE_STATE_ERROR;
+                PACK_EVENT(EVT_DIAG_FAILED, 0);
             } else {
-                syslog(LOG_INFO, "PACK%u: Diagnose erfolgreich", PACK_PDO.id);
                 PACK_PDO.stateMachine = AFE_STATE_CONFIG;
+                PACK_EVENT(EVT_DIAG_OK, 0);
             }
             break;
         case AFE_STATE_CONFIG:
@@ -399,41 +759,59 @@ void bms_CyclicTask(uint32_t id) {
              *********************************************/
             AFEClearAllErrors();
             AFEWatchdogEnable();
-            syslog(LOG_INFO, "PACK%u: Konfiguration fertig, RUN-Mode\n", PACK_PDO.id);
-            
             PACK_PDO.stateMachine = AFE_STATE_RUN;
+            PACK_EVENT(EVT_RUN, 0);
             break;
         case AFE_STATE_SANITY_CHECK:
             /*********************************************
              * Register prüfen
              *********************************************/
             if(!AFECheckPowerupComplete() && AFEVerifyUser(id)) {
-                syslog(LOG_ALERT, "PACK%u: Sanity-Check fehlerhaft, deaktiviere Pack\n", PACK_PDO.id);
                 PACK_PDO_SWALERTFLAG_BITS.CHIPSTATE_ERR = 1;
                 PACK_PDO.stateMachine = AFE_STATE_ERROR;
+                PACK_EVENT(EVT_SANITY_FAILED, 0);
             } else {
                 PACK_PDO.stateMachine = AFE_STATE_RUN;
             }
         case AFE_STATE_RUN_WARNING:
         case AFE_STATE_RUN:
             /*********************************************
-             * Daten lesen
+             * Daten lesen (je nach fälligen Jobs)
              * Parameter und Limits berechnen
+             * Zyklisch Userconfig prüfen
              * Fehlerhandling
              * Mosfets steuern
-             * SOC/SOH berechnen
-             * Zyklisch einen Sanity Check durchführen
+             * Balancer planen
              *********************************************/
-            AFEReadData(id);
-            CalculateParametersAndLimits(id);
+            jobs = RunJobs(id);
+            if (AFEReadData(id, jobs) == 0 && (jobs & JOB(JOB_MEAS))) {
+                t0 = tim_Now();
+                CalculateParametersAndLimits(id);
+                tim_Pack(id, TIMING_LIMITS, t0);
+            }
+            if ((jobs & JOB(JOB_VERIFY)) && AFEVerifyUser(id)) {
+                PACK_PDO_SWALERTFLAG_BITS.CHIPSTATE_ERR = 1;
+                PACK_PDO.stateMachine = AFE_STATE_ERROR; // MosControl schaltet noch ab
+                PACK_EVENT(EVT_USER_CHANGED, 0);
+            }
+            SpiAccounting(id);      // vor ErrorHandler, damit COMM_ERR noch in diesem Zyklus wirkt
+            accounted = 1;
+            t0 = tim_Now();
             ErrorHandler(id);
+            tim_Pack(id, TIMING_ERROR, t0);
+            t0 = tim_Now();
             MosControl(id);
-            if(PACK_PDO.hwBalancerTimer == 0)
+            tim_Pack(id, TIMING_MOS, t0);
+            // Periode entspricht dem Countdown in AFEBalancer, daher ohne Blick auf hwBalancerTimer
+            if (jobs & JOB(JOB_BALANCE)) {
+                t0 = tim_Now();
                 for (int i=0; i<NUMBER_OF_CELLS; i++)
                     if(PACK_PDO.cells[i] >= PACK_GENERALCONFIG->balancerStartVoltage) {
                         AFEBalancer(id);
                         break;
                     }
+                tim_Pack(id, TIMING_BALANCER, t0);
+            }
                 
             break;
         case AFE_STATE_ERROR:
@@ -441,4 +819,7 @@ void bms_CyclicTask(uint32_t id) {
         default:
             break;
     }
+    if (!accounted)
+        SpiAccounting(id);
+    tim_Pack(id, TIMING_TASK, tTask);
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #ifndef BMS_H
 #define BMS_H
 
+void bms_Tick(void);
+void bms_Prefetch(uint32_t id);
 void bms_CyclicTask(uint32_t id);
+void bms_Aggregate(void);
+uint32_t bms_Command(uint32_t cmd, uint32_t pack, uint32_t arg);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>      // für shm_open
+#include <sys/mman.h>   // für mmap
+#include <sys/stat.h>
+#include <unistd.h>
+#include <time.h>
+#include "bmsclient.h"
+
+#define BMSC_READ_TRIES 50           // Versuche bei laufendem Zyklus (seq ungerade)
+#define BMSC_RETRY_DELAY_NS 1000000  // Pause zwischen zwei Versuchen
+
+struct BMSC_s {
+    const PDO_HEADER_t *hdr;
+    size_t pdoSize;
+    const BMSC_SNAPSHOT_t *live;     // GLOBAL_PDO_t + PACK_PDO_t[] im Segment
+    void *sdo;
+    size_t sdoSize;
+    int sdoErrno;                    // Grund, wenn /battery_sdo_shm nicht schreibbar ist
+    SDO_QUEUE_t *queue;
+    const HISTORY_HEADER_t *hist;    // /battery_history_shm, NULL wenn nicht lesbar
+    size_t histSize;
+    int histErrno;
+    BMSC_SNAPSHOT_t *snapshot;       // Puffer für bmsc_Snapshot
+    uint32_t snapshotCycle;
+    int snapshotValid;
+};
+
+// ---------------------------------------------------------
+// Segment einblenden, Rückgabe: Adresse, NULL bei Fehler
+static void* MapShmem(const char *name, int writable, size_t *size) {
+    int fd = shm_open(name, writable ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return NULL;
+    }
+    *size = st.st_size;
+    void *ptr = mmap(NULL, *size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static void RetryDelay(void) {
+    struct timespec delay = { 0, BMSC_RETRY_DELAY_NS };
+    nanosleep(&delay, NULL);
+}
+
+// Seqlock-Kopie mit Wartezeit, solange bmsd den Zyklus schreibt
+static int ReadConsistent(const uint32_t *seq, const void *src, void *dst, size_t len) {
+    for (int i = 0; i < BMSC_READ_TRIES; i++) {
+        if (dob_ReadConsistent(seq, src, dst, len, 0) == 0)
+            return i;
+        RetryDelay();
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+// ---------------------------------------------------------
+// PDO-Segment prüfen und einblenden, Kommandoqueue nur wenn schreibbar
+BMSC_t* bmsc_Attach(void) {
+    BMSC_t *client = calloc(1, sizeof(BMSC_t));
+    if (!client)
+        return NULL;
+
+    client->hdr = MapShmem(SHMEM_BATTERYPDO, 0, &client->pdoSize);
+    if (!client->hdr) {
+        free(client);
+        return NULL;
+    }
+
+    const PDO_HEADER_t *hdr = client->hdr;
+    int err = 0;
+    if (client->pdoSize < sizeof(PDO_HEADER_t) || __atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != PDO_MAGIC)
+        err = EAGAIN; // bmsd legt das Segment gerade an
+    else if (hdr->layoutVersion != PDO_LAYOUT_VERSION || hdr->globalSize != sizeof(GLOBAL_PDO_t) ||
+             hdr->packSize != sizeof(PACK_PDO_t) || hdr->packOffset != hdr->globalOffset + sizeof(GLOBAL_PDO_t) ||
+             hdr->packOffset + (size_t)hdr->packSize * hdr->numberOfPacks > client->pdoSize)
+        err = EPROTO; // anderer Aufbau, gegen passende dataobjects.h bauen
+    if (err) {
+        bmsc_Detach(client);
+        errno = err;
+        return NULL;
+    }
+    client->live = (const BMSC_SNAPSHOT_t*)((const uint8_t*)hdr + hdr->globalOffset);
+
+    size_t queueOffset = sizeof(PACK_SDO_t) * hdr->numberOfPacks;
+    client->sdo = MapShmem(SHMEM_BATTERYSDO, 1, &client->sdoSize);
+    if (!client->sdo)
+        client->sdoErrno = errno;
+    else if (client->sdoSize < queueOffset + sizeof(SDO_QUEUE_t))
+        client->sdoErrno = EPROTO;
+    else {
+        client->queue = (SDO_QUEUE_t*)((uint8_t*)client->sdo + queueOffset);
+        if (client->sdoSize < queueOffset + sizeof(SDO_QUEUE_t) +
+                              client->queue->depth * (sizeof(SDO_CMD_t) + sizeof(SDO_ACK_t))) {
+            client->queue = NULL;
+            client->sdoErrno = EPROTO;
+        }
+    }
+
+    client->hist = MapShmem(SHMEM_HISTORY, 0, &client->histSize);
+    if (!client->hist)
+        client->histErrno = errno;
+    else if (client->histSize < sizeof(HISTORY_HEADER_t) || client->hist->numberOfPacks != hdr->numberOfPacks ||
+             client->hist->recordSize != sizeof(HISTORY_RECORD_t) + sizeof(PACK_PDO_t) * hdr->numberOfPacks ||
+             client->histSize < sizeof(HISTORY_HEADER_t) + (size_t)client->hist->recordSize * client->hist->depth) {
+        munmap((void*)client->hist, client->histSize);
+        client->hist = NULL;
+        client->histErrno = EPROTO;
+    }
+    return client;
+}
+
+void bmsc_Detach(BMSC_t *client) {
+    if (!client)
+        return;
+    if (client->hdr)
+        munmap((void*)client->hdr, client->pdoSize);
+    if (client->sdo)
+        munmap(client->sdo, client->sdoSize);
+    if (client->hist)
+        munmap((void*)client->hist, client->histSize);
+    free(client->snapshot);
+    free(client);
+}
+
+const PDO_HEADER_t* bmsc_Header(const BMSC_t *client) {
+    return client->hdr;
+}
+
+uint32_t bmsc_NumberOfPacks(const BMSC_t *client) {
+    return client->hdr->numberOfPacks;
+}
+
+size_t bmsc_SnapshotSize(const BMSC_t *client) {
+    return sizeof(BMSC_SNAPSHOT_t) + sizeof(PACK_PDO_t) * client->hdr->numberOfPacks;
+}
+
+// ---------------------------------------------------------
+// Kopien
+int bmsc_SnapshotCopy(BMSC_t *client, BMSC_SNAPSHOT_t *dst) {
+    return ReadConsistent(&client->live->glob.seq, client->live, dst, bmsc_SnapshotSize(client));
+}
+
+const BMSC_SNAPSHOT_t* bmsc_Snapshot(BMSC_t *client) {
+    if (!client->snapshot) {
+        client->snapshot = aligned_alloc(PDO_CACHE_LINE, bmsc_SnapshotSize(client));
+        if (!client->snapshot)
+            return NULL;
+    }
+
+    // cycle wird erst nach dem Zyklus erhöht: vorher lesen, schlimmstenfalls eine Kopie zu viel
+    uint32_t cycle = __atomic_load_n(&client->live->glob.cycle, __ATOMIC_ACQUIRE);
+    if (client->snapshotValid && cycle == client->snapshotCycle)
+        return client->snapshot;
+
+    if (ReadConsistent(&client->live->glob.seq, client->live, client->snapshot, bmsc_SnapshotSize(client)) >= 0) {
+        client->snapshotCycle = cycle;
+        client->snapshotValid = 1;
+    }
+    // sonst letzter konsistenter Stand
+    return client->snapshotValid ? client->snapshot : NULL;
+}
+
+int bmsc_PackCopy(BMSC_t *client, uint32_t pack, PACK_PDO_t *dst) {
+    if (pack >= client->hdr->numberOfPacks) {
+        errno = EINVAL;
+        return -1;
+    }
+    const PACK_PDO_t *src = &client->live->pack[pack];
+    return ReadConsistent(&src->seq, src, dst, sizeof(PACK_PDO_t));
+}
+
+// ---------------------------------------------------------
+// Ohne Kopie
+const BMSC_SNAPSHOT_t* bmsc_Live(const BMSC_t *client) {
+    return client->live;
+}
+
+uint32_t bmsc_ReadBegin(const BMSC_t *client) {
+    uint32_t seq;
+    while ((seq = __atomic_load_n(&client->live->glob.seq, __ATOMIC_ACQUIRE)) & 1)
+        RetryDelay();
+    return seq;
+}
+
+int bmsc_ReadRetry(const BMSC_t *client, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE); // Daten vor dem zweiten seq lesen
+    return __atomic_load_n(&client->live->glob.seq, __ATOMIC_RELAXED) != seq;
+}
+
+int64_t bmsc_WaitCycle(BMSC_t *client, uint32_t lastCycle, int timeoutMs) {
+    return dob_WaitCycle(&client->live->glob, lastCycle, timeoutMs);
+}
+
+// ---------------------------------------------------------
+// Verlauf
+size_t bmsc_HistoryRecordSize(const BMSC_t *client) {
+    return sizeof(HISTORY_RECORD_t) + sizeof(PACK_PDO_t) * client->hdr->numberOfPacks;
+}
+
+uint64_t bmsc_HistoryCycle(const BMSC_t *client) {
+    return client->hist ? __atomic_load_n(&client->hist->cycle, __ATOMIC_ACQUIRE) : 0;
+}
+
+int bmsc_HistoryRead(BMSC_t *client, uint64_t *next, void *dst, uint32_t maxRecords, uint64_t *lost) {
+    if (!client->hist) {
+        errno = client->histErrno;
+        return -1;
+    }
+    return dob_HistoryRead(client->hist, next, dst, maxRecords, lost);
+}
+
+// ---------------------------------------------------------
+// Kommandos
+int bmsc_Command(BMSC_t *client, uint32_t cmd, uint32_t pack, uint32_t arg, uint32_t *id) {
+    if (!client->queue) {
+        errno = client->sdoErrno;
+        return -1;
+    }
+    if (dob_CommandPush(client->queue, cmd, pack, arg, id) != 0) {
+        errno = EBUSY;
+        return -1;
+    }
+    return 0;
+}
+
+uint32_t bmsc_CommandStatus(const BMSC_t *client, uint32_t id) {
+    return client->queue ? dob_CommandStatus(client->queue, id) : SDO_STATUS_PENDING;
+}
+
+int bmsc_FieldOffset(const BMSC_t *client, const char *name, uint32_t scope) {
+    const PDO_FIELD_t *field = dob_FindField(client->hdr, name, scope);
+    return field ? field->offset : -1;
+}
\ No newline at end of file
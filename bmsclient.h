@@ -0,0 +1,66 @@
+#ifndef BMSCLIENT_H
+#define BMSCLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "dataobjects.h"
+
+/*
+ * libbmsclient: Lesezugriff auf /battery_pdo_shm und /battery_history_shm,
+ * Kommandos über /battery_sdo_shm für externe Prozesse (Wechselrichter-Bridge, Logger).
+ * Kapselt Segmentnamen, Header-Prüfung, Seqlock, Futex und Kommandoqueue.
+ * Ein Handle gehört einem Thread. Nach einem Neustart von bmsd neu anhängen.
+ * Fehler: NULL bzw. -1 und errno.
+ */
+
+#if defined(BMSCLIENT_BUILD)
+#define BMSC_API __attribute__((visibility("default")))
+#else
+#define BMSC_API
+#endif
+
+typedef struct BMSC_s BMSC_t;
+
+// Gleiches Layout wie das Segment ab PDO_HEADER_t.globalOffset
+typedef struct {
+    GLOBAL_PDO_t glob;
+    PACK_PDO_t pack[];
+} BMSC_SNAPSHOT_t;
+
+BMSC_API BMSC_t* bmsc_Attach(void);
+BMSC_API void bmsc_Detach(BMSC_t *client);
+
+BMSC_API const PDO_HEADER_t* bmsc_Header(const BMSC_t *client);
+BMSC_API uint32_t bmsc_NumberOfPacks(const BMSC_t *client);
+BMSC_API size_t bmsc_SnapshotSize(const BMSC_t *client);
+
+// Kopie: ganzer Zyklus in dst (bmsc_SnapshotSize Bytes). Rückgabe: Wiederholungen, -1
+BMSC_API int bmsc_SnapshotCopy(BMSC_t *client, BMSC_SNAPSHOT_t *dst);
+// Zeiger auf eine Kopie im Handle, nur bei neuem Zyklus neu gelesen. Gültig bis zum nächsten Aufruf
+BMSC_API const BMSC_SNAPSHOT_t* bmsc_Snapshot(BMSC_t *client);
+// Ein Pack über dessen eigene seq (pack = Index 0..numberOfPacks-1)
+BMSC_API int bmsc_PackCopy(BMSC_t *client, uint32_t pack, PACK_PDO_t *dst);
+
+// Ohne Kopie: live lesen und mit bmsc_ReadRetry prüfen, bei != 0 wiederholen
+BMSC_API const BMSC_SNAPSHOT_t* bmsc_Live(const BMSC_t *client);
+BMSC_API uint32_t bmsc_ReadBegin(const BMSC_t *client);
+BMSC_API int bmsc_ReadRetry(const BMSC_t *client, uint32_t seq);
+
+// Rückgabe: neuer Zyklus, -1 bei Timeout (timeoutMs < 0: ohne Timeout)
+BMSC_API int64_t bmsc_WaitCycle(BMSC_t *client, uint32_t lastCycle, int timeoutMs);
+
+// Verlauf (/battery_history_shm): je Zyklus HISTORY_RECORD_t + PACK_PDO_t[numberOfPacks],
+// bmsc_HistoryRecordSize Bytes. Liest ab Zyklus *next (0 = ältester im Ring) höchstens
+// maxRecords Einträge, überschriebene zählen in *lost. Rückgabe: Anzahl, -1 ohne Verlauf
+BMSC_API size_t bmsc_HistoryRecordSize(const BMSC_t *client);
+BMSC_API uint64_t bmsc_HistoryCycle(const BMSC_t *client);   // zuletzt veröffentlicht, 0 = keiner
+BMSC_API int bmsc_HistoryRead(BMSC_t *client, uint64_t *next, void *dst, uint32_t maxRecords, uint64_t *lost);
+
+// Werte wie ESdoCommand_t/ESdoStatus_t, pack = PACK_PDO_t.id, 0 für alle Packs
+BMSC_API int bmsc_Command(BMSC_t *client, uint32_t cmd, uint32_t pack, uint32_t arg, uint32_t *id);
+BMSC_API uint32_t bmsc_CommandStatus(const BMSC_t *client, uint32_t id);
+
+// Offset eines Feldes in GLOBAL_PDO_t/PACK_PDO_t laut Feldtabelle, -1 wenn unbekannt
+BMSC_API int bmsc_FieldOffset(const BMSC_t *client, const char *name, uint32_t scope);
+
+#endif
\ No newline at end of file
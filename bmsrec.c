@@ -0,0 +1,625 @@
+#define _GNU_SOURCE // strptime, timegm
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>         // für offsetof
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <syslog.h>
+#include <dirent.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bmsclient.h"
+
+/*
+ * bmsrec: zeichnet jeden Zyklus aus /battery_history_shm in Segmentdateien
+ * auf, mit -q werden Zeitbereiche je Pack bzw. Zelle als CSV ausgegeben.
+ * Je Pack werden die Kernwerte quantisiert (Zellen in mV, Temperaturen in
+ * 0.1 °C, ...) und gegen den vorigen Zyklus kodiert: Maske der geänderten
+ * Werte, dann je Wert die Differenz (Flags: XOR) als Varint. Ein Segment
+ * beginnt gegen Null und ist allein dekodierbar. Segmente sind per mmap
+ * eingeblendet und werden nur alle -i Sekunden per msync geschrieben
+ * (SD-Karte/eMMC), bei -s MB neu begonnen und ab -m MB von alt nach neu
+ * gelöscht. Der Kernel schreibt geänderte Seiten spätestens nach
+ * vm.dirty_expire_centisecs selbst, für große -i entsprechend anheben.
+ */
+
+#define REC_MAGIC 0x43455242        // "BREC"
+#define REC_VERSION 1               // Aufbau von s_recFields
+#define REC_MAX_VALUES 64           // Bits der Änderungsmaske
+#define REC_INVALID INT32_MIN       // NaN bzw. außerhalb des Wertebereichs
+#define REC_STALE_S 3               // ohne neuen Zyklus: neu anhängen (bmsd neu gestartet)
+#define REC_SEGMENT_MB 16
+#define REC_QUOTA_MB 1024
+#define REC_FLUSH_S 60
+
+// Segment: REC_HEADER_t, danach die Einträge bis used. Eintrag:
+//   varint  Zyklus - voriger Zyklus (> 1: Zyklen verloren)
+//   varint  ZigZag(Zeitabstand - voriger Zeitabstand), ms
+//   je Pack varint Änderungsmaske, je gesetztes Bit varint ZigZag(Differenz) bzw. XOR
+typedef struct {
+    uint32_t magic;                 // REC_MAGIC
+    uint32_t version;
+    uint32_t numberOfPacks;
+    uint32_t valueCount;
+    uint64_t firstCycle;
+    int64_t firstTimeMs;            // CLOCK_REALTIME
+    uint64_t lastCycle;             // Stand des letzten Flush
+    int64_t lastTimeMs;
+    uint64_t used;                  // gültige Bytes ab Dateianfang
+    uint64_t records;
+} __attribute__((aligned(64))) REC_HEADER_t;
+
+typedef struct {
+    const char *name;
+    uint16_t offset;                // in PACK_PDO_t
+    uint8_t count;
+    uint8_t xor;                    // 1: Bitmaske, 0: Zahl
+    float scale;                    // float-Feld: gespeichert round(Wert * scale), 0 = uint32_t
+} REC_FIELD_t;
+
+#define REC_FLOAT(f, n, scale) { #f, offsetof(PACK_PDO_t, f), n, 0, scale }
+#define REC_UINT(f, xor)       { #f, offsetof(PACK_PDO_t, f), 1, xor, 0 }
+
+// Reihenfolge = Bit in der Änderungsmaske, häufig geänderte Werte zuerst (kürzere Maske).
+// Änderungen hier erfordern REC_VERSION + 1
+static const REC_FIELD_t s_recFields[] = {
+    REC_FLOAT(current, 1, 1000),                    // mA
+    REC_FLOAT(fastCurrent, 1, 1000),
+    REC_FLOAT(voltage, 1, 1000),                    // mV
+    REC_FLOAT(cells, NUMBER_OF_CELLS, 1000),
+    REC_FLOAT(ntcTemperature, 4, 10),               // 0.1 °C
+    REC_FLOAT(dieTemperature, 1, 10),
+    REC_FLOAT(stateOfCharge, 1, 100),               // 0.01 %
+    REC_FLOAT(availableChargeCurrent, 1, 10),       // 0.1 A
+    REC_FLOAT(availableDischargeCurrent, 1, 10),
+    REC_FLOAT(prechargeResistorI2t, 1, 10),
+    REC_UINT(stateMachine, 0),
+    REC_UINT(swAlertFlags, 1),
+    REC_UINT(swWarningFlags, 1),
+    REC_UINT(mosfetStatus, 1),
+};
+
+// s_recFields aufgelöst in Einzelwerte
+typedef struct {
+    uint16_t offset;
+    uint8_t xor;
+    uint8_t decimals;               // Nachkommastellen bei der Ausgabe
+    float scale;
+    char name[32];
+} REC_VALUE_t;
+
+typedef struct {
+    uint64_t cycle;
+    int64_t timeMs;
+    int64_t deltaMs;
+    uint32_t value[MAX_BATTERY_PACKS][REC_MAX_VALUES];
+} REC_STATE_t;
+
+typedef struct {
+    int fd;
+    uint8_t *base;                  // NULL: kein offenes Segment
+    REC_HEADER_t *hdr;
+    size_t used;
+    uint64_t records;
+    REC_STATE_t state;
+    char path[PATH_MAX];
+} REC_SEGMENT_t;
+
+static REC_VALUE_t s_values[REC_MAX_VALUES];
+static uint32_t s_valueCount;
+static REC_SEGMENT_t s_seg;
+static const char *s_dir = ".";
+static size_t s_segmentSize = (size_t)REC_SEGMENT_MB << 20;
+static uint64_t s_quota = (uint64_t)REC_QUOTA_MB << 20;
+static volatile sig_atomic_t s_running = 1;
+
+static int InitValues(void) {
+    for (size_t f = 0; f < sizeof(s_recFields) / sizeof(s_recFields[0]); f++) {
+        for (uint32_t k = 0; k < s_recFields[f].count; k++) {
+            if (s_valueCount == REC_MAX_VALUES)
+                return -1;
+            REC_VALUE_t *v = &s_values[s_valueCount++];
+            v->offset = s_recFields[f].offset + k * 4;
+            v->xor = s_recFields[f].xor;
+            v->scale = s_recFields[f].scale;
+            for (float s = v->scale; s >= 10; s /= 10)
+                v->decimals++;
+            if (s_recFields[f].count > 1)
+                snprintf(v->name, sizeof(v->name), "%s[%u]", s_recFields[f].name, k);
+            else
+                snprintf(v->name, sizeof(v->name), "%s", s_recFields[f].name);
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------
+// Kodierung
+static uint8_t* PutVarint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+// NULL: Eintrag abgeschnitten
+static const uint8_t* GetVarint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        result |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static uint64_t ZigZag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t UnZigZag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint32_t Quantize(const REC_VALUE_t *v, const PACK_PDO_t *pack) {
+    const uint8_t *src = (const uint8_t*)pack + v->offset;
+    if (!v->scale) {
+        uint32_t u;
+        memcpy(&u, src, 4);
+        return u;
+    }
+    float f;
+    memcpy(&f, src, 4);
+    double q = (double)f * v->scale;
+    return q > -INT32_MAX && q < INT32_MAX ? (uint32_t)(int32_t)lrint(q) : (uint32_t)REC_INVALID; // auch NaN
+}
+
+static size_t RecordMaxSize(uint32_t numPacks) {
+    return 20 + numPacks * (10 + 10 * (size_t)s_valueCount);
+}
+
+static uint8_t* EncodeRecord(uint8_t *p, REC_STATE_t *st, uint32_t numPacks, uint64_t cycle, int64_t timeMs,
+                             const PACK_PDO_t *packs) {
+    int64_t deltaMs = timeMs - st->timeMs;
+    p = PutVarint(p, cycle - st->cycle);
+    p = PutVarint(p, ZigZag(deltaMs - st->deltaMs));
+    st->cycle = cycle;
+    st->timeMs = timeMs;
+    st->deltaMs = deltaMs;
+
+    for (uint32_t i = 0; i < numPacks; i++) {
+        uint32_t *prev = st->value[i];
+        uint32_t cur[REC_MAX_VALUES];
+        uint64_t mask = 0;
+        for (uint32_t v = 0; v < s_valueCount; v++) {
+            cur[v] = Quantize(&s_values[v], &packs[i]);
+            if (cur[v] != prev[v])
+                mask |= 1ULL << v;
+        }
+        p = PutVarint(p, mask);
+        for (uint32_t v = 0; v < s_valueCount; v++) {
+            if (!(mask & (1ULL << v)))
+                continue;
+            p = PutVarint(p, s_values[v].xor ? cur[v] ^ prev[v] : ZigZag((int64_t)(int32_t)cur[v] - (int32_t)prev[v]));
+            prev[v] = cur[v];
+        }
+    }
+    return p;
+}
+
+// Rückgabe: nächster Eintrag, NULL bei abgeschnittenem oder ungültigem Eintrag
+static const uint8_t* DecodeRecord(const uint8_t *p, const uint8_t *end, REC_STATE_t *st, uint32_t numPacks) {
+    uint64_t cycleDelta, deltaDelta;
+    if (!(p = GetVarint(p, end, &cycleDelta)) || !(p = GetVarint(p, end, &deltaDelta)))
+        return NULL;
+    st->cycle += cycleDelta;
+    st->deltaMs += UnZigZag(deltaDelta);
+    st->timeMs += st->deltaMs;
+
+    for (uint32_t i = 0; i < numPacks; i++) {
+        uint64_t mask, diff;
+        if (!(p = GetVarint(p, end, &mask)) || (s_valueCount < 64 && mask >> s_valueCount))
+            return NULL;
+        for (uint32_t v = 0; v < s_valueCount; v++) {
+            if (!(mask & (1ULL << v)))
+                continue;
+            if (!(p = GetVarint(p, end, &diff)))
+                return NULL;
+            st->value[i][v] = s_values[v].xor ? st->value[i][v] ^ (uint32_t)diff
+                                              : (uint32_t)((int32_t)st->value[i][v] + (int32_t)UnZigZag(diff));
+        }
+    }
+    return p;
+}
+
+// ---------------------------------------------------------
+// Segmentdateien, Name bmsrec-JJJJMMTT-hhmmss.mmm.seg (UTC), sortiert = zeitlich
+static int SegmentFilter(const struct dirent *d) {
+    size_t len = strlen(d->d_name);
+    return strncmp(d->d_name, "bmsrec-", 7) == 0 && len > 4 && strcmp(d->d_name + len - 4, ".seg") == 0;
+}
+
+// Älteste Segmente löschen, bis alle zusammen mit reserve unter s_quota liegen
+static void EnforceQuota(uint64_t reserve) {
+    struct dirent **list;
+    int n = scandir(s_dir, &list, SegmentFilter, alphasort);
+    if (n < 0)
+        return;
+
+    uint64_t total = 0;
+    uint64_t *size = calloc(n, sizeof(uint64_t));
+    char path[PATH_MAX];
+    for (int i = 0; size && i < n; i++) {
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", s_dir, list[i]->d_name);
+        if (stat(path, &st) == 0)
+            total += size[i] = (uint64_t)st.st_blocks * 512; // belegt, nicht Dateigröße (sparse)
+    }
+    for (int i = 0; size && i < n && total + reserve > s_quota; i++) {
+        snprintf(path, sizeof(path), "%s/%s", s_dir, list[i]->d_name);
+        if (unlink(path) != 0)
+            continue;
+        total -= size[i];
+        syslog(LOG_INFO, "Segment %s gelöscht (Quota)", path);
+    }
+    for (int i = 0; i < n; i++)
+        free(list[i]);
+    free(list);
+    free(size);
+}
+
+// Daten vor dem Header: nach einem Absturz endet das Segment beim letzten Flush
+static void SegmentFlush(void) {
+    if (!s_seg.base || s_seg.used == s_seg.hdr->used)
+        return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t from = s_seg.hdr->used & ~(page - 1);
+    msync(s_seg.base + from, s_seg.used - from, MS_SYNC);
+    s_seg.hdr->lastCycle = s_seg.state.cycle;
+    s_seg.hdr->lastTimeMs = s_seg.state.timeMs;
+    s_seg.hdr->records = s_seg.records;
+    s_seg.hdr->used = s_seg.used;
+    msync(s_seg.base, page, MS_SYNC);
+}
+
+static void SegmentClose(void) {
+    if (!s_seg.base)
+        return;
+    SegmentFlush();
+    munmap(s_seg.base, s_segmentSize);
+    if (ftruncate(s_seg.fd, s_seg.used) != 0)
+        syslog(LOG_WARNING, "ftruncate %s: %s", s_seg.path, strerror(errno));
+    close(s_seg.fd);
+    syslog(LOG_INFO, "Segment %s: %llu Zyklen, %zu Bytes", s_seg.path,
+           (unsigned long long)s_seg.records, s_seg.used);
+    s_seg.base = NULL;
+    s_seg.path[0] = 0;
+}
+
+// Platz wird vorab belegt: volles Dateisystem ergibt hier einen Fehler statt SIGBUS beim Schreiben
+static int SegmentOpen(uint32_t numPacks, uint64_t cycle, int64_t timeMs) {
+    char name[32];
+    time_t t = timeMs / 1000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(name, sizeof(name), "bmsrec-%Y%m%d-%H%M%S", &tm);
+    snprintf(s_seg.path, sizeof(s_seg.path), "%s/%s.%03u.seg", s_dir, name, (unsigned)(timeMs % 1000));
+
+    EnforceQuota(s_segmentSize);
+    s_seg.fd = open(s_seg.path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (s_seg.fd < 0 || (errno = posix_fallocate(s_seg.fd, 0, s_segmentSize)) != 0 ||
+        (s_seg.base = mmap(NULL, s_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, s_seg.fd, 0)) == MAP_FAILED) {
+        int err = errno;
+        if (s_seg.fd >= 0) {
+            close(s_seg.fd);
+            unlink(s_seg.path);
+        }
+        s_seg.base = NULL;
+        s_seg.path[0] = 0;
+        errno = err;
+        return -1;
+    }
+
+    s_seg.hdr = (REC_HEADER_t*)s_seg.base;
+    *s_seg.hdr = (REC_HEADER_t){
+        .magic = REC_MAGIC, .version = REC_VERSION, .numberOfPacks = numPacks, .valueCount = s_valueCount,
+        .firstCycle = cycle, .firstTimeMs = timeMs, .lastCycle = cycle, .lastTimeMs = timeMs,
+        .used = sizeof(REC_HEADER_t), .records = 0,
+    };
+    s_seg.used = sizeof(REC_HEADER_t);
+    s_seg.records = 0;
+    memset(&s_seg.state, 0, sizeof(s_seg.state));
+    return 0;
+}
+
+static int SegmentAppend(uint32_t numPacks, uint64_t cycle, int64_t timeMs, const PACK_PDO_t *packs) {
+    // bmsd neu gestartet (Zyklus kleiner) oder Segment voll: neues Segment
+    if (s_seg.base && (cycle <= s_seg.state.cycle || numPacks != s_seg.hdr->numberOfPacks ||
+                       s_seg.used + RecordMaxSize(numPacks) > s_segmentSize))
+        SegmentClose();
+    if (!s_seg.base && SegmentOpen(numPacks, cycle, timeMs) != 0)
+        return -1;
+
+    s_seg.used = EncodeRecord(s_seg.base + s_seg.used, &s_seg.state, numPacks, cycle, timeMs, packs) - s_seg.base;
+    s_seg.records++;
+    return 0;
+}
+
+// ---------------------------------------------------------
+// Aufzeichnung
+static int Record(int flushInterval) {
+    BMSC_t *client = NULL;
+    uint8_t *buf = NULL;
+    uint64_t next = 0, lost = 0, lostReported = 0;
+    uint32_t lastCycle = 0;
+    time_t lastChange = 0, lastFlush = time(NULL);
+    int failed = 0;
+
+    while (s_running) {
+        time_t now = time(NULL);
+        if (!client) {
+            uint64_t probe = 0, none = 0;
+            client = bmsc_Attach();
+            if (client && (bmsc_NumberOfPacks(client) > MAX_BATTERY_PACKS ||
+                           bmsc_HistoryRead(client, &probe, NULL, 0, &none) < 0)) {
+                if (bmsc_NumberOfPacks(client) > MAX_BATTERY_PACKS)
+                    errno = EPROTO;
+                int err = errno;
+                bmsc_Detach(client);
+                client = NULL;
+                errno = err;
+            }
+            if (!client) {
+                if (errno != ENOENT && errno != EAGAIN)
+                    syslog(LOG_ERR, "bmsc_Attach: %s", strerror(errno));
+                sleep(1);
+                continue;
+            }
+            free(buf);
+            buf = malloc(bmsc_HistoryRecordSize(client) * HISTORY_DEPTH);
+            if (!buf) {
+                syslog(LOG_ERR, "kein Speicher");
+                break;
+            }
+            next = bmsc_HistoryCycle(client); // ab dem aktuellen Zyklus, der Ring liegt schon im vorigen Segment
+            lastCycle = bmsc_Live(client)->glob.cycle;
+            lastChange = now;
+            SegmentClose();
+            syslog(LOG_INFO, "an bmsd angehängt: %u Packs, ab Zyklus %llu", bmsc_NumberOfPacks(client),
+                   (unsigned long long)next);
+        }
+
+        int64_t cycle = bmsc_WaitCycle(client, lastCycle, 1000);
+        if (cycle >= 0) {
+            lastCycle = cycle;
+            lastChange = now;
+        } else if (now - lastChange >= REC_STALE_S) {
+            bmsc_Detach(client);
+            client = NULL;
+            continue;
+        }
+
+        size_t recordSize = bmsc_HistoryRecordSize(client);
+        int n = bmsc_HistoryRead(client, &next, buf, HISTORY_DEPTH, &lost);
+        for (int i = 0; i < n; i++) {
+            const HISTORY_RECORD_t *rec = (const HISTORY_RECORD_t*)(buf + i * recordSize);
+            if (SegmentAppend(bmsc_NumberOfPacks(client), rec->cycle, rec->timeNs / 1000000,
+                              (const PACK_PDO_t*)(rec + 1)) == 0) {
+                failed = 0;
+            } else if (!failed++) {
+                syslog(LOG_ERR, "Segment %s: %s", s_dir, strerror(errno));
+            }
+        }
+        if (lost != lostReported) {
+            syslog(LOG_WARNING, "%llu Zyklen nicht aufgezeichnet", (unsigned long long)(lost - lostReported));
+            lostReported = lost;
+        }
+        if (now - lastFlush >= flushInterval) {
+            SegmentFlush();
+            lastFlush = now;
+        }
+    }
+
+    SegmentClose();
+    bmsc_Detach(client);
+    free(buf);
+    return 0;
+}
+
+// ---------------------------------------------------------
+// Abfrage
+static void PrintValue(const REC_VALUE_t *v, uint32_t q) {
+    if (!v->scale)
+        printf(v->xor ? ",0x%x" : ",%u", q);
+    else if ((int32_t)q == REC_INVALID)
+        printf(",nan");
+    else
+        printf(",%.*f", v->decimals, (int32_t)q / v->scale);
+}
+
+static int Query(int pack, int cell, int64_t fromMs, int64_t toMs) {
+    struct dirent **list;
+    int n = scandir(s_dir, &list, SegmentFilter, alphasort);
+    if (n < 0) {
+        perror(s_dir);
+        return 1;
+    }
+
+    REC_STATE_t state;
+    uint64_t records = 0, bytes = 0;
+    int segments = 0;
+    printf("time,cycle,pack");
+    for (uint32_t v = 0; v < s_valueCount; v++)
+        if (cell < 0 || s_values[v].offset == offsetof(PACK_PDO_t, cells) + cell * 4)
+            printf(",%s", s_values[v].name);
+    printf("\n");
+
+    for (int i = 0; i < n; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", s_dir, list[i]->d_name);
+        free(list[i]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(REC_HEADER_t)) {
+            if (fd >= 0)
+                close(fd);
+            continue;
+        }
+        uint8_t *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            continue;
+
+        const REC_HEADER_t *hdr = (const REC_HEADER_t*)base;
+        if (hdr->magic != REC_MAGIC || hdr->version != REC_VERSION || hdr->valueCount != s_valueCount ||
+            hdr->numberOfPacks > MAX_BATTERY_PACKS) {
+            fprintf(stderr, "%s: unbekanntes Format, übersprungen\n", path);
+        } else if (hdr->records && hdr->lastTimeMs >= fromMs && hdr->firstTimeMs <= toMs) {
+            const uint8_t *p = base + sizeof(REC_HEADER_t);
+            const uint8_t *end = base + (hdr->used < (uint64_t)st.st_size ? hdr->used : (uint64_t)st.st_size);
+            memset(&state, 0, sizeof(state));
+            segments++;
+            bytes += end - p;
+            while (p < end && (p = DecodeRecord(p, end, &state, hdr->numberOfPacks))) {
+                records++;
+                if (state.timeMs < fromMs || state.timeMs > toMs)
+                    continue;
+                char stamp[32];
+                time_t t = state.timeMs / 1000;
+                struct tm tm;
+                gmtime_r(&t, &tm);
+                strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+                for (uint32_t k = 0; k < hdr->numberOfPacks; k++) {
+                    if (pack && (uint32_t)pack != k + 1)
+                        continue;
+                    printf("%s.%03uZ,%llu,%u", stamp, (unsigned)(state.timeMs % 1000),
+                           (unsigned long long)state.cycle, k + 1);
+                    for (uint32_t v = 0; v < s_valueCount; v++)
+                        if (cell < 0 || s_values[v].offset == offsetof(PACK_PDO_t, cells) + cell * 4)
+                            PrintValue(&s_values[v], state.value[k][v]);
+                    printf("\n");
+                }
+            }
+            if (p != end)
+                fprintf(stderr, "%s: Eintrag nach Zyklus %llu ungültig\n", path, (unsigned long long)state.cycle);
+        }
+        munmap(base, st.st_size);
+    }
+    free(list);
+    if (records)
+        fprintf(stderr, "%d Segmente, %llu Zyklen, %.1f Bytes/Zyklus\n", segments,
+                (unsigned long long)records, (double)bytes / records);
+    return 0;
+}
+
+// Sekunden seit 1970 oder JJJJ-MM-TT[Thh:mm:ss] (UTC)
+static int ParseTime(const char *s, int64_t *ms) {
+    struct tm tm = { 0 };
+    const char *end = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (!end) {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(s, "%Y-%m-%d", &tm);
+    }
+    if (end && !*end) {
+        *ms = (int64_t)timegm(&tm) * 1000;
+        return 0;
+    }
+    char *num;
+    double sec = strtod(s, &num);
+    if (num == s || *num)
+        return -1;
+    *ms = (int64_t)(sec * 1000);
+    return 0;
+}
+
+// ---------------------------------------------------------
+static void SignalHandler(int sig) {
+    (void)sig;
+    s_running = 0;
+}
+
+static void Usage(const char *name) {
+    printf("Usage: %s [-d verzeichnis] [-s MB] [-m MB] [-i s]\n", name);
+    printf("       %s -q [-d verzeichnis] [-p pack] [-c zelle] [-f von] [-t bis]\n", name);
+    printf("  -d pfad       Verzeichnis der Segmente (Standard .)\n");
+    printf("  -s MB         Segmentgröße (Standard %d)\n", REC_SEGMENT_MB);
+    printf("  -m MB         alle Segmente zusammen höchstens (Standard %d)\n", REC_QUOTA_MB);
+    printf("  -i s          Sekunden zwischen zwei Schreibvorgängen (Standard %d)\n", REC_FLUSH_S);
+    printf("  -q            Abfrage als CSV auf stdout\n");
+    printf("  -p pack       nur dieses Pack (ab 1)\n");
+    printf("  -c zelle      nur diese Zelle (ab 0)\n");
+    printf("  -f/-t zeit    Zeitbereich, Sekunden seit 1970 oder JJJJ-MM-TT[Thh:mm:ss] UTC\n");
+}
+
+int main(int argc, char **argv) {
+    int query = 0, pack = 0, cell = -1, flushInterval = REC_FLUSH_S;
+    int64_t fromMs = INT64_MIN, toMs = INT64_MAX;
+    int opt;
+
+    if (InitValues() != 0) {
+        fprintf(stderr, "bmsrec: mehr als %d Werte je Pack\n", REC_MAX_VALUES);
+        return 1;
+    }
+    while ((opt = getopt(argc, argv, "d:s:m:i:qp:c:f:t:h")) != -1) {
+        switch (opt) {
+            case 'd':
+                s_dir = optarg;
+                break;
+            case 's':
+                s_segmentSize = (size_t)atoi(optarg) << 20;
+                break;
+            case 'm':
+                s_quota = (uint64_t)atoi(optarg) << 20;
+                break;
+            case 'i':
+                flushInterval = atoi(optarg);
+                break;
+            case 'q':
+                query = 1;
+                break;
+            case 'p':
+                pack = atoi(optarg);
+                break;
+            case 'c':
+                cell = atoi(optarg);
+                break;
+            case 'f':
+            case 't':
+                if (ParseTime(optarg, opt == 'f' ? &fromMs : &toMs) == 0)
+                    break;
+                fprintf(stderr, "bmsrec: ungültige Zeit %s\n", optarg);
+                return 1;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (cell >= NUMBER_OF_CELLS || s_segmentSize < ((size_t)1 << 20)) {
+        Usage(argv[0]);
+        return 1;
+    }
+    if (query)
+        return Query(pack, cell, fromMs, toMs);
+
+    openlog("bmsrec", LOG_PID | LOG_CONS, LOG_DAEMON);
+    struct sigaction sa = { .sa_handler = SignalHandler };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int ret = Record(flushInterval);
+    closelog();
+    return ret;
+}
\ No newline at end of file
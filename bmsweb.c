@@ -0,0 +1,1366 @@
+#define _GNU_SOURCE // strcasestr
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>       // für offsetof
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <syslog.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>      // für htonl/htons
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/mman.h>       // für mmap (/battery_timing_shm)
+#include <sys/uio.h>        // für writev
+#include <sys/sendfile.h>
+#include "bmsclient.h"
+
+/*
+ * bmsweb: HTTP-Server für das Dashboard, ersetzt pywebbms.py für
+ * /api/bmsdata, /api/timing, /api/history, /api/cmd und die statischen
+ * Dateien in webserver/.
+ * /api/bmsdata wird einmal je Zyklus direkt aus dem Snapshot nach CBOR
+ * kodiert, Feldnamen und Reihenfolge aus der Feldtabelle in PDO_HEADER_t
+ * (gleiche Form wie decode_pdo in pywebbms.py). Optional ?fields=a,b,c
+ * (Projektion) und ?typed=1 (Arrays als RFC 8746 Typed Arrays).
+ * /api/stream: Server-Sent Events, ein JSON-Objekt je Zyklus, zuerst der
+ * ganze Stand ("full"), danach nur geänderte Felder ("delta").
+ * /metrics: Prometheus-Textformat aus demselben Snapshot, der Text steht
+ * fest, je Zyklus werden nur die Werte an ihrer Stelle überschrieben.
+ * /api/timing und /api/history: gleiche Form wie in pywebbms.py, je Anfrage
+ * aus /battery_timing_shm bzw. über bmsc_HistoryRead kodiert.
+ */
+
+#define WEB_PORT 80
+#define WEB_MAX_CLIENTS 16          // gleichzeitige Verbindungen, ein Thread je Verbindung
+#define WEB_REQUEST_MAX 8192        // Request-Zeile + Header + Body
+#define WEB_IDLE_TIMEOUT_S 30       // Keep-Alive ohne Request
+#define WEB_ACK_TIMEOUT_MS 500      // wie SDO_ACK_TIMEOUT in pywebbms.py
+#define WEB_STALE_S 3               // ohne neuen Zyklus: neu anhängen (bmsd neu gestartet)
+#define WEB_STREAM_KEEPALIVE_S 2    // SSE-Kommentar, wenn kein Zyklus kommt
+#define WEB_HISTORY_MAX 64          // Einträge je /api/history, wie HISTORY_MAX_RECORDS in pywebbms.py
+#define WEB_METRIC_WIDTH 14         // Wert-Slot in /metrics, "-1.234568e+38"
+
+// Vorkodiertes Feld: Name als CBOR-Textstring bzw. JSON-Schlüssel + Position im Snapshot
+typedef struct {
+    uint8_t key[PDO_FIELD_NAME_LEN + 2];
+    uint8_t keyLen;
+    char jsonKey[PDO_FIELD_NAME_LEN + 4];  // "name":
+    uint8_t jsonKeyLen;
+    uint8_t type;
+    uint16_t count;
+    uint16_t offset;
+} WEB_FIELD_t;
+
+typedef struct {
+    WEB_FIELD_t *field;
+    uint32_t count;
+} WEB_SCHEMA_t;
+
+// Auswahl für /api/bmsdata?fields=...&typed=1, use[] = NULL: alle Felder
+typedef struct {
+    uint8_t *use[2];                // je Feld im Schema 0/1, Index EPdoScope_t
+    int typed;
+} WEB_PROJECTION_t;
+
+// Wert in /metrics: Slot im Text, rechtsbündig aus dem Snapshot überschrieben
+typedef struct {
+    uint32_t pos;                   // Slot im Text
+    uint32_t src;                   // Offset im Snapshot
+    uint8_t type;                   // EPdoType_t
+    int8_t bit;                     // Flag-Bit, -1 = ganzer Wert
+} WEB_METRIC_SLOT_t;
+
+// RFC 8746 Tags je EPdoType_t (Big Endian), 0 = kein Typed Array. Little Endian: +4
+static const uint8_t s_typedArrayTag[] = { 0, 64, 65, 66, 0, 74, 81 };
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CBOR_TAG_LE 4
+#else
+#define CBOR_TAG_LE 0
+#endif
+
+// Verbindungen lesen den Handle, nur das Neu-Anhängen schreibt
+static pthread_rwlock_t s_clientLock = PTHREAD_RWLOCK_INITIALIZER;
+static BMSC_t *s_client;
+static WEB_SCHEMA_t s_schema[2];    // Index EPdoScope_t
+
+// CBOR von /api/bmsdata, neu kodiert wenn sich glob.seq ändert
+static pthread_mutex_t s_cacheLock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t *s_cbor;
+static size_t s_cborSize;
+static size_t s_cborLen;
+static uint32_t s_cborSeq;
+static int s_cborValid;
+static size_t s_responseSize;       // größte Antwort aus dem Speicher (CBOR oder /metrics)
+
+// /metrics, Text je Anhängen aufgebaut, Werte unter s_cacheLock je glob.seq neu
+static char *s_metrics;
+static size_t s_metricsLen;
+static WEB_METRIC_SLOT_t *s_metricSlots;
+static uint32_t s_metricSlotCount;
+static uint32_t s_metricsSeq;
+static int s_metricsValid;
+
+// /api/stream: ein Paar Nachrichten je Zyklus für alle Stream-Verbindungen
+static pthread_mutex_t s_streamLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_streamCond = PTHREAD_COND_INITIALIZER;
+static char *s_streamFull;
+static char *s_streamDelta;
+static size_t s_streamFullLen;
+static size_t s_streamDeltaLen;
+static size_t s_streamSize;         // Größe beider Puffer
+static uint32_t s_streamCycle;      // Zyklus der Nachrichten
+static uint32_t s_streamBase;       // Zyklus, auf den sich delta bezieht
+static int s_streamValid;
+static int s_streamClients;         // atomar, ohne Verbindungen nichts kodieren
+static uint32_t s_generation;       // erhöht bei jedem Anhängen
+
+// /battery_timing_shm, NULL wenn nicht lesbar. Zähler ohne Seqlock wie in pywebbms.py
+static const TIMING_GLOBAL_t *s_timing;
+static size_t s_timingSize;
+
+static const char *s_root = "webserver";   // nur dieses Verzeichnis wird ausgeliefert
+static volatile sig_atomic_t s_running = 1;
+static int s_clients;               // atomar
+
+static const struct {
+    const char *name;
+    uint32_t cmd[2];
+    uint32_t arg[2];
+} s_webCommands[] = {                // wie WEB_COMMANDS in pywebbms.py, cmd 0 = unbenutzt
+    { "charge_on",     { SDO_CMD_CHARGE_ENABLE, 0 },    { 1, 0 } },
+    { "charge_off",    { SDO_CMD_CHARGE_ENABLE, 0 },    { 0, 0 } },
+    { "discharge_on",  { SDO_CMD_DISCHARGE_ENABLE, 0 }, { 1, 0 } },
+    { "discharge_off", { SDO_CMD_DISCHARGE_ENABLE, 0 }, { 0, 0 } },
+    { "all_on",        { SDO_CMD_CHARGE_ENABLE, SDO_CMD_DISCHARGE_ENABLE }, { 1, 1 } },
+    { "all_off",       { SDO_CMD_CHARGE_ENABLE, SDO_CMD_DISCHARGE_ENABLE }, { 0, 0 } },
+    { "clear_alerts",  { SDO_CMD_CLEAR_ALERTS, 0 },     { 0, 0 } },
+    { "reset",         { SDO_CMD_RESET, 0 },            { 0, 0 } },
+};
+static const char *s_statusText[] = { "pending", "done", "bad_command", "bad_pack" };
+static const char *s_timingGlobalNames[] = { "loop", "period", "iowait", "wakeup" };   // ETimingGlobalPhase_t
+static const char *s_timingPackNames[] = {                                           // ETimingPackPhase_t
+    "select", "burst", "convert", "limits", "error", "mos", "balancer", "task",
+};
+
+static const char *s_alertFlagNames[] = {     // Reihenfolge wie swAlertFlags_bits
+    "HW_CHARGE_OC", "HW_DISCHARGE_OC", "SW_CHARGE_OC", "SW_DISCHARGE_OC", "SHORT",
+    "CHIPSTATE_ERR", "HW_OVERTEMP", "HW_UNDERTEMP", "PACK_OVERTEMP", "PACK_UNDERTEMP",
+    "TEMP_MISMATCH", "COMM_ERR", "DIAG_ERR", "PACK_OV", "PACK_UV",
+    "CELL_OV", "CELL_UV", "CELL_MISMATCH", "PRECHARGE_FAIL", "CURRENT_ABNORMAL",
+};
+
+// Metriken für /metrics, Quelle ist das Feld gleichen Namens in der Feldtabelle.
+// Pack-Metriken mit Label pack (Index + 1), Arrays zusätzlich mit label = Index
+static const struct {
+    const char *field;
+    uint8_t scope;                  // EPdoScope_t
+    uint8_t flags;                  // 1: ein Wert 0/1 je Bit aus s_alertFlagNames
+    const char *name;
+    const char *type;
+    const char *label;
+    const char *help;
+} s_metricDefs[] = {
+    { "cycle",                PDO_SCOPE_GLOBAL, 0, "bms_cycles_total",            "counter", NULL,   "Vollständige Zyklen von bmsd" },
+    { "voltage",              PDO_SCOPE_GLOBAL, 0, "bms_bus_voltage_volts",       "gauge",   NULL,   "Busspannung, Mittel der zugeschalteten Packs" },
+    { "cells",                PDO_SCOPE_PACK,   0, "bms_cell_voltage_volts",      "gauge",   "cell", "Zellspannung" },
+    { "ntcTemperature",       PDO_SCOPE_PACK,   0, "bms_ntc_temperature_celsius", "gauge",   "ntc",  "NTC-Temperatur" },
+    { "current",              PDO_SCOPE_PACK,   0, "bms_current_amperes",         "gauge",   NULL,   "Packstrom" },
+    { "fastCurrent",          PDO_SCOPE_PACK,   0, "bms_fast_current_amperes",    "gauge",   NULL,   "Packstrom, schnelle Messung" },
+    { "stateMachine",         PDO_SCOPE_PACK,   0, "bms_state_machine",           "gauge",   NULL,   "Zustand, Wert aus EStateMachine_t" },
+    { "swAlertFlags",         PDO_SCOPE_PACK,   1, "bms_alert",                   "gauge",   "flag", "Alarm aktiv" },
+    { "swWarningFlags",       PDO_SCOPE_PACK,   0, "bms_warning_flags",           "gauge",   NULL,   "Warnungen, Rohwert swWarningFlags (Bits ohne Namen)" },
+    { "prechargeResistorI2t", PDO_SCOPE_PACK,   0, "bms_precharge_resistor_i2t",  "gauge",   NULL,   "I2t Vorladewiderstand" },
+    { "spiRetries",           PDO_SCOPE_PACK,   0, "bms_spi_retries_total",       "counter", NULL,   "SPI Wiederholungen" },
+    { "spiCrcErrors",         PDO_SCOPE_PACK,   0, "bms_spi_crc_errors_total",    "counter", NULL,   "SPI CRC-Fehler" },
+    { "spiIoctlErrors",       PDO_SCOPE_PACK,   0, "bms_spi_ioctl_errors_total",  "counter", NULL,   "SPI ioctl-Fehler" },
+    { "spiFailedCalls",       PDO_SCOPE_PACK,   0, "bms_spi_failed_calls_total",  "counter", NULL,   "SPI Aufrufe ohne Erfolg nach allen Wiederholungen" },
+};
+
+static const struct {
+    const char *ext;
+    const char *type;
+} s_mimeTypes[] = {
+    { ".html", "text/html; charset=utf-8" },
+    { ".js",   "application/javascript" },
+    { ".css",  "text/css" },
+    { ".json", "application/json" },
+    { ".svg",  "image/svg+xml" },
+    { ".png",  "image/png" },
+    { ".ico",  "image/x-icon" },
+};
+
+// ---------------------------------------------------------
+// CBOR
+static uint8_t* CborHead(uint8_t *p, uint8_t major, uint64_t value) {
+    major <<= 5;
+    if (value < 24) {
+        *p++ = major | value;
+    } else if (value <= UINT8_MAX) {
+        *p++ = major | 24;
+        *p++ = value;
+    } else if (value <= UINT16_MAX) {
+        uint16_t be = htons(value);
+        *p++ = major | 25;
+        memcpy(p, &be, 2);
+        p += 2;
+    } else if (value <= UINT32_MAX) {
+        uint32_t be = htonl(value);
+        *p++ = major | 26;
+        memcpy(p, &be, 4);
+        p += 4;
+    } else {
+        uint32_t be[2] = { htonl(value >> 32), htonl(value) };
+        *p++ = major | 27;
+        memcpy(p, be, 8);
+        p += 8;
+    }
+    return p;
+}
+
+static uint8_t* CborValue(uint8_t *p, const uint8_t *src, uint8_t type) {
+    switch (type) {
+        case PDO_TYPE_U8:  return CborHead(p, 0, *src);
+        case PDO_TYPE_U16: { uint16_t v; memcpy(&v, src, 2); return CborHead(p, 0, v); }
+        case PDO_TYPE_U32: { uint32_t v; memcpy(&v, src, 4); return CborHead(p, 0, v); }
+        case PDO_TYPE_U64: { uint64_t v; memcpy(&v, src, 8); return CborHead(p, 0, v); }
+        case PDO_TYPE_I32: {
+            int32_t v;
+            memcpy(&v, src, 4);
+            return v < 0 ? CborHead(p, 1, -1 - (int64_t)v) : CborHead(p, 0, v);
+        }
+        case PDO_TYPE_F32: {
+            uint32_t be;
+            memcpy(&be, src, 4);
+            be = htonl(be);
+            *p++ = 0xfa;
+            memcpy(p, &be, 4);
+            return p + 4;
+        }
+    }
+    return CborHead(p, 7, 23); // undefined
+}
+
+static size_t FieldElemSize(uint8_t type) {
+    return type == PDO_TYPE_U8 ? 1 : type == PDO_TYPE_U16 ? 2 : type == PDO_TYPE_U64 ? 8 : 4;
+}
+
+// use = NULL: alle Felder, typed: Arrays als Byte-String mit RFC 8746 Tag (Host-Byteorder)
+static uint8_t* CborStruct(uint8_t *p, const WEB_SCHEMA_t *schema, const uint8_t *use, int typed, const uint8_t *base) {
+    uint32_t count = schema->count;
+    if (use) {
+        count = 0;
+        for (uint32_t i = 0; i < schema->count; i++)
+            count += use[i];
+    }
+    p = CborHead(p, 5, count);
+    for (uint32_t i = 0; i < schema->count; i++) {
+        const WEB_FIELD_t *f = &schema->field[i];
+        if (use && !use[i])
+            continue;
+        memcpy(p, f->key, f->keyLen);
+        p += f->keyLen;
+        if (f->count == 1) {
+            p = CborValue(p, base + f->offset, f->type);
+            continue;
+        }
+        size_t elem = FieldElemSize(f->type);
+        if (typed && s_typedArrayTag[f->type]) {
+            p = CborHead(p, 6, s_typedArrayTag[f->type] + (elem > 1 ? CBOR_TAG_LE : 0));
+            p = CborHead(p, 2, elem * f->count);
+            memcpy(p, base + f->offset, elem * f->count);
+            p += elem * f->count;
+            continue;
+        }
+        p = CborHead(p, 4, f->count);
+        for (uint32_t k = 0; k < f->count; k++)
+            p = CborValue(p, base + f->offset + k * elem, f->type);
+    }
+    return p;
+}
+
+// Schema aus der Feldtabelle, Rückgabe: maximale CBOR-Länge von /api/bmsdata, 0 bei Fehler
+static size_t BuildSchema(BMSC_t *client, WEB_SCHEMA_t schema[2]) {
+    const PDO_HEADER_t *hdr = bmsc_Header(client);
+    const PDO_FIELD_t *table = (const PDO_FIELD_t*)((const uint8_t*)hdr + hdr->fieldOffset);
+    size_t maxSize[2] = { 9, 9 };
+
+    for (int s = 0; s < 2; s++) {
+        schema[s].field = calloc(hdr->fieldCount, sizeof(WEB_FIELD_t));
+        schema[s].count = 0;
+        if (!schema[s].field)
+            return 0;
+    }
+    for (uint32_t i = 0; i < hdr->fieldCount; i++) {
+        const PDO_FIELD_t *t = &table[i];
+        if (t->scope > PDO_SCOPE_PACK || t->type < PDO_TYPE_U8 || t->type > PDO_TYPE_F32)
+            continue; // unbekannt (neueres bmsd): auslassen
+        WEB_FIELD_t *f = &schema[t->scope].field[schema[t->scope].count++];
+        size_t nameLen = strnlen(t->name, PDO_FIELD_NAME_LEN);
+        f->keyLen = CborHead(f->key, 3, nameLen) - f->key;
+        memcpy(f->key + f->keyLen, t->name, nameLen);
+        f->keyLen += nameLen;
+        f->jsonKeyLen = sprintf(f->jsonKey, "\"%.*s\":", (int)nameLen, t->name);
+        f->type = t->type;
+        f->count = t->count;
+        f->offset = t->offset;
+        maxSize[t->scope] += f->keyLen + 9 + 9 * (size_t)f->count;
+    }
+    return 16 + maxSize[PDO_SCOPE_GLOBAL] + 9 + maxSize[PDO_SCOPE_PACK] * hdr->numberOfPacks;
+}
+
+// ---------------------------------------------------------
+// JSON für /api/stream
+static size_t JsonMaxSize(const WEB_SCHEMA_t *schema) {
+    size_t size = 2;
+    for (uint32_t i = 0; i < schema->count; i++)
+        size += schema->field[i].jsonKeyLen + 4 + 24 * (size_t)schema->field[i].count;
+    return size;
+}
+
+static char* JsonPut(char *p, const uint8_t *src, uint8_t type) {
+    switch (type) {
+        case PDO_TYPE_U8:  return p + sprintf(p, "%u", *src);
+        case PDO_TYPE_U16: { uint16_t v; memcpy(&v, src, 2); return p + sprintf(p, "%u", v); }
+        case PDO_TYPE_U32: { uint32_t v; memcpy(&v, src, 4); return p + sprintf(p, "%u", v); }
+        case PDO_TYPE_U64: { uint64_t v; memcpy(&v, src, 8); return p + sprintf(p, "%llu", (unsigned long long)v); }
+        case PDO_TYPE_I32: { int32_t v; memcpy(&v, src, 4); return p + sprintf(p, "%d", v); }
+        case PDO_TYPE_F32: {
+            float v;
+            memcpy(&v, src, 4);
+            if (v != v || v - v != 0)
+                return p + sprintf(p, "null"); // NaN/Inf gibt es in JSON nicht
+            return p + sprintf(p, "%.7g", v);
+        }
+    }
+    return p + sprintf(p, "null");
+}
+
+// Felder von base als JSON-Objekt, mit prev nur die geänderten
+static char* JsonStruct(char *p, const WEB_SCHEMA_t *schema, const uint8_t *base, const uint8_t *prev) {
+    *p++ = '{';
+    char *first = p;
+    for (uint32_t i = 0; i < schema->count; i++) {
+        const WEB_FIELD_t *f = &schema->field[i];
+        size_t elem = FieldElemSize(f->type);
+        if (prev && memcmp(base + f->offset, prev + f->offset, elem * f->count) == 0)
+            continue;
+        if (p != first)
+            *p++ = ',';
+        memcpy(p, f->jsonKey, f->jsonKeyLen);
+        p += f->jsonKeyLen;
+        if (f->count == 1) {
+            p = JsonPut(p, base + f->offset, f->type);
+            continue;
+        }
+        *p++ = '[';
+        for (uint32_t k = 0; k < f->count; k++) {
+            if (k)
+                *p++ = ',';
+            p = JsonPut(p, base + f->offset + k * elem, f->type);
+        }
+        *p++ = ']';
+    }
+    *p++ = '}';
+    return p;
+}
+
+static size_t JsonSnapshot(char *out, const BMSC_SNAPSHOT_t *snap, const BMSC_SNAPSHOT_t *prev,
+                           uint32_t numPacks, uint32_t cycle, uint32_t base) {
+    char *p = out;
+    p += prev ? sprintf(p, "{\"cycle\":%u,\"base\":%u,\"glob\":", cycle, base) : sprintf(p, "{\"cycle\":%u,\"glob\":", cycle);
+    p = JsonStruct(p, &s_schema[PDO_SCOPE_GLOBAL], (const uint8_t*)&snap->glob, prev ? (const uint8_t*)&prev->glob : NULL);
+    p += sprintf(p, ",\"pack\":[");
+    for (uint32_t i = 0; i < numPacks; i++) {
+        if (i)
+            *p++ = ',';
+        p = JsonStruct(p, &s_schema[PDO_SCOPE_PACK], (const uint8_t*)&snap->pack[i],
+                       prev ? (const uint8_t*)&prev->pack[i] : NULL);
+    }
+    p += sprintf(p, "]}");
+    return p - out;
+}
+
+// Wartet auf jeden Zyklus und erzeugt full/delta für alle Stream-Verbindungen
+static void* StreamThread(void *arg) {
+    (void)arg;
+    BMSC_SNAPSHOT_t *snap[2] = { NULL, NULL };
+    uint32_t generation = 0, lastCycle = 0, prevCycle = 0;
+    size_t snapSize = 0;
+    int havePrev = 0, cur = 0;
+
+    while (s_running) {
+        pthread_rwlock_rdlock(&s_clientLock);
+        if (!s_client) {
+            pthread_rwlock_unlock(&s_clientLock);
+            sleep(1);
+            continue;
+        }
+        if (generation != s_generation) {
+            // (neu) angehängt: Puffer an Pack-Anzahl und Schema anpassen
+            generation = s_generation;
+            snapSize = bmsc_SnapshotSize(s_client);
+            size_t jsonSize = 64 + JsonMaxSize(&s_schema[PDO_SCOPE_GLOBAL]) +
+                              JsonMaxSize(&s_schema[PDO_SCOPE_PACK]) * bmsc_NumberOfPacks(s_client);
+            for (int i = 0; i < 2; i++) {
+                free(snap[i]);
+                snap[i] = aligned_alloc(PDO_CACHE_LINE, (snapSize + PDO_CACHE_LINE - 1) & ~(size_t)(PDO_CACHE_LINE - 1));
+            }
+            pthread_mutex_lock(&s_streamLock);
+            free(s_streamFull);
+            free(s_streamDelta);
+            s_streamFull = malloc(jsonSize);
+            s_streamDelta = malloc(jsonSize);
+            s_streamSize = jsonSize;
+            s_streamValid = 0;
+            pthread_mutex_unlock(&s_streamLock);
+            havePrev = 0;
+            if (!snap[0] || !snap[1] || !s_streamFull || !s_streamDelta) {
+                syslog(LOG_ERR, "/api/stream: kein Speicher");
+                pthread_rwlock_unlock(&s_clientLock);
+                break;
+            }
+        }
+
+        int64_t cycle = bmsc_WaitCycle(s_client, lastCycle, 1000);
+        if (cycle < 0 || !__atomic_load_n(&s_streamClients, __ATOMIC_RELAXED)) {
+            // ohne Verbindungen nur mitzählen, der nächste Leser beginnt mit full
+            if (cycle >= 0)
+                lastCycle = cycle;
+            havePrev = 0;
+            pthread_rwlock_unlock(&s_clientLock);
+            continue;
+        }
+        lastCycle = cycle;
+        if (bmsc_SnapshotCopy(s_client, snap[cur]) < 0) {
+            pthread_rwlock_unlock(&s_clientLock);
+            continue;
+        }
+
+        uint32_t numPacks = bmsc_NumberOfPacks(s_client);
+        pthread_mutex_lock(&s_streamLock);
+        s_streamFullLen = JsonSnapshot(s_streamFull, snap[cur], NULL, numPacks, cycle, 0);
+        s_streamDeltaLen = havePrev ? JsonSnapshot(s_streamDelta, snap[cur], snap[cur ^ 1], numPacks, cycle, prevCycle) : 0;
+        s_streamBase = havePrev ? prevCycle : 0;
+        s_streamCycle = cycle;
+        s_streamValid = 1;
+        pthread_cond_broadcast(&s_streamCond);
+        pthread_mutex_unlock(&s_streamLock);
+        pthread_rwlock_unlock(&s_clientLock);
+
+        prevCycle = cycle;
+        havePrev = 1;
+        cur ^= 1;
+    }
+    free(snap[0]);
+    free(snap[1]);
+    return NULL;
+}
+
+static uint8_t* CborBmsData(uint8_t *p, const BMSC_SNAPSHOT_t *snap, const WEB_PROJECTION_t *proj) {
+    p = CborHead(p, 5, 2);
+    p = CborHead(p, 3, 4);
+    memcpy(p, "glob", 4);
+    p = CborStruct(p + 4, &s_schema[PDO_SCOPE_GLOBAL], proj->use[PDO_SCOPE_GLOBAL], proj->typed,
+                   (const uint8_t*)&snap->glob);
+    p = CborHead(p, 3, 4);
+    memcpy(p, "pack", 4);
+    p = CborHead(p + 4, 4, bmsc_NumberOfPacks(s_client));
+    for (uint32_t i = 0; i < bmsc_NumberOfPacks(s_client); i++)
+        p = CborStruct(p, &s_schema[PDO_SCOPE_PACK], proj->use[PDO_SCOPE_PACK], proj->typed,
+                       (const uint8_t*)&snap->pack[i]);
+    return p;
+}
+
+// Aufruf unter s_clientLock (lesend). Ohne Projektion aus dem gemeinsamen Cache,
+// sonst je Anfrage aus dem Snapshot (nur die ausgewählten Felder)
+static size_t EncodeBmsData(uint8_t *out, size_t outSize, const WEB_PROJECTION_t *proj) {
+    static const WEB_PROJECTION_t all = { { NULL, NULL }, 0 };
+    size_t len = 0;
+
+    pthread_mutex_lock(&s_cacheLock);
+    const BMSC_SNAPSHOT_t *snap = bmsc_Snapshot(s_client);
+    if (proj) {
+        if (snap && s_cborSize <= outSize)
+            len = CborBmsData(out, snap, proj) - out;
+        pthread_mutex_unlock(&s_cacheLock);
+        return len;
+    }
+    if (snap && (!s_cborValid || snap->glob.seq != s_cborSeq)) {
+        s_cborLen = CborBmsData(s_cbor, snap, &all) - s_cbor;
+        s_cborSeq = snap->glob.seq;
+        s_cborValid = 1;
+    }
+    if (s_cborValid && s_cborLen <= outSize) {
+        memcpy(out, s_cbor, s_cborLen);
+        len = s_cborLen;
+    }
+    pthread_mutex_unlock(&s_cacheLock);
+    return len;
+}
+
+// ---------------------------------------------------------
+// /api/timing, /api/history
+static uint8_t* CborText(uint8_t *p, const char *text) {
+    size_t len = strlen(text);
+    p = CborHead(p, 3, len);
+    memcpy(p, text, len);
+    return p + len;
+}
+
+// Felder wie timing_phase_dict in pywebbms.py, höchstens WEB_TIMING_PHASE_MAX Bytes
+#define WEB_TIMING_PHASE_MAX (64 + 9 * TIMING_BUCKETS)
+static uint8_t* CborTimingPhase(uint8_t *p, const TIMING_PHASE_t *src) {
+    TIMING_PHASE_t ph = *src;
+    p = CborHead(p, 5, 5);
+    p = CborHead(CborText(p, "count"), 0, ph.count);
+    p = CborHead(CborText(p, "minNs"), 0, ph.count ? ph.minNs : 0);
+    p = CborHead(CborText(p, "maxNs"), 0, ph.maxNs);
+    p = CborHead(CborText(p, "meanNs"), 0, ph.count ? ph.sumNs / ph.count : 0);
+    p = CborHead(CborText(p, "hist"), 4, TIMING_BUCKETS);
+    for (int b = 0; b < TIMING_BUCKETS; b++)
+        p = CborHead(p, 0, ph.hist[b]);
+    return p;
+}
+
+// Aufruf unter s_clientLock (lesend). Rückgabe: Länge, 0 ohne passendes Segment
+static size_t EncodeTiming(uint8_t **out) {
+    const TIMING_GLOBAL_t *t = s_timing;
+    *out = NULL;
+    if (!t)
+        return 0;
+    TIMING_GLOBAL_t glob = *t;
+    size_t phases = glob.globalPhases + (size_t)glob.packPhases * glob.numberOfPacks;
+    if (glob.globalPhases != TIMING_GLOBAL_PHASES || glob.packPhases != TIMING_PACK_PHASES ||
+        glob.buckets != TIMING_BUCKETS || s_timingSize < sizeof(glob) + phases * sizeof(TIMING_PHASE_t))
+        return 0;
+    *out = malloc(256 + phases * WEB_TIMING_PHASE_MAX);
+    if (!*out)
+        return 0;
+
+    const TIMING_PHASE_t *phase = (const TIMING_PHASE_t*)(t + 1);
+    uint8_t *p = CborHead(*out, 5, 10);
+    p = CborHead(CborText(p, "numberOfPacks"), 0, glob.numberOfPacks);
+    p = CborHead(CborText(p, "globalPhases"), 0, glob.globalPhases);
+    p = CborHead(CborText(p, "packPhases"), 0, glob.packPhases);
+    p = CborHead(CborText(p, "buckets"), 0, glob.buckets);
+    p = CborHead(CborText(p, "tickNs"), 0, glob.tickNs);
+    p = CborHead(CborText(p, "ticks"), 0, glob.ticks);
+    p = CborHead(CborText(p, "overruns"), 0, glob.overruns);
+    p = CborHead(CborText(p, "missedTicks"), 0, glob.missedTicks);
+    p = CborHead(CborText(p, "global"), 5, TIMING_GLOBAL_PHASES);
+    for (int i = 0; i < TIMING_GLOBAL_PHASES; i++)
+        p = CborTimingPhase(CborText(p, s_timingGlobalNames[i]), &phase[i]);
+    p = CborHead(CborText(p, "pack"), 4, glob.numberOfPacks);
+    for (uint32_t pack = 0; pack < glob.numberOfPacks; pack++) {
+        p = CborHead(p, 5, TIMING_PACK_PHASES);
+        for (int i = 0; i < TIMING_PACK_PHASES; i++)
+            p = CborTimingPhase(CborText(p, s_timingPackNames[i]),
+                                &phase[TIMING_GLOBAL_PHASES + pack * TIMING_PACK_PHASES + i]);
+    }
+    return p - *out;
+}
+
+// Aufruf unter s_clientLock (lesend). Einträge ab *next wie history_data in pywebbms.py,
+// Rückgabe: Länge, 0 bei Fehler (errno von bmsc_HistoryRead)
+static size_t EncodeHistory(uint8_t **out, uint64_t next, uint32_t maxRecords) {
+    const uint32_t numPacks = bmsc_NumberOfPacks(s_client);
+    const size_t recordSize = bmsc_HistoryRecordSize(s_client);
+    uint8_t *rec = malloc(recordSize * (maxRecords ? maxRecords : 1));
+    uint64_t lost = 0;
+    int n = rec ? bmsc_HistoryRead(s_client, &next, rec, maxRecords, &lost) : -1;
+    *out = n >= 0 ? malloc(48 + n * (48 + s_cborSize)) : NULL;   // s_cborSize: glob + alle Packs
+    if (!*out) {
+        free(rec);
+        return 0;
+    }
+
+    uint8_t *p = CborHead(*out, 5, 3);
+    p = CborHead(CborText(p, "next"), 0, next);
+    p = CborHead(CborText(p, "lost"), 0, lost);
+    p = CborHead(CborText(p, "records"), 4, n);
+    for (int i = 0; i < n; i++) {
+        const uint8_t *r = rec + i * recordSize;
+        const HISTORY_RECORD_t *h = (const HISTORY_RECORD_t*)r;
+        p = CborHead(p, 5, 3);
+        p = CborHead(CborText(p, "cycle"), 0, h->cycle);
+        p = CborHead(CborText(p, "timeNs"), 0, h->timeNs);
+        p = CborHead(CborText(p, "pack"), 4, numPacks);
+        for (uint32_t k = 0; k < numPacks; k++)
+            p = CborStruct(p, &s_schema[PDO_SCOPE_PACK], NULL, 0, r + sizeof(HISTORY_RECORD_t) + k * sizeof(PACK_PDO_t));
+    }
+    free(rec);
+    return p - *out;
+}
+
+// ---------------------------------------------------------
+// /metrics
+static const PDO_FIELD_t* MetricField(BMSC_t *client, size_t def) {
+    const PDO_FIELD_t *f = dob_FindField(bmsc_Header(client), s_metricDefs[def].field, s_metricDefs[def].scope);
+    // U64 passt nicht in den Slot, Flags nur aus 32 Bit
+    if (!f || f->type < PDO_TYPE_U8 || f->type > PDO_TYPE_F32 || f->type == PDO_TYPE_U64 ||
+        (s_metricDefs[def].flags && f->type != PDO_TYPE_U32))
+        return NULL;
+    return f;
+}
+
+// Text mit HELP/TYPE, Namen und Labels, Werte als Leerzeichen-Slots (vor dem Wert
+// erlaubt das Textformat beliebig viele Leerzeichen). Rückgabe: Länge, 0 bei Fehler
+static size_t BuildMetrics(BMSC_t *client, char **text, WEB_METRIC_SLOT_t **slots, uint32_t *slotCount) {
+    const uint32_t numPacks = bmsc_NumberOfPacks(client);
+    const size_t nDefs = sizeof(s_metricDefs) / sizeof(s_metricDefs[0]);
+    const size_t nFlags = sizeof(s_alertFlagNames) / sizeof(s_alertFlagNames[0]);
+    uint32_t samples = 0;
+
+    for (size_t d = 0; d < nDefs; d++) {
+        const PDO_FIELD_t *f = MetricField(client, d);
+        if (f)
+            samples += (s_metricDefs[d].flags ? nFlags : f->count) * (s_metricDefs[d].scope == PDO_SCOPE_PACK ? numPacks : 1);
+    }
+    *text = malloc(nDefs * 256 + samples * (size_t)(96 + WEB_METRIC_WIDTH));
+    *slots = malloc(samples * sizeof(WEB_METRIC_SLOT_t));
+    if (!*text || !*slots) {
+        free(*text);
+        free(*slots);
+        return 0;
+    }
+
+    char *p = *text;
+    uint32_t n = 0;
+    for (size_t d = 0; d < nDefs; d++) {
+        const PDO_FIELD_t *f = MetricField(client, d);
+        if (!f)
+            continue; // älteres bmsd ohne das Feld
+        const int pack = s_metricDefs[d].scope == PDO_SCOPE_PACK;
+        const uint32_t count = s_metricDefs[d].flags ? nFlags : f->count;
+        p += sprintf(p, "# HELP %s %s\n# TYPE %s %s\n", s_metricDefs[d].name, s_metricDefs[d].help,
+                     s_metricDefs[d].name, s_metricDefs[d].type);
+        for (uint32_t i = 0; i < (pack ? numPacks : 1); i++) {
+            for (uint32_t k = 0; k < count; k++) {
+                WEB_METRIC_SLOT_t *s = &(*slots)[n++];
+                p += sprintf(p, "%s", s_metricDefs[d].name);
+                if (pack && s_metricDefs[d].flags)
+                    p += sprintf(p, "{pack=\"%u\",%s=\"%s\"}", i + 1, s_metricDefs[d].label, s_alertFlagNames[k]);
+                else if (pack && s_metricDefs[d].label)
+                    p += sprintf(p, "{pack=\"%u\",%s=\"%u\"}", i + 1, s_metricDefs[d].label, k);
+                else if (pack)
+                    p += sprintf(p, "{pack=\"%u\"}", i + 1);
+                else if (s_metricDefs[d].label)
+                    p += sprintf(p, "{%s=\"%u\"}", s_metricDefs[d].label, k);
+                *p++ = ' ';
+                s->pos = p - *text;
+                s->src = (pack ? offsetof(BMSC_SNAPSHOT_t, pack) + i * sizeof(PACK_PDO_t)
+                               : offsetof(BMSC_SNAPSHOT_t, glob)) + f->offset;
+                s->src += s_metricDefs[d].flags ? 0 : k * FieldElemSize(f->type);
+                s->type = f->type;
+                s->bit = s_metricDefs[d].flags ? (int8_t)k : -1;
+                memset(p, ' ', WEB_METRIC_WIDTH);
+                p += WEB_METRIC_WIDTH;
+                *p++ = '\n';
+            }
+        }
+    }
+    *slotCount = n;
+    return p - *text;
+}
+
+// Aufruf unter s_cacheLock, Werte aus snap in die Slots
+static void PatchMetrics(const BMSC_SNAPSHOT_t *snap) {
+    const uint8_t *base = (const uint8_t*)snap;
+    char value[32];
+
+    for (uint32_t i = 0; i < s_metricSlotCount; i++) {
+        const WEB_METRIC_SLOT_t *s = &s_metricSlots[i];
+        const uint8_t *src = base + s->src;
+        int len;
+        if (s->bit >= 0) {
+            uint32_t v;
+            memcpy(&v, src, 4);
+            len = sprintf(value, "%u", (v >> s->bit) & 1);
+        } else if (s->type == PDO_TYPE_F32) {
+            float v;
+            memcpy(&v, src, 4);
+            len = v != v ? sprintf(value, "NaN") : v - v != 0 ? sprintf(value, v > 0 ? "+Inf" : "-Inf")
+                                                             : sprintf(value, "%.7g", v);
+        } else {
+            len = JsonPut(value, src, s->type) - value;
+        }
+        char *slot = s_metrics + s->pos;
+        memset(slot, ' ', WEB_METRIC_WIDTH - len);
+        memcpy(slot + WEB_METRIC_WIDTH - len, value, len);
+    }
+}
+
+// ---------------------------------------------------------
+// Anhängen an bmsd, bei Neustart von bmsd neu
+static const TIMING_GLOBAL_t* MapTiming(size_t *size) {
+    int fd = shm_open(SHMEM_TIMING, O_RDONLY, 0);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void *ptr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TIMING_GLOBAL_t)) {
+        *size = st.st_size;
+        ptr = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+static int Attach(void) {
+    BMSC_t *client = bmsc_Attach();
+    if (!client)
+        return -1;
+
+    WEB_SCHEMA_t schema[2] = { 0 };
+    size_t size = BuildSchema(client, schema);
+    uint8_t *cbor = size ? malloc(size) : NULL;
+    char *metrics = NULL;
+    WEB_METRIC_SLOT_t *slots = NULL;
+    uint32_t slotCount = 0;
+    size_t metricsLen = cbor ? BuildMetrics(client, &metrics, &slots, &slotCount) : 0;
+    if (!metricsLen) {
+        free(cbor);
+        free(schema[0].field);
+        free(schema[1].field);
+        bmsc_Detach(client);
+        return -1;
+    }
+
+    size_t timingSize = 0;
+    const TIMING_GLOBAL_t *timing = MapTiming(&timingSize);   // optional, sonst /api/timing 503
+
+    pthread_rwlock_wrlock(&s_clientLock);
+    BMSC_t *old = s_client;
+    const TIMING_GLOBAL_t *oldTiming = s_timing;
+    size_t oldTimingSize = s_timingSize;
+    s_timing = timing;
+    s_timingSize = timingSize;
+    free(s_schema[0].field);
+    free(s_schema[1].field);
+    free(s_cbor);
+    s_client = client;
+    s_schema[0] = schema[0];
+    s_schema[1] = schema[1];
+    s_cbor = cbor;
+    s_cborSize = size;
+    s_cborValid = 0;
+    free(s_metrics);
+    free(s_metricSlots);
+    s_metrics = metrics;
+    s_metricsLen = metricsLen;
+    s_metricSlots = slots;
+    s_metricSlotCount = slotCount;
+    s_metricsValid = 0;
+    s_responseSize = size > metricsLen ? size : metricsLen;
+    s_generation++;
+    pthread_rwlock_unlock(&s_clientLock);
+
+    bmsc_Detach(old);
+    if (oldTiming)
+        munmap((void*)oldTiming, oldTimingSize);
+    syslog(LOG_INFO, "an bmsd angehängt: %u Packs, %u Felder", bmsc_NumberOfPacks(client),
+           bmsc_Header(client)->fieldCount);
+    return 0;
+}
+
+// ---------------------------------------------------------
+// HTTP
+static int SendAll(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int SendResponse(int fd, const char *status, const char *type, const void *body, size_t len, int keepAlive) {
+    char header[256];
+    int hlen = snprintf(header, sizeof(header),
+                        "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                        "Cache-Control: no-store\r\nConnection: %s\r\n\r\n",
+                        status, type, len, keepAlive ? "keep-alive" : "close");
+    struct iovec iov[2] = { { header, hlen }, { (void*)body, len } };
+    return SendAll(fd, iov, len ? 2 : 1);
+}
+
+static int SendError(int fd, const char *status, int keepAlive) {
+    return SendResponse(fd, status, "text/plain", status, strlen(status), keepAlive);
+}
+
+static const char* MimeType(const char *path) {
+    const char *ext = strrchr(path, '.');
+    for (size_t i = 0; ext && i < sizeof(s_mimeTypes) / sizeof(s_mimeTypes[0]); i++)
+        if (strcmp(ext, s_mimeTypes[i].ext) == 0)
+            return s_mimeTypes[i].type;
+    return "application/octet-stream";
+}
+
+static int SendFile(int fd, const char *urlPath, int keepAlive) {
+    char path[1280];
+
+    if (urlPath[0] != '/' || strstr(urlPath, ".."))
+        return SendError(fd, "403 Forbidden", keepAlive);
+    if (snprintf(path, sizeof(path), "%s%s", s_root, strcmp(urlPath, "/") ? urlPath : "/index.html") >= (int)sizeof(path))
+        return SendError(fd, "414 URI Too Long", keepAlive);
+
+    int file = open(path, O_RDONLY);
+    struct stat st;
+    if (file < 0 || fstat(file, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (file >= 0)
+            close(file);
+        return SendError(fd, "404 Not Found", keepAlive);
+    }
+
+    char header[256];
+    int hlen = snprintf(header, sizeof(header),
+                        "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %lld\r\nConnection: %s\r\n\r\n",
+                        MimeType(path), (long long)st.st_size, keepAlive ? "keep-alive" : "close");
+    struct iovec iov = { header, hlen };
+    int ret = SendAll(fd, &iov, 1);
+    off_t offset = 0;
+    while (ret == 0 && offset < st.st_size) {
+        ssize_t n = sendfile(fd, file, &offset, st.st_size - offset);
+        if (n <= 0 && !(n < 0 && errno == EINTR))
+            ret = -1;
+    }
+    close(file);
+    return ret;
+}
+
+// GET /api/stream, läuft bis die Verbindung abbricht
+static int HandleStream(int fd) {
+    static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                 "Cache-Control: no-store\r\nConnection: close\r\n\r\nretry: 2000\n\n";
+    struct iovec iov[3] = { { (void*)header, sizeof(header) - 1 } };
+    if (SendAll(fd, iov, 1) != 0)
+        return -1;
+
+    __atomic_add_fetch(&s_streamClients, 1, __ATOMIC_RELAXED);
+    char *msg = NULL;
+    size_t msgSize = 0;
+    uint32_t last = 0;
+    int haveLast = 0;
+    for (;;) {
+        char head[64];
+        int hlen;
+        size_t len;
+
+        pthread_mutex_lock(&s_streamLock);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += WEB_STREAM_KEEPALIVE_S;
+        while (s_running && (!s_streamValid || (haveLast && s_streamCycle == last)))
+            if (pthread_cond_timedwait(&s_streamCond, &s_streamLock, &deadline) == ETIMEDOUT)
+                break;
+        if (!s_running || !s_streamValid || (haveLast && s_streamCycle == last)) {
+            pthread_mutex_unlock(&s_streamLock);
+            if (!s_running)
+                break;
+            iov[0] = (struct iovec){ ": \n\n", 3 };
+            if (SendAll(fd, iov, 1) != 0)
+                break;
+            continue;
+        }
+
+        // delta nur, wenn es genau an die zuletzt gesendete Nachricht anschließt
+        int delta = haveLast && s_streamDeltaLen && s_streamBase == last;
+        len = delta ? s_streamDeltaLen : s_streamFullLen;
+        if (msgSize < s_streamSize) {
+            free(msg);
+            msgSize = s_streamSize;
+            msg = malloc(msgSize);
+        }
+        if (msg)
+            memcpy(msg, delta ? s_streamDelta : s_streamFull, len);
+        last = s_streamCycle;
+        haveLast = 1;
+        pthread_mutex_unlock(&s_streamLock);
+        if (!msg)
+            break;
+
+        hlen = snprintf(head, sizeof(head), "id: %u\nevent: %s\ndata: ", last, delta ? "delta" : "full");
+        iov[0] = (struct iovec){ head, hlen };
+        iov[1] = (struct iovec){ msg, len };
+        iov[2] = (struct iovec){ "\n\n", 2 };
+        if (SendAll(fd, iov, 3) != 0)
+            break;
+    }
+    free(msg);
+    __atomic_sub_fetch(&s_streamClients, 1, __ATOMIC_RELAXED);
+    return -1; // Verbindung schließen
+}
+
+// Wert zu "key" in einem flachen JSON-Objekt, NULL wenn nicht vorhanden
+static const char* JsonValue(const char *json, const char *key) {
+    char quoted[40];
+    snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+    const char *p = strstr(json, quoted);
+    if (!p)
+        return NULL;
+    p += strlen(quoted);
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (*p++ != ':')
+        return NULL;
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+// POST /api/cmd {"cmd": "...", "pack": n|null}, Antwort wie pywebbms.py
+static int HandleCommand(int fd, const char *body, int keepAlive) {
+    char name[32] = "";
+    uint32_t pack = 0;
+
+    const char *v = JsonValue(body, "cmd");
+    if (v && *v == '"')
+        sscanf(v + 1, "%31[^\"]", name);
+    v = JsonValue(body, "pack");
+    if (v && *v >= '0' && *v <= '9')
+        pack = strtoul(v, NULL, 10);
+
+    size_t nameLen = strlen(name);
+    if (nameLen > 4 && strcmp(name + nameLen - 4, "_all") == 0) {
+        name[nameLen - 4] = 0;
+        pack = 0;
+    }
+
+    size_t c = 0;
+    while (c < sizeof(s_webCommands) / sizeof(s_webCommands[0]) && strcmp(s_webCommands[c].name, name))
+        c++;
+    if (c == sizeof(s_webCommands) / sizeof(s_webCommands[0])) {
+        char msg[96];
+        int len = snprintf(msg, sizeof(msg), "{\"error\": \"unbekanntes Kommando %s\"}", name);
+        return SendResponse(fd, "400 Bad Request", "application/json", msg, len, keepAlive);
+    }
+
+    uint32_t id[2], status[2] = { 0 };
+    int n = 0;
+    pthread_rwlock_rdlock(&s_clientLock);
+    for (; n < 2 && s_webCommands[c].cmd[n]; n++) {
+        if (bmsc_Command(s_client, s_webCommands[c].cmd[n], pack, s_webCommands[c].arg[n], &id[n]) != 0) {
+            pthread_rwlock_unlock(&s_clientLock);
+            const char *msg = "{\"error\": \"Kommandoqueue voll\"}";
+            return SendResponse(fd, "503 Service Unavailable", "application/json", msg, strlen(msg), keepAlive);
+        }
+    }
+
+    struct timespec now, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += WEB_ACK_TIMEOUT_MS * 1000000L;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+    deadline.tv_nsec %= 1000000000L;
+    uint32_t cycle = bmsc_Live(s_client)->glob.cycle;
+    for (;;) {
+        int pending = 0;
+        for (int i = 0; i < n; i++)
+            pending |= (status[i] = bmsc_CommandStatus(s_client, id[i])) == SDO_STATUS_PENDING;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int64_t leftMs = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+        if (!pending || leftMs <= 0)
+            break;
+        int64_t next = bmsc_WaitCycle(s_client, cycle, leftMs);
+        if (next >= 0)
+            cycle = next;
+    }
+    pthread_rwlock_unlock(&s_clientLock);
+
+    char msg[160];
+    int len = snprintf(msg, sizeof(msg), "{\"ids\": [");
+    for (int i = 0; i < n; i++)
+        len += snprintf(msg + len, sizeof(msg) - len, "%s%u", i ? ", " : "", id[i]);
+    len += snprintf(msg + len, sizeof(msg) - len, "], \"status\": [");
+    for (int i = 0; i < n; i++)
+        len += snprintf(msg + len, sizeof(msg) - len, "%s\"%s\"", i ? ", " : "",
+                        status[i] < 4 ? s_statusText[status[i]] : "unknown");
+    len += snprintf(msg + len, sizeof(msg) - len, "]}");
+    return SendResponse(fd, "200 OK", "application/json", msg, len, keepAlive);
+}
+
+// Wert eines Query-Parameters URL-dekodiert nach out, 0 wenn nicht vorhanden
+static int QueryParam(const char *query, const char *name, char *out, size_t outSize) {
+    size_t nameLen = strlen(name);
+    for (const char *p = query; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+        if (strncmp(p, name, nameLen) || p[nameLen] != '=')
+            continue;
+        size_t n = 0;
+        for (p += nameLen + 1; *p && *p != '&' && n + 1 < outSize; p++) {
+            unsigned hex;
+            if (*p == '%' && sscanf(p + 1, "%2x", &hex) == 1) {
+                out[n++] = hex;
+                p += 2;
+            } else
+                out[n++] = *p == '+' ? ' ' : *p;
+        }
+        out[n] = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// GET /api/bmsdata[?fields=a,b,c][&typed=1]
+static int HandleBmsData(int fd, const char *query, int keepAlive, uint8_t *cbor, size_t cborSize) {
+    WEB_PROJECTION_t proj = { { NULL, NULL }, 0 };
+    char fields[512], typed[8];
+    size_t len = 0;
+
+    if (query && QueryParam(query, "typed", typed, sizeof(typed)))
+        proj.typed = strcmp(typed, "0") != 0;
+
+    pthread_rwlock_rdlock(&s_clientLock);
+    if (!s_client) {
+        pthread_rwlock_unlock(&s_clientLock);
+        return SendError(fd, "503 Service Unavailable", keepAlive);
+    }
+    int project = query && QueryParam(query, "fields", fields, sizeof(fields));
+    if (project) {
+        for (int s = 0; s < 2; s++)
+            proj.use[s] = calloc(s_schema[s].count + 1, 1);
+        char *save = NULL;
+        for (char *name = strtok_r(fields, ", ", &save); name && proj.use[0] && proj.use[1];
+             name = strtok_r(NULL, ", ", &save)) {
+            size_t nameLen = strlen(name);
+            int found = 0;
+            for (int s = 0; s < 2; s++) {
+                for (uint32_t i = 0; i < s_schema[s].count; i++) {
+                    const WEB_FIELD_t *f = &s_schema[s].field[i];
+                    if (f->jsonKeyLen == nameLen + 3 && memcmp(f->jsonKey + 1, name, nameLen) == 0)
+                        found = proj.use[s][i] = 1;
+                }
+            }
+            if (!found) {
+                char msg[96];
+                int msgLen = snprintf(msg, sizeof(msg), "{\"error\": \"unbekanntes Feld %.40s\"}", name);
+                pthread_rwlock_unlock(&s_clientLock);
+                free(proj.use[0]);
+                free(proj.use[1]);
+                return SendResponse(fd, "400 Bad Request", "application/json", msg, msgLen, keepAlive);
+            }
+        }
+    }
+    if (!project || (proj.use[0] && proj.use[1])) // sonst kein Speicher
+        len = EncodeBmsData(cbor, cborSize, project || proj.typed ? &proj : NULL);
+    pthread_rwlock_unlock(&s_clientLock);
+    free(proj.use[0]);
+    free(proj.use[1]);
+
+    if (!len)
+        return SendError(fd, "503 Service Unavailable", keepAlive);
+    return SendResponse(fd, "200 OK", "application/cbor", cbor, len, keepAlive);
+}
+
+// GET /api/timing
+static int HandleTiming(int fd, int keepAlive) {
+    uint8_t *out;
+    pthread_rwlock_rdlock(&s_clientLock);
+    size_t len = EncodeTiming(&out);
+    pthread_rwlock_unlock(&s_clientLock);
+
+    int ret = len ? SendResponse(fd, "200 OK", "application/cbor", out, len, keepAlive)
+                  : SendError(fd, "503 Service Unavailable", keepAlive);
+    free(out);
+    return ret;
+}
+
+// GET /api/history[?since=<Zyklus>][&max=<n>], since 0 = ältester verfügbarer, max <= WEB_HISTORY_MAX
+static int HandleHistory(int fd, const char *query, int keepAlive) {
+    unsigned long long since = 0, max = WEB_HISTORY_MAX;
+    char value[24], *end;
+
+    if (query && QueryParam(query, "since", value, sizeof(value))) {
+        since = strtoull(value, &end, 10);
+        if (*value < '0' || *value > '9' || *end)
+            return SendError(fd, "400 Bad Request", keepAlive);
+    }
+    if (query && QueryParam(query, "max", value, sizeof(value))) {
+        max = strtoull(value, &end, 10);
+        if (*value < '0' || *value > '9' || *end)
+            return SendError(fd, "400 Bad Request", keepAlive);
+    }
+    if (max > WEB_HISTORY_MAX)
+        max = WEB_HISTORY_MAX;
+
+    uint8_t *out = NULL;
+    size_t len = 0;
+    pthread_rwlock_rdlock(&s_clientLock);
+    if (s_client)
+        len = EncodeHistory(&out, since, max);
+    pthread_rwlock_unlock(&s_clientLock);
+
+    int ret = len ? SendResponse(fd, "200 OK", "application/cbor", out, len, keepAlive)
+                  : SendError(fd, "503 Service Unavailable", keepAlive);
+    free(out);
+    return ret;
+}
+
+// GET /metrics, aus bmsc_Snapshot wie /api/bmsdata, also immer ein vollständiger Zyklus
+static int HandleMetrics(int fd, int keepAlive, uint8_t *out, size_t outSize) {
+    size_t len = 0;
+
+    pthread_rwlock_rdlock(&s_clientLock);
+    if (s_client) {
+        pthread_mutex_lock(&s_cacheLock);
+        const BMSC_SNAPSHOT_t *snap = bmsc_Snapshot(s_client);
+        if (snap && (!s_metricsValid || snap->glob.seq != s_metricsSeq)) {
+            PatchMetrics(snap);
+            s_metricsSeq = snap->glob.seq;
+            s_metricsValid = 1;
+        }
+        if (s_metricsValid && s_metricsLen <= outSize) {
+            memcpy(out, s_metrics, s_metricsLen);
+            len = s_metricsLen;
+        }
+        pthread_mutex_unlock(&s_cacheLock);
+    }
+    pthread_rwlock_unlock(&s_clientLock);
+
+    if (!len)
+        return SendError(fd, "503 Service Unavailable", keepAlive);
+    return SendResponse(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", out, len, keepAlive);
+}
+
+static int HandleRequest(int fd, char *method, char *path, const char *body, int keepAlive, uint8_t *cbor, size_t cborSize) {
+    char *query = strchr(path, '?');
+    if (query)
+        *query++ = 0;
+
+    if (strcmp(path, "/api/bmsdata") == 0 && strcmp(method, "GET") == 0)
+        return HandleBmsData(fd, query, keepAlive, cbor, cborSize);
+    if (strcmp(path, "/api/stream") == 0 && strcmp(method, "GET") == 0)
+        return HandleStream(fd);
+    if (strcmp(path, "/metrics") == 0 && strcmp(method, "GET") == 0)
+        return HandleMetrics(fd, keepAlive, cbor, cborSize);
+    if (strcmp(path, "/api/timing") == 0 && strcmp(method, "GET") == 0)
+        return HandleTiming(fd, keepAlive);
+    if (strcmp(path, "/api/history") == 0 && strcmp(method, "GET") == 0)
+        return HandleHistory(fd, query, keepAlive);
+    if (strcmp(path, "/api/cmd") == 0 && strcmp(method, "POST") == 0)
+        return s_client ? HandleCommand(fd, body, keepAlive) : SendError(fd, "503 Service Unavailable", keepAlive);
+    if (strncmp(path, "/api/", 5) == 0)
+        return SendError(fd, "404 Not Found", keepAlive);
+    if (strcmp(method, "GET") == 0)
+        return SendFile(fd, path, keepAlive);
+    return SendError(fd, "405 Method Not Allowed", 0);
+}
+
+// Nur Ziffern (davor/danach Leerzeichen), kein Vorzeichen, kein Überlauf
+static int ParseContentLength(const char *value, size_t *length) {
+    while (*value == ' ' || *value == '\t')
+        value++;
+    if (*value < '0' || *value > '9')
+        return -1;
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(value, &end, 10);
+    while (*end == ' ' || *end == '\t')
+        end++;
+    if (errno == ERANGE || v > SIZE_MAX || (*end && *end != '\r'))
+        return -1;
+    *length = v;
+    return 0;
+}
+
+static void* ClientThread(void *arg) {
+    int fd = (intptr_t)arg;
+    char *buf = malloc(WEB_REQUEST_MAX + 1);
+    size_t cborSize = 0;
+    uint8_t *cbor = NULL;
+    size_t have = 0;
+
+    while (buf) {
+        // Header vollständig einlesen
+        char *end;
+        buf[have] = 0;
+        while (!(end = strstr(buf, "\r\n\r\n"))) {
+            if (have == WEB_REQUEST_MAX)
+                goto done;
+            ssize_t n = recv(fd, buf + have, WEB_REQUEST_MAX - have, 0);
+            if (n <= 0)
+                goto done;
+            have += n;
+            buf[have] = 0;
+        }
+        *end = 0;
+        char *body = end + 4;
+
+        char method[8], path[1024], version[16];
+        if (sscanf(buf, "%7s %1023s %15s", method, path, version) != 3) {
+            SendError(fd, "400 Bad Request", 0);
+            break;
+        }
+
+        int keepAlive = strcmp(version, "HTTP/1.1") == 0;
+        size_t contentLength = 0;
+        for (char *line = strstr(buf, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+            if (strncasecmp(line + 2, "Content-Length:", 15) == 0) {
+                if (ParseContentLength(line + 17, &contentLength) != 0) {
+                    SendError(fd, "400 Bad Request", 0);
+                    goto done;
+                }
+            } else if (strncasecmp(line + 2, "Connection:", 11) == 0 && strcasestr(line + 13, "close"))
+                keepAlive = 0;
+            else if (strncasecmp(line + 2, "Connection:", 11) == 0 && strcasestr(line + 13, "keep-alive"))
+                keepAlive = 1;
+        }
+        size_t header = body - buf;
+        if (contentLength > WEB_REQUEST_MAX - header) {
+            SendError(fd, "413 Payload Too Large", 0);
+            break;
+        }
+        while (have - header < contentLength) {
+            ssize_t n = recv(fd, buf + have, contentLength - (have - header), 0);
+            if (n <= 0)
+                goto done;
+            have += n;
+        }
+        char next = body[contentLength];
+        body[contentLength] = 0;
+
+        // Puffer je Verbindung, wächst mit der Pack-Anzahl
+        pthread_rwlock_rdlock(&s_clientLock);
+        size_t need = s_responseSize;
+        pthread_rwlock_unlock(&s_clientLock);
+        if (need > cborSize) {
+            free(cbor);
+            cborSize = need;
+            cbor = malloc(cborSize);
+            if (!cbor)
+                break;
+        }
+
+        if (HandleRequest(fd, method, path, body, keepAlive, cbor, cborSize) != 0 || !keepAlive)
+            break;
+
+        // Rest (Pipelining) an den Anfang
+        body[contentLength] = next;
+        size_t used = body + contentLength - buf;
+        memmove(buf, buf + used, have - used);
+        have -= used;
+    }
+done:
+    free(cbor);
+    free(buf);
+    close(fd);
+    __atomic_sub_fetch(&s_clients, 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+// ---------------------------------------------------------
+static void SignalHandler(int sig) {
+    (void)sig;
+    s_running = 0;
+}
+
+static void Usage(const char *name) {
+    printf("Usage: %s [-p port] [-d verzeichnis]\n", name);
+    printf("  -p port       TCP-Port (Standard %d)\n", WEB_PORT);
+    printf("  -d pfad       Verzeichnis der statischen Dateien (Standard webserver)\n");
+}
+
+int main(int argc, char **argv) {
+    int port = WEB_PORT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:d:h")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'd':
+                s_root = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+
+    openlog("bmsweb", LOG_PID | LOG_CONS, LOG_DAEMON);
+    struct sigaction sa = { .sa_handler = SignalHandler };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int srv = socket(AF_INET6, SOCK_STREAM, 0);
+    int on = 1, off = 0;
+    struct sockaddr_in6 addr = { .sin6_family = AF_INET6, .sin6_port = htons(port), .sin6_addr = IN6ADDR_ANY_INIT };
+    if (srv < 0 || setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) ||
+        setsockopt(srv, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) ||
+        bind(srv, (struct sockaddr*)&addr, sizeof(addr)) || listen(srv, WEB_MAX_CLIENTS)) {
+        perror("bmsweb: socket");
+        return 1;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_attr_setstacksize(&attr, 64 * 1024);
+    pthread_t streamThread;
+    if (pthread_create(&streamThread, &attr, StreamThread, NULL) != 0) {
+        perror("bmsweb: pthread_create");
+        return 1;
+    }
+
+    uint32_t lastCycle = 0;
+    time_t lastChange = 0;
+    while (s_running) {
+        // Anhängen bzw. neu anhängen, wenn bmsd keinen Zyklus mehr veröffentlicht
+        time_t now = time(NULL);
+        if (!s_client) {
+            if (now != lastChange && Attach() != 0 && errno != ENOENT && errno != EAGAIN)
+                syslog(LOG_ERR, "bmsc_Attach: %s", strerror(errno));
+            lastChange = now;
+        } else if (bmsc_Live(s_client)->glob.cycle != lastCycle) {
+            lastCycle = bmsc_Live(s_client)->glob.cycle;
+            lastChange = now;
+        } else if (now - lastChange >= WEB_STALE_S) {
+            Attach();
+            lastChange = now;
+        }
+
+        struct pollfd pfd = { srv, POLLIN, 0 };
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+        int fd = accept(srv, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        struct timeval idle = { WEB_IDLE_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        pthread_t thread;
+        if (__atomic_add_fetch(&s_clients, 1, __ATOMIC_RELAXED) > WEB_MAX_CLIENTS ||
+            pthread_create(&thread, &attr, ClientThread, (void*)(intptr_t)fd) != 0) {
+            SendError(fd, "503 Service Unavailable", 0);
+            close(fd);
+            __atomic_sub_fetch(&s_clients, 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    close(srv);
+    closelog();
+    return 0;
+}
\ No newline at end of file
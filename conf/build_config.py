@@ -500,6 +500,10 @@ global_conf = GLOBAL_CONF_t()
 global_conf.numberOfPacks = 2
 global_conf.diagWireBreakDelta = 200
 global_conf.prechargeDeltaVoltage = 1
+global_conf.spiMaxRetries = 2
+global_conf.spiRetryBudgetUs = 2000
+global_conf.spiErrorBurst = 3
+global_conf.spiMaxSpeedHz = 4000000
 # In Datei schreiben
 with open(FILENAME, "wb") as datei:
     datei.write(ctypes.string_at(ctypes.byref(global_conf), ctypes.sizeof(global_conf)))
@@ -5,6 +5,10 @@ class GLOBAL_CONF_t(Structure):
         ("numberOfPacks", c_uint32),
         ("diagWireBreakDelta", c_uint32),
         ("prechargeDeltaVoltage", c_float),
+        ("spiMaxRetries", c_uint32),
+        ("spiRetryBudgetUs", c_uint32),
+        ("spiErrorBurst", c_uint32),
+        ("spiMaxSpeedHz", c_uint32),
     ]
 class PACK_USERCONF_t(Structure):
     _pack_ = 1
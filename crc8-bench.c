@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "crc8.c"
+
+/*
+ * Benchmark aller CRC8 Kernel über typische PB7170 Framelängen.
+ * Bytes/Takt wird über die CPU-Frequenz aus sysfs berechnet, alternativ
+ * per -f <MHz> vorgeben (z.B. wenn der Governor die Frequenz verändert).
+ */
+
+#define BENCH_ITERATIONS 2000000
+
+typedef uint8_t (*CRC8_KERNEL_FN_t)(const void *data, size_t len);
+
+static const struct {
+    const char *name;
+    CRC8_KERNEL_FN_t fn;
+} s_kernels[] = {
+    { "table",  Crc8Table },
+    { "slice4", Crc8Slice4 },
+    { "slice8", Crc8Slice8 },
+    { "nibble", Crc8Nibble },
+};
+
+static const size_t s_frameLen[] = { 3, 5, 35, CRC8_MAX_FRAME };
+
+static double CpuFrequencyHz(void)
+{
+    const char *paths[] = {
+        "/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq",
+        "/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+    };
+    for (int i = 0; i < 2; i++) {
+        FILE *f = fopen(paths[i], "r");
+        if (!f)
+            continue;
+        unsigned long khz = 0;
+        int ok = fscanf(f, "%lu", &khz) == 1;
+        fclose(f);
+        if (ok && khz)
+            return khz * 1e3;
+    }
+
+    // x86 Host ohne cpufreq: erster "cpu MHz" Eintrag
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f)
+        return 0;
+    char line[128];
+    double mhz = 0;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "cpu MHz : %lf", &mhz) == 1)
+            break;
+    fclose(f);
+    return mhz * 1e6;
+}
+
+static double Now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    double freq = CpuFrequencyHz();
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:")) != -1) {
+        if (opt == 'f')
+            freq = strtod(optarg, NULL) * 1e6;
+    }
+
+    crc8_Init();
+    if (crc8_SelfCheck()) {
+        printf("CRC8 Selbsttest fehlgeschlagen\n");
+        return 1;
+    }
+
+    uint8_t buf[CRC8_MAX_FRAME];
+    for (size_t i = 0; i < sizeof(buf); i++)
+        buf[i] = rand();
+
+    printf("--- CRC8 Benchmark (Build-Kernel: %s, CPU %.0f MHz) ---\n", crc8_KernelName(), freq * 1e-6);
+    printf("%-8s %6s %10s %12s\n", "Kernel", "Bytes", "ns/Frame", "Bytes/Takt");
+    for (size_t k = 0; k < sizeof(s_kernels) / sizeof(s_kernels[0]); k++) {
+        for (size_t l = 0; l < sizeof(s_frameLen) / sizeof(s_frameLen[0]); l++) {
+            size_t len = s_frameLen[l];
+            volatile uint8_t sink = 0;
+            double t0 = Now();
+            for (uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+                buf[0] = i; // Abhängigkeit erzwingen, kein Hochziehen aus der Schleife
+                sink ^= s_kernels[k].fn(buf, len);
+            }
+            double dt = Now() - t0;
+            double nsPerFrame = dt * 1e9 / BENCH_ITERATIONS;
+            if (freq > 0)
+                printf("%-8s %6zu %10.1f %12.3f\n", s_kernels[k].name, len, nsPerFrame,
+                       (double)len * BENCH_ITERATIONS / (dt * freq));
+            else
+                printf("%-8s %6zu %10.1f %12s\n", s_kernels[k].name, len, nsPerFrame, "-");
+        }
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "crc8.h"
+
+/*
+ * CRC-8 des PB7170 (Polynom 0x07, Init 0x00, MSB zuerst).
+ * Alle Kernel sind enthalten, crc8_Calc() verwendet den per CRC8_KERNEL
+ * beim Build gewählten. Die Slice-Tabellen werden in crc8_Init() aus der
+ * Referenztabelle erzeugt.
+ */
+
+// ---------------- Tabellen ----------------
+static const uint8_t s_afeCrc8Table[256] =
+{
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 
+    0x24, 0x23, 0x2A, 0x2D, 0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 
+    0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D, 0xE0, 0xE7, 0xEE, 0xE9, 
+    0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD, 
+    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 
+    0xB4, 0xB3, 0xBA, 0xBD, 0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 
+    0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA, 0xB7, 0xB0, 0xB9, 0xBE, 
+    0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A, 
+    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 
+    0x03, 0x04, 0x0D, 0x0A, 0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 
+    0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A, 0x89, 0x8E, 0x87, 0x80, 
+    0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4, 
+    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 
+    0xDD, 0xDA, 0xD3, 0xD4, 0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 
+    0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44, 0x19, 0x1E, 0x17, 0x10, 
+    0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34, 
+    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 
+    0x6A, 0x6D, 0x64, 0x63, 0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 
+    0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13, 0xAE, 0xA9, 0xA0, 0xA7, 
+    0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83, 
+    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 
+    0xFA, 0xFD, 0xF4, 0xF3
+};
+
+// Tk[x] = CRC von x gefolgt von k Nullbytes
+static uint8_t s_crc8Slice[8][256];
+
+// Verarbeitung eines Nibbles, entspricht s_afeCrc8Table[0..15]
+static const uint8_t s_crc8Nibble[16] =
+{
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31,
+    0x24, 0x23, 0x2A, 0x2D
+};
+
+// ---------------- Kernel ----------------
+// Referenz: bitweise, nur für Selbsttest und Tabellenprüfung
+static uint8_t Crc8Bitwise(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t crc = 0x00;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+// 256 Byte Tabelle, 4x ausgerollt
+static inline uint8_t Crc8Table(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t crc = 0x00;
+
+    while (len >= 4)
+    {
+        crc = s_afeCrc8Table[crc ^ *p++];
+        crc = s_afeCrc8Table[crc ^ *p++];
+        crc = s_afeCrc8Table[crc ^ *p++];
+        crc = s_afeCrc8Table[crc ^ *p++];
+        len -= 4;
+    }
+    while (len--)
+    {
+        crc = s_afeCrc8Table[crc ^ *p++];
+    }
+    return crc;
+}
+
+// Slice-by-4: 4 unabhängige Lookups pro 4 Byte, 1 KB Tabellen
+static inline uint8_t Crc8Slice4(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t crc = 0x00;
+
+    while (len >= 4)
+    {
+        crc = s_crc8Slice[3][crc ^ p[0]] ^
+              s_crc8Slice[2][p[1]] ^
+              s_crc8Slice[1][p[2]] ^
+              s_crc8Slice[0][p[3]];
+        p += 4;
+        len -= 4;
+    }
+    while (len--)
+    {
+        crc = s_crc8Slice[0][crc ^ *p++];
+    }
+    return crc;
+}
+
+// Slice-by-8: 8 unabhängige Lookups pro 8 Byte, 2 KB Tabellen
+static inline uint8_t Crc8Slice8(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t crc = 0x00;
+
+    while (len >= 8)
+    {
+        crc = s_crc8Slice[7][crc ^ p[0]] ^
+              s_crc8Slice[6][p[1]] ^
+              s_crc8Slice[5][p[2]] ^
+              s_crc8Slice[4][p[3]] ^
+              s_crc8Slice[3][p[4]] ^
+              s_crc8Slice[2][p[5]] ^
+              s_crc8Slice[1][p[6]] ^
+              s_crc8Slice[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+    {
+        crc = s_crc8Slice[0][crc ^ *p++];
+    }
+    return crc;
+}
+
+// Nibble-Tabelle: 16 Byte, passt in eine Cachezeile
+static inline uint8_t Crc8Nibble(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint8_t crc = 0x00;
+
+    while (len--)
+    {
+        crc ^= *p++;
+        crc = (uint8_t)(crc << 4) ^ s_crc8Nibble[crc >> 4];
+        crc = (uint8_t)(crc << 4) ^ s_crc8Nibble[crc >> 4];
+    }
+    return crc;
+}
+
+// ---------------- API ----------------
+void crc8_Init(void)
+{
+    for (int i = 0; i < 256; i++)
+        s_crc8Slice[0][i] = s_afeCrc8Table[i];
+    for (int k = 1; k < 8; k++)
+        for (int i = 0; i < 256; i++)
+            s_crc8Slice[k][i] = s_afeCrc8Table[s_crc8Slice[k - 1][i]];
+}
+
+uint8_t crc8_Calc(const void *data, size_t len)
+{
+#if CRC8_KERNEL == CRC8_KERNEL_SLICE4
+    return Crc8Slice4(data, len);
+#elif CRC8_KERNEL == CRC8_KERNEL_SLICE8
+    return Crc8Slice8(data, len);
+#elif CRC8_KERNEL == CRC8_KERNEL_NIBBLE
+    return Crc8Nibble(data, len);
+#else
+    return Crc8Table(data, len);
+#endif
+}
+
+const char *crc8_KernelName(void)
+{
+#if CRC8_KERNEL == CRC8_KERNEL_SLICE4
+    return "slice4";
+#elif CRC8_KERNEL == CRC8_KERNEL_SLICE8
+    return "slice8";
+#elif CRC8_KERNEL == CRC8_KERNEL_NIBBLE
+    return "nibble";
+#else
+    return "table";
+#endif
+}
+
+/*
+ * Prüft die Referenztabelle gegen die bitweise Berechnung und den gewählten
+ * Kernel gegen die Referenz für alle Framelängen bis CRC8_MAX_FRAME.
+ * Rückgabe 0 wenn alles übereinstimmt.
+ */
+int crc8_SelfCheck(void)
+{
+    uint8_t buf[CRC8_MAX_FRAME];
+    uint32_t seed = 0x12345678;
+
+    for (int i = 0; i < 256; i++)
+    {
+        uint8_t b = i;
+        if (Crc8Bitwise(&b, 1) != s_afeCrc8Table[i])
+            return -1;
+    }
+
+    for (size_t len = 0; len <= sizeof(buf); len++)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            seed = seed * 1664525 + 1013904223; // LCG
+            buf[i] = seed >> 24;
+        }
+        uint8_t ref = Crc8Table(buf, len);
+        if (Crc8Bitwise(buf, len) != ref || crc8_Calc(buf, len) != ref)
+            return -2;
+    }
+    return 0;
+}
\ No newline at end of file
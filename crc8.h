@@ -0,0 +1,24 @@
+#ifndef CRC8_H
+#define CRC8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC8_MAX_FRAME 67        // 2 Byte Header + 32*2 Byte Daten + 1 Byte CRC
+
+// Kernel-Auswahl beim Build: -DCRC8_KERNEL=CRC8_KERNEL_xxx
+#define CRC8_KERNEL_TABLE 0      // 256 Byte Tabelle, 4x ausgerollt
+#define CRC8_KERNEL_SLICE4 1     // Slice-by-4, 1 KB Tabellen
+#define CRC8_KERNEL_SLICE8 2     // Slice-by-8, 2 KB Tabellen
+#define CRC8_KERNEL_NIBBLE 3     // 16 Byte Tabelle, 2 Lookups pro Byte
+
+#ifndef CRC8_KERNEL
+#define CRC8_KERNEL CRC8_KERNEL_TABLE
+#endif
+
+void crc8_Init(void);
+int crc8_SelfCheck(void);
+uint8_t crc8_Calc(const void *data, size_t len);
+const char *crc8_KernelName(void);
+
+#endif
\ No newline at end of file
@@ -6,16 +6,24 @@
 #include <fcntl.h>      // für shm_open
 #include <sys/mman.h>   // für mmap
 #include <unistd.h>     // für ftruncate
+#include <sched.h>      // für sched_yield
+#include <stddef.h>     // für offsetof
 #include <syslog.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 #include "dataobjects.h"
 
-#define SHMEM_BATTERYPDO "/battery_pdo_shm"
-#define SHMEM_BATTERYSDO "/battery_sdo_shm"
-
 // SHMEM Objekte
 GLOBAL_PDO_t* g_GlobalPdoData = NULL;
 PACK_PDO_t* g_PackPdoData = NULL;
 PACK_SDO_t* g_PackSdoData = NULL;
+SDO_QUEUE_t* g_SdoQueue = NULL;
+TIMING_GLOBAL_t* g_TimingData = NULL;
+TIMING_PHASE_t* g_TimingPhase = NULL;
+HISTORY_HEADER_t* g_History = NULL;
 
 // Globale Arrays
 GLOBAL_CONF_t g_GlobalConfig;
@@ -24,6 +32,88 @@ PACK_GENERALCONF_t* g_PackGeneralConfig[MAX_BATTERY_PACKS];
 PACK_CALIBRATION_t* g_PackCalibration[MAX_BATTERY_PACKS];
 uint16_t g_packEnabled = 0;
 
+// ---------------------------------------------------------
+// Kommandoqueue: Slots und Quittungen folgen direkt auf SDO_QUEUE_t
+static SDO_CMD_t* SdoCmd(const SDO_QUEUE_t *queue) {
+    return (SDO_CMD_t*)(queue + 1);
+}
+
+static SDO_ACK_t* SdoAck(const SDO_QUEUE_t *queue) {
+    return (SDO_ACK_t*)(SdoCmd(queue) + queue->depth);
+}
+
+// ---------------------------------------------------------
+// Feldtabelle für PDO_HEADER_t, neue Felder in GLOBAL_PDO_t/PACK_PDO_t hier eintragen
+#define PDO_FIELD(scope, st, f, type, ctype) \
+    { #f, offsetof(st, f), sizeof(((st*)0)->f) / sizeof(ctype), type, scope, 0 }
+#define GLOBAL_FIELD(f, type, ctype) PDO_FIELD(PDO_SCOPE_GLOBAL, GLOBAL_PDO_t, f, type, ctype)
+#define PACK_FIELD(f, type, ctype) PDO_FIELD(PDO_SCOPE_PACK, PACK_PDO_t, f, type, ctype)
+
+static const PDO_FIELD_t s_pdoFields[] = {
+    GLOBAL_FIELD(numberOfPacks, PDO_TYPE_U32, uint32_t),
+    GLOBAL_FIELD(seq, PDO_TYPE_U32, uint32_t),
+    GLOBAL_FIELD(voltage, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(cycle, PDO_TYPE_U32, uint32_t),
+    GLOBAL_FIELD(runPacks, PDO_TYPE_U32, uint32_t),
+    GLOBAL_FIELD(errorPacks, PDO_TYPE_U32, uint32_t),
+    GLOBAL_FIELD(warningPacks, PDO_TYPE_U32, uint32_t),
+    GLOBAL_FIELD(current, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(availableChargeCurrent, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(availableDischargeCurrent, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(cellMin, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(cellMax, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(cellAvg, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(temperatureMin, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(temperatureMax, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(temperatureAvg, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(stateOfCharge, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(stateOfHealth, PDO_TYPE_F32, float),
+    GLOBAL_FIELD(cellMinPack, PDO_TYPE_U8, uint8_t),
+    GLOBAL_FIELD(cellMinCell, PDO_TYPE_U8, uint8_t),
+    GLOBAL_FIELD(cellMaxPack, PDO_TYPE_U8, uint8_t),
+    GLOBAL_FIELD(cellMaxCell, PDO_TYPE_U8, uint8_t),
+    GLOBAL_FIELD(temperatureMinPack, PDO_TYPE_U8, uint8_t),
+    GLOBAL_FIELD(temperatureMaxPack, PDO_TYPE_U8, uint8_t),
+
+    PACK_FIELD(seq, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(stateMachine, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(aliveCounter, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(spiRetries, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(spiCrcErrors, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(spiIoctlErrors, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(spiFailedCalls, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(spiMaxTransferUs, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(spiSpeedHz, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(swAlertFlags, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(swWarningFlags, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwStatus, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwAlertFlags, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwAlertState, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwAlertCellUnderOvervoltage, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwAlertAux, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwBalancerTimer, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(hwBalancerStatus, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(mosfetStatus, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(prechargeResistorI2t, PDO_TYPE_F32, float),
+    PACK_FIELD(current, PDO_TYPE_F32, float),
+    PACK_FIELD(fastCurrent, PDO_TYPE_F32, float),
+    PACK_FIELD(cells, PDO_TYPE_F32, float),
+    PACK_FIELD(ntcTemperature, PDO_TYPE_F32, float),
+    PACK_FIELD(dieTemperature, PDO_TYPE_F32, float),
+    PACK_FIELD(voltage, PDO_TYPE_F32, float),
+    PACK_FIELD(pvddVoltage, PDO_TYPE_F32, float),
+    PACK_FIELD(availableChargeCurrent, PDO_TYPE_F32, float),
+    PACK_FIELD(availableDischargeCurrent, PDO_TYPE_F32, float),
+    PACK_FIELD(rawCodes, PDO_TYPE_U16, uint16_t),
+    PACK_FIELD(id, PDO_TYPE_U32, uint32_t),
+    PACK_FIELD(availableCapacity, PDO_TYPE_F32, float),
+    PACK_FIELD(totalCapacity, PDO_TYPE_F32, float),
+    PACK_FIELD(stateOfCharge, PDO_TYPE_F32, float),
+    PACK_FIELD(stateOfHealth, PDO_TYPE_F32, float),
+    PACK_FIELD(cycleCount, PDO_TYPE_F32, float),
+};
+#define PDO_FIELD_COUNT (sizeof(s_pdoFields) / sizeof(s_pdoFields[0]))
+
 // ---------------------------------------------------------
 // generische Datei-Ladefunktion
 static void* LoadBinaryFile(
@@ -165,22 +255,62 @@ int dob_LoadPackConfigs(void)
         return -1;
     }
 
-    size_t shmSize = sizeof(GLOBAL_PDO_t) + sizeof(PACK_PDO_t) * numPacks;
+    // Header + Feldtabelle, GLOBAL_PDO_t auf die nächste Cache-Line
+    size_t globalOffset = (sizeof(PDO_HEADER_t) + sizeof(s_pdoFields) + PDO_CACHE_LINE - 1) &
+        ~(size_t)(PDO_CACHE_LINE - 1);
+    size_t shmSize = globalOffset + sizeof(GLOBAL_PDO_t) + sizeof(PACK_PDO_t) * numPacks;
     void* shm_ptr = NULL;
     if (InitShmem(&shm_ptr, SHMEM_BATTERYPDO, shmSize) != 0) {
         syslog(LOG_ERR, "SHMEM_PDO konnte nicht initialisiert werden.\n");
         return -1;
     }
 
-    g_GlobalPdoData = (GLOBAL_PDO_t*)shm_ptr;
+    PDO_HEADER_t *pdoHeader = (PDO_HEADER_t*)shm_ptr;
+    memcpy(pdoHeader + 1, s_pdoFields, sizeof(s_pdoFields));
+    pdoHeader->layoutVersion = PDO_LAYOUT_VERSION;
+    pdoHeader->numberOfPacks = numPacks;
+    pdoHeader->fieldCount = PDO_FIELD_COUNT;
+    pdoHeader->fieldOffset = sizeof(PDO_HEADER_t);
+    pdoHeader->globalOffset = globalOffset;
+    pdoHeader->globalSize = sizeof(GLOBAL_PDO_t);
+    pdoHeader->packOffset = globalOffset + sizeof(GLOBAL_PDO_t);
+    pdoHeader->packSize = sizeof(PACK_PDO_t);
+    __atomic_store_n(&pdoHeader->magic, PDO_MAGIC, __ATOMIC_RELEASE); // zuletzt: Header gültig
+
+    g_GlobalPdoData = (GLOBAL_PDO_t*)((uint8_t*)shm_ptr + globalOffset);
     g_PackPdoData   = (PACK_PDO_t*)(g_GlobalPdoData + 1);
 
     // -----------------------------------------------------
-    // Shared Memory für SDO
-    if (InitShmem((void**)&g_PackSdoData, SHMEM_BATTERYSDO, sizeof(PACK_SDO_t) * numPacks) != 0) {
+    // Shared Memory für SDO: PackSDO + Kommandoqueue
+    size_t sdoSize = sizeof(PACK_SDO_t) * numPacks + sizeof(SDO_QUEUE_t) +
+        (sizeof(SDO_CMD_t) + sizeof(SDO_ACK_t)) * SDO_QUEUE_DEPTH;
+    if (InitShmem((void**)&g_PackSdoData, SHMEM_BATTERYSDO, sdoSize) != 0) {
         syslog(LOG_ERR, "SHMEM_SDO konnte nicht initialisiert werden.\n");
         return -1;
     }
+    g_SdoQueue = (SDO_QUEUE_t*)(g_PackSdoData + numPacks);
+    dob_CommandQueueInit(g_SdoQueue, SDO_QUEUE_DEPTH);
+
+    // -----------------------------------------------------
+    // Shared Memory für Zeitmessung: global + je Pack
+    size_t timingSize = sizeof(TIMING_GLOBAL_t) +
+        sizeof(TIMING_PHASE_t) * (TIMING_GLOBAL_PHASES + TIMING_PACK_PHASES * numPacks);
+    if (InitShmem((void**)&g_TimingData, SHMEM_TIMING, timingSize) != 0) {
+        syslog(LOG_ERR, "SHMEM_TIMING konnte nicht initialisiert werden.\n");
+        return -1;
+    }
+    g_TimingPhase = (TIMING_PHASE_t*)(g_TimingData + 1);
+
+    // -----------------------------------------------------
+    // Shared Memory für Verlauf: Header + HISTORY_DEPTH Einträge
+    size_t recordSize = sizeof(HISTORY_RECORD_t) + sizeof(PACK_PDO_t) * numPacks; // Vielfaches von PDO_CACHE_LINE
+    if (InitShmem((void**)&g_History, SHMEM_HISTORY, sizeof(HISTORY_HEADER_t) + recordSize * HISTORY_DEPTH) != 0) {
+        syslog(LOG_ERR, "SHMEM_HISTORY konnte nicht initialisiert werden.\n");
+        return -1;
+    }
+    g_History->depth = HISTORY_DEPTH;
+    g_History->numberOfPacks = numPacks;
+    g_History->recordSize = recordSize;
 
     g_packEnabled = 0;
 
@@ -248,4 +378,209 @@ int dob_LoadPackConfigs(void)
 void dob_Cleanup() {
     shm_unlink(SHMEM_BATTERYPDO);
     shm_unlink(SHMEM_BATTERYSDO);
+    shm_unlink(SHMEM_TIMING);
+    shm_unlink(SHMEM_HISTORY);
+}
+// ---------------------------------------------------------
+// Seqlock für PDO-Leser (Webserver, Clients). Ein Schreiber, beliebig viele
+// Leser ohne Sperre: seq ungerade während des Schreibens, Leser kopieren und
+// prüfen danach, ob seq unverändert und gerade war.
+void dob_WriteBegin(uint32_t *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // seq vor den Daten sichtbar
+}
+
+void dob_WriteEnd(uint32_t *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE); // Daten vor seq sichtbar
+}
+
+// Rückgabe: benötigte Wiederholungen, -1 wenn kein konsistenter Stand
+int dob_ReadConsistent(const uint32_t *seq, const void *src, void *dst, size_t len, uint32_t maxRetries) {
+    for (uint32_t i = 0; i <= maxRetries; i++) {
+        uint32_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (s & 1) {
+            sched_yield();
+            continue;
+        }
+        memcpy(dst, src, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE); // Daten vor dem zweiten seq lesen
+        if (__atomic_load_n(seq, __ATOMIC_RELAXED) == s)
+            return i;
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------
+// Verlauf: am Ende jedes Zyklus alle PACK_PDO_t in den Ring kopieren.
+// Jeder Eintrag hat ein eigenes Seqlock, der Header zeigt auf den
+// zuletzt vollständigen Zyklus.
+static HISTORY_RECORD_t* HistoryRecord(const HISTORY_HEADER_t *hist, uint64_t cycle) {
+    return (HISTORY_RECORD_t*)((uint8_t*)(hist + 1) + (cycle % hist->depth) * hist->recordSize);
+}
+
+void dob_HistoryPush(void) {
+    uint64_t cycle = g_History->cycle + 1;
+    HISTORY_RECORD_t *rec = HistoryRecord(g_History, cycle);
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    dob_WriteBegin(&rec->seq);
+    rec->cycle = cycle;
+    rec->timeNs = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    memcpy(rec + 1, g_PackPdoData, sizeof(PACK_PDO_t) * g_History->numberOfPacks);
+    dob_WriteEnd(&rec->seq);
+    __atomic_store_n(&g_History->cycle, cycle, __ATOMIC_RELEASE);
+}
+
+/*
+ * Leser: kopiert ab Zyklus *next bis zu maxRecords Einträge (je recordSize
+ * Bytes) nach dst und setzt *next auf den nächsten ungelesenen Zyklus.
+ * *next = 0 beginnt beim ältesten verfügbaren Eintrag. Überschriebene Zyklen
+ * werden in *lost gezählt. Liegt *next hinter dem Kopf (bmsd neu gestartet),
+ * geht es beim ältesten Eintrag weiter, die davor überschriebenen Zyklen des
+ * neuen Laufs zählen als verloren. Rückgabe: Anzahl kopierter Einträge.
+ */
+int dob_HistoryRead(const HISTORY_HEADER_t *hist, uint64_t *next, void *dst, uint32_t maxRecords, uint64_t *lost) {
+    uint64_t head = __atomic_load_n(&hist->cycle, __ATOMIC_ACQUIRE);
+    // Der älteste Eintrag wird ggf. gerade vom nächsten Zyklus überschrieben
+    uint64_t oldest = head >= hist->depth ? head - hist->depth + 2 : 1;
+    uint64_t cycle = *next;
+    int n = 0;
+
+    if (cycle == 0)
+        cycle = oldest;
+    else if (cycle > head + 1) {
+        *lost += oldest - 1;
+        cycle = oldest;
+    } else if (cycle < oldest) {
+        *lost += oldest - cycle;
+        cycle = oldest;
+    }
+
+    for (; cycle <= head && (uint32_t)n < maxRecords; cycle++) {
+        HISTORY_RECORD_t *out = (HISTORY_RECORD_t*)((uint8_t*)dst + n * hist->recordSize);
+        HISTORY_RECORD_t *rec = HistoryRecord(hist, cycle);
+        if (dob_ReadConsistent(&rec->seq, rec, out, hist->recordSize, 3) >= 0 && out->cycle == cycle)
+            n++;
+        else
+            (*lost)++; // inzwischen überschrieben
+    }
+    *next = cycle;
+    return n;
+}
+
+// ---------------------------------------------------------
+// Änderungsbenachrichtigung: GLOBAL_PDO_t.cycle ist ein prozessübergreifendes
+// Futex-Wort. Leser schlafen darin, bis ein neuer Zyklus veröffentlicht ist.
+static long Futex(const uint32_t *addr, int op, uint32_t val, const struct timespec *timeout, uint32_t bitset) {
+    return syscall(SYS_futex, addr, op, val, timeout, NULL, bitset);
+}
+
+// Nach PDO und Verlauf aufrufen, blockiert nie
+void dob_NotifyCycle(void) {
+    __atomic_store_n(&g_GlobalPdoData->cycle, g_GlobalPdoData->cycle + 1, __ATOMIC_RELEASE);
+    Futex(&g_GlobalPdoData->cycle, FUTEX_WAKE, INT_MAX, NULL, 0);
+}
+
+/*
+ * Wartet, bis glob->cycle von lastCycle abweicht. Rückgabe: neuer Zyklus,
+ * -1 bei Timeout (timeoutMs < 0 wartet unbegrenzt). Die Frist ist absolut
+ * (CLOCK_MONOTONIC), EINTR/EAGAIN verlängern sie nicht.
+ */
+int64_t dob_WaitCycle(const GLOBAL_PDO_t *glob, uint32_t lastCycle, int timeoutMs) {
+    struct timespec deadline;
+    uint32_t cycle;
+
+    if (timeoutMs >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    while ((cycle = __atomic_load_n(&glob->cycle, __ATOMIC_ACQUIRE)) == lastCycle) {
+        if (Futex(&glob->cycle, FUTEX_WAIT_BITSET, lastCycle, timeoutMs < 0 ? NULL : &deadline,
+                  FUTEX_BITSET_MATCH_ANY) && errno == ETIMEDOUT)
+            return -1;
+    }
+    return cycle;
+}
+
+// ---------------------------------------------------------
+// Kommandoqueue (gebundene MPSC-Queue mit Sequenz je Slot). Erzeuger
+// reservieren per CAS eine Kommandonummer und geben den Slot mit seq = pos + 1
+// frei, bmsd übernimmt ihn und gibt ihn mit seq = pos + depth zurück.
+// depth: Zweierpotenz, dahinter Platz für SDO_CMD_t[depth] und SDO_ACK_t[depth]
+void dob_CommandQueueInit(SDO_QUEUE_t *queue, uint32_t depth) {
+    queue->depth = depth;
+    queue->enqueuePos = 0;
+    queue->dequeuePos = 0;
+    for (uint32_t i = 0; i < depth; i++) {
+        SdoCmd(queue)[i].seq = i;
+        SdoAck(queue)[i].id = i - depth; // noch nichts quittiert
+    }
+}
+
+// Rückgabe: 0, -1 wenn die Queue voll ist. *id für dob_CommandStatus.
+int dob_CommandPush(SDO_QUEUE_t *queue, uint32_t cmd, uint32_t pack, uint32_t arg, uint32_t *id) {
+    uint32_t pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+    SDO_CMD_t *slot;
+
+    for (;;) {
+        slot = &SdoCmd(queue)[pos & (queue->depth - 1)];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (diff < 0)
+            return -1; // voll, bmsd hat den Slot noch nicht übernommen
+        if (diff == 0 && __atomic_compare_exchange_n(&queue->enqueuePos, &pos, pos + 1, 0,
+                                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+        if (diff > 0)
+            pos = __atomic_load_n(&queue->enqueuePos, __ATOMIC_RELAXED);
+    }
+    slot->cmd = cmd;
+    slot->pack = pack;
+    slot->arg = arg;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    *id = pos;
+    return 0;
+}
+
+// SDO_STATUS_PENDING solange bmsd das Kommando nicht quittiert hat
+uint32_t dob_CommandStatus(const SDO_QUEUE_t *queue, uint32_t id) {
+    const SDO_ACK_t *ack = &SdoAck(queue)[id & (queue->depth - 1)];
+    if (__atomic_load_n(&ack->id, __ATOMIC_ACQUIRE) != id)
+        return SDO_STATUS_PENDING;
+    return ack->status;
+}
+
+// Nur bmsd: nächstes Kommando übernehmen, -1 wenn die Queue leer ist
+int dob_CommandPop(SDO_CMD_t *cmd, uint32_t *id) {
+    uint32_t pos = g_SdoQueue->dequeuePos;
+    SDO_CMD_t *slot = &SdoCmd(g_SdoQueue)[pos & (g_SdoQueue->depth - 1)];
+
+    if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+        return -1;
+    *cmd = *slot;
+    *id = pos;
+    __atomic_store_n(&slot->seq, pos + g_SdoQueue->depth, __ATOMIC_RELEASE);
+    g_SdoQueue->dequeuePos = pos + 1;
+    return 0;
+}
+
+void dob_CommandAck(uint32_t id, uint32_t status) {
+    SDO_ACK_t *ack = &SdoAck(g_SdoQueue)[id & (g_SdoQueue->depth - 1)];
+    ack->status = status;
+    __atomic_store_n(&ack->id, id, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------
+// Feld in der Tabelle eines angehängten PDO-Segments suchen, NULL wenn unbekannt
+const PDO_FIELD_t* dob_FindField(const PDO_HEADER_t *hdr, const char *name, uint32_t scope) {
+    const PDO_FIELD_t *field = (const PDO_FIELD_t*)((const uint8_t*)hdr + hdr->fieldOffset);
+    for (uint32_t i = 0; i < hdr->fieldCount; i++)
+        if (field[i].scope == scope && strncmp(field[i].name, name, PDO_FIELD_NAME_LEN) == 0)
+            return &field[i];
+    return NULL;
 }
\ No newline at end of file
@@ -4,6 +4,16 @@
 #define MAX_BATTERY_PACKS 10
 #define GENERALCONF_CURRENTTABLE_SIZE 10
 #define NUMBER_OF_CELLS 16
+#define PDO_MAGIC 0x4f445042      // "BPDO"
+#define PDO_LAYOUT_VERSION 4     // bei Änderungen am Aufbau von /battery_pdo_shm erhöhen
+#define PDO_FIELD_NAME_LEN 32
+#define PDO_CACHE_LINE 64        // Ausrichtung der PDO-Blöcke
+#define PDO_RAW_CODES 28         // AFE-Register 0x84-0x9f
+
+#define SHMEM_BATTERYPDO "/battery_pdo_shm"
+#define SHMEM_BATTERYSDO "/battery_sdo_shm"
+#define SHMEM_TIMING "/battery_timing_shm"
+#define SHMEM_HISTORY "/battery_history_shm"
 
 typedef enum {
     AFE_STATE_WAIT_INIT = 0,
@@ -23,178 +33,262 @@ typedef enum {
     AFE_STATE_COUNT  // Anzahl der States (letztes Element)
 } EStateMachine_t;
 
+// Segment /battery_pdo_shm: PDO_HEADER_t, PDO_FIELD_t[fieldCount], GLOBAL_PDO_t,
+// dann PACK_PDO_t[numberOfPacks]. Header und Feldtabelle beschreiben den Aufbau,
+// Leser brauchen nur PDO_HEADER_t/PDO_FIELD_t (Felder dort nur anhängen).
+typedef enum {
+    PDO_TYPE_U8 = 1,
+    PDO_TYPE_U16,
+    PDO_TYPE_U32,
+    PDO_TYPE_U64,
+    PDO_TYPE_I32,
+    PDO_TYPE_F32,
+} EPdoType_t;
+
+typedef enum {
+    PDO_SCOPE_GLOBAL = 0,        // Offset relativ zu GLOBAL_PDO_t
+    PDO_SCOPE_PACK,              // Offset relativ zu jedem PACK_PDO_t
+} EPdoScope_t;
+
 typedef struct {
+    uint32_t magic;              // PDO_MAGIC
+    uint32_t layoutVersion;      // PDO_LAYOUT_VERSION
     uint32_t numberOfPacks;
-    uint32_t sync;
-    float voltage;
-    
-} GLOBAL_PDO_t;
+    uint32_t fieldCount;
+    uint32_t fieldOffset;        // PDO_FIELD_t[fieldCount] ab Segmentanfang
+    uint32_t globalOffset;       // GLOBAL_PDO_t ab Segmentanfang
+    uint32_t globalSize;
+    uint32_t packOffset;         // PACK_PDO_t[0] ab Segmentanfang
+    uint32_t packSize;           // Abstand der Packs
+} __attribute__((aligned(PDO_CACHE_LINE))) PDO_HEADER_t;
+
+typedef struct {
+    char name[PDO_FIELD_NAME_LEN];
+    uint16_t offset;
+    uint16_t count;              // Elemente, 1 = Skalar
+    uint8_t type;                // EPdoType_t
+    uint8_t scope;               // EPdoScope_t
+    uint16_t reserved;
+} PDO_FIELD_t;
+
+// GLOBAL_PDO_t und PACK_PDO_t auf PDO_CACHE_LINE ausgerichtet
+typedef struct {
+    uint32_t numberOfPacks;
+    uint32_t seq;                 // Seqlock über den ganzen Zyklus, ungerade = Schreibzugriff
+    float voltage;                // Busspannung: Mittel der zugeschalteten Packs, 0 wenn keines
+    uint32_t cycle;               // Futex: vollständige Zyklen, Wake am Zyklusende
+
+    // Aggregate über alle Packs, bms_Aggregate am Zyklusende. Bitmasken: Bit = Pack-Index,
+    // *Pack = PACK_PDO_t.id (0 = kein Pack), *Cell = Zellindex ab 0
+    uint32_t runPacks;            // Messwerte gültig (RUN/RUN_WARNING), Basis der Zell-/Temperaturwerte
+    uint32_t errorPacks;          // swAlertFlags != 0
+    uint32_t warningPacks;        // swWarningFlags != 0
+    float current;                // Summe
+    float availableChargeCurrent; // Summe
+    float availableDischargeCurrent;
+    float cellMin;
+    float cellMax;
+    float cellAvg;
+    float temperatureMin;         // NTC
+    float temperatureMax;
+    float temperatureAvg;
+    float stateOfCharge;          // Mittel
+    float stateOfHealth;
+    uint8_t cellMinPack;
+    uint8_t cellMinCell;
+    uint8_t cellMaxPack;
+    uint8_t cellMaxCell;
+    uint8_t temperatureMinPack;
+    uint8_t temperatureMaxPack;
+} __attribute__((aligned(PDO_CACHE_LINE))) GLOBAL_PDO_t;
 
 typedef struct {
     uint32_t numberOfPacks;
     uint32_t diagWireBreakDelta;
     float prechargeDeltaVoltage;
+    uint32_t spiMaxRetries;       // max. Wiederholungen pro SPI-Aufruf
+    uint32_t spiRetryBudgetUs;    // Zeitbudget pro SPI-Aufruf inkl. Wiederholungen
+    uint32_t spiErrorBurst;       // fehlgeschlagene Aufrufe in Folge bis COMM_ERR
+    uint32_t spiMaxSpeedHz;       // Obergrenze Taktkalibrierung, 0 = fester Takt
 
 } GLOBAL_CONF_t;
 
 typedef struct {
-    /***************** Allgemeine Informationen *****************/
-    uint32_t id;
-    EStateMachine_t stateMachine;
-    uint32_t aliveCounter;
-
-    /***************** Allgemeine Statusinformationen *****************/
-    uint32_t spiRetries;
-
-    /***************** SW zeug *****************/
-    union {
-        uint32_t swAlertFlags;
-        struct {
-            uint32_t HW_CHARGE_OC : 1;
-            uint32_t HW_DISCHARGE_OC : 1;
-            uint32_t SW_CHARGE_OC : 1;
-            uint32_t SW_DISCHARGE_OC : 1;
-            uint32_t SHORT : 1;
-            uint32_t CHIPSTATE_ERR : 1;
-            uint32_t HW_OVERTEMP : 1;
-            uint32_t HW_UNDERTEMP : 1;
-            uint32_t PACK_OVERTEMP : 1;
-            uint32_t PACK_UNDERTEMP : 1;
-            uint32_t TEMP_MISMATCH : 1;
-            uint32_t COMM_ERR : 1;
-            uint32_t DIAG_ERR : 1;
-            uint32_t PACK_OV : 1;
-            uint32_t PACK_UV : 1;
-            uint32_t CELL_OV : 1;
-            uint32_t CELL_UV : 1;
-            uint32_t CELL_MISMATCH : 1;
-            uint32_t PRECHARGE_FAIL : 1;
-            uint32_t CURRENT_ABNORMAL : 1;
-        } swAlertFlags_bits;
-    };
-    union {
-        uint32_t swWarningFlags;
-    };
+    /***************** Heiß: in jedem Zyklus geschrieben *****************/
+    struct __attribute__((aligned(PDO_CACHE_LINE))) {
+        uint32_t seq;                 // Seqlock über bms_CyclicTask, ungerade = Schreibzugriff
+        EStateMachine_t stateMachine;
+        uint32_t aliveCounter;
 
-    /***************** HW zeug *****************/
-    union {
-        uint32_t hwStatus; /* PB7170 STATUS_MISC 0x01 */
-        struct {
-            uint32_t STA_LODD : 1;
-            uint32_t reserved1 : 1;
-            uint32_t CD : 2;
-            uint32_t STA_SLEEP : 1;
-            uint32_t STA_WAKE : 1;
-            uint32_t BLSW_ON : 1;
-            uint32_t ADC_ON : 1;
-            uint32_t STA_CHGD : 1;
-            uint32_t reserved2 : 1;
-            uint32_t SCH_CNT : 4;
-        } hwStatus_bits;
-    };
-    union {
-        uint32_t hwAlertFlags; /* PB7170 ALRT_FLG0,1 0x02-03 */
-        struct {
-            uint32_t CHARGE_OC : 1;
-            uint32_t DISCHARGE_OC : 1;
-            uint32_t SHORT : 1;
-            uint32_t BAL_TIMEOUT : 1;
-            uint32_t BAL_UV : 1;
-            uint32_t SCHED_END : 1;
-            uint32_t TIM_END : 1;
-            uint32_t WDT_OVF : 1;
-            uint32_t EXT_PROT : 1;
-            uint32_t PVDD_UVOV : 1;
-            uint32_t CELL_UV : 1;
-            uint32_t CELL_OV : 1;
-            uint32_t LV : 1;
-            uint32_t THERM_SD : 1;
-            uint32_t CHGDD : 1;
-            uint32_t LODD : 1;
-            uint32_t SPI_CRC_ERR : 1;
-            uint32_t MISMATCH : 1;
-            uint32_t reserved1 : 4;  // Bits 18-21
-            uint32_t TDIE_HI : 1;
-            uint32_t TDIE_LO : 1;
-            uint32_t PACK_UV : 1;
-            uint32_t PACK_OV : 1;
-            uint32_t reserved2 : 2;  // Bits 26-27
-            uint32_t AUX_OV : 1;
-            uint32_t AUX_UV : 1;
-            uint32_t reserved3 : 1;  // Bit 30
-            uint32_t MEAS_DONE : 1;
-        } hwAlertFlags_bits;
-    };
-    union {
-        uint32_t hwAlertState; /* PB7170 ALRT_STAT0,1 0x05-06 */
-        struct {
-            uint32_t CHARGE_OC : 1;
-            uint32_t DISCHARGE_OC : 1;
-            uint32_t SHORT : 1;
-            uint32_t CELL_UV : 1;
-            uint32_t CELL_OV : 1;
-            uint32_t PVDD_UVOV : 1;
-            uint32_t reserved1 : 8;  // Bits 6-13
-            uint32_t RESET : 1;
-            uint32_t SLEEP : 1;
-            uint32_t VREF : 1;
-            uint32_t LVMUX : 1;
-            uint32_t AVDD : 1;
-            uint32_t DVDD : 1;
-            uint32_t MISMATCH : 1;
-            uint32_t TDIE_LO : 1;
-            uint32_t TDIE_HI : 1;
-            uint32_t SPI_CRC_ERR : 1;
-            uint32_t EEPROM_CRC_ERR : 1;
-            uint32_t PACK_UV : 1;
-            uint32_t PACK_OV : 1;
-            uint32_t reserved2 : 4;  // Bits 27-30
-            uint32_t CLOCK_ABNORMAL : 1;
-        } hwAlertState_bits;
+        /***************** SPI Statusinformationen *****************/
+        uint32_t spiRetries;
+        uint32_t spiCrcErrors;
+        uint32_t spiIoctlErrors;
+        uint32_t spiFailedCalls;
+        uint32_t spiMaxTransferUs;
+        uint32_t spiSpeedHz;
+
+        /***************** SW zeug *****************/
+        union {
+            uint32_t swAlertFlags;
+            struct {
+                uint32_t HW_CHARGE_OC : 1;
+                uint32_t HW_DISCHARGE_OC : 1;
+                uint32_t SW_CHARGE_OC : 1;
+                uint32_t SW_DISCHARGE_OC : 1;
+                uint32_t SHORT : 1;
+                uint32_t CHIPSTATE_ERR : 1;
+                uint32_t HW_OVERTEMP : 1;
+                uint32_t HW_UNDERTEMP : 1;
+                uint32_t PACK_OVERTEMP : 1;
+                uint32_t PACK_UNDERTEMP : 1;
+                uint32_t TEMP_MISMATCH : 1;
+                uint32_t COMM_ERR : 1;
+                uint32_t DIAG_ERR : 1;
+                uint32_t PACK_OV : 1;
+                uint32_t PACK_UV : 1;
+                uint32_t CELL_OV : 1;
+                uint32_t CELL_UV : 1;
+                uint32_t CELL_MISMATCH : 1;
+                uint32_t PRECHARGE_FAIL : 1;
+                uint32_t CURRENT_ABNORMAL : 1;
+            } swAlertFlags_bits;
+        };
+        union {
+            uint32_t swWarningFlags;
+        };
+
+
+        /***************** HW zeug *****************/
+        union {
+            uint32_t hwStatus; /* PB7170 STATUS_MISC 0x01 */
+            struct {
+                uint32_t STA_LODD : 1;
+                uint32_t reserved1 : 1;
+                uint32_t CD : 2;
+                uint32_t STA_SLEEP : 1;
+                uint32_t STA_WAKE : 1;
+                uint32_t BLSW_ON : 1;
+                uint32_t ADC_ON : 1;
+                uint32_t STA_CHGD : 1;
+                uint32_t reserved2 : 1;
+                uint32_t SCH_CNT : 4;
+            } hwStatus_bits;
+        };
+        union {
+            uint32_t hwAlertFlags; /* PB7170 ALRT_FLG0,1 0x02-03 */
+            struct {
+                uint32_t CHARGE_OC : 1;
+                uint32_t DISCHARGE_OC : 1;
+                uint32_t SHORT : 1;
+                uint32_t BAL_TIMEOUT : 1;
+                uint32_t BAL_UV : 1;
+                uint32_t SCHED_END : 1;
+                uint32_t TIM_END : 1;
+                uint32_t WDT_OVF : 1;
+                uint32_t EXT_PROT : 1;
+                uint32_t PVDD_UVOV : 1;
+                uint32_t CELL_UV : 1;
+                uint32_t CELL_OV : 1;
+                uint32_t LV : 1;
+                uint32_t THERM_SD : 1;
+                uint32_t CHGDD : 1;
+                uint32_t LODD : 1;
+                uint32_t SPI_CRC_ERR : 1;
+                uint32_t MISMATCH : 1;
+                uint32_t reserved1 : 4;  // Bits 18-21
+                uint32_t TDIE_HI : 1;
+                uint32_t TDIE_LO : 1;
+                uint32_t PACK_UV : 1;
+                uint32_t PACK_OV : 1;
+                uint32_t reserved2 : 2;  // Bits 26-27
+                uint32_t AUX_OV : 1;
+                uint32_t AUX_UV : 1;
+                uint32_t reserved3 : 1;  // Bit 30
+                uint32_t MEAS_DONE : 1;
+            } hwAlertFlags_bits;
+        };
+        union {
+            uint32_t hwAlertState; /* PB7170 ALRT_STAT0,1 0x05-06 */
+            struct {
+                uint32_t CHARGE_OC : 1;
+                uint32_t DISCHARGE_OC : 1;
+                uint32_t SHORT : 1;
+                uint32_t CELL_UV : 1;
+                uint32_t CELL_OV : 1;
+                uint32_t PVDD_UVOV : 1;
+                uint32_t reserved1 : 8;  // Bits 6-13
+                uint32_t RESET : 1;
+                uint32_t SLEEP : 1;
+                uint32_t VREF : 1;
+                uint32_t LVMUX : 1;
+                uint32_t AVDD : 1;
+                uint32_t DVDD : 1;
+                uint32_t MISMATCH : 1;
+                uint32_t TDIE_LO : 1;
+                uint32_t TDIE_HI : 1;
+                uint32_t SPI_CRC_ERR : 1;
+                uint32_t EEPROM_CRC_ERR : 1;
+                uint32_t PACK_UV : 1;
+                uint32_t PACK_OV : 1;
+                uint32_t reserved2 : 4;  // Bits 27-30
+                uint32_t CLOCK_ABNORMAL : 1;
+            } hwAlertState_bits;
+        };
+        uint32_t hwAlertCellUnderOvervoltage; /* PB7170 ALRT_OVCELL 0x07 ALRT_UVCELL 0x08 */
+        union {
+            uint32_t hwAlertAux; /* PB7170 ALRT_AUX 0x0A */
+            struct {
+                uint32_t AUXIN1_OV : 1;
+                uint32_t AUXIN2_OV : 1;
+                uint32_t AUXIN3_OV : 1;
+                uint32_t AUXIN4_OV : 1;
+                uint32_t reserved1 : 4;
+                uint32_t AUXIN1_UV : 1;
+                uint32_t AUXIN2_UV : 1;
+                uint32_t AUXIN3_UV : 1;
+                uint32_t AUXIN4_UV : 1;
+            } hwAlertAux_bits;
+        };
+        uint32_t hwBalancerTimer; /* PB7170 BLSW_CMD 0x0F */
+        uint32_t hwBalancerStatus; /* PB7170 BLSW_STAT 0x10 */
+        /***************** Batteriemanagementstatus *****************/
+        union {
+            uint32_t mosfetStatus;
+            struct {
+                uint32_t PRECHARGE : 1;
+                uint32_t CHARGE : 1;
+                uint32_t DISCHARGE : 1;
+            } mosfetStatus_bits;
+        };
+        float prechargeResistorI2t;
+
+        float current;
+        float fastCurrent;
+        float cells[NUMBER_OF_CELLS];
+        float ntcTemperature[4];
+        float dieTemperature;
+        float voltage;
+        float pvddVoltage;
+        float availableChargeCurrent;
+        float availableDischargeCurrent;
     };
-    uint32_t hwAlertCellUnderOvervoltage; /* PB7170 ALRT_OVCELL 0x07 ALRT_UVCELL 0x08 */
-    union {
-        uint32_t hwAlertAux; /* PB7170 ALRT_AUX 0x0A */
-        struct {
-            uint32_t AUXIN1_OV : 1;
-            uint32_t AUXIN2_OV : 1;
-            uint32_t AUXIN3_OV : 1;
-            uint32_t AUXIN4_OV : 1;
-            uint32_t reserved1 : 4;
-            uint32_t AUXIN1_UV : 1;
-            uint32_t AUXIN2_UV : 1;
-            uint32_t AUXIN3_UV : 1;
-            uint32_t AUXIN4_UV : 1;
-        } hwAlertAux_bits;
+
+    /***************** Rohwerte AFE 0x84-0x9f, Umrechnung beim Leser *****************/
+    struct __attribute__((aligned(PDO_CACHE_LINE))) {
+        uint16_t rawCodes[PDO_RAW_CODES];
     };
-    uint32_t hwBalancerTimer; /* PB7170 BLSW_CMD 0x0F */
-    uint32_t hwBalancerStatus; /* PB7170 BLSW_STAT 0x10 */
-    /***************** Batteriemanagementstatus *****************/
-    union {
-        uint32_t mosfetStatus;
-        struct {
-            uint32_t PRECHARGE : 1;
-            uint32_t CHARGE : 1;
-            uint32_t DISCHARGE : 1;
-        } mosfetStatus_bits;
+
+    /***************** Kalt: selten geändert *****************/
+    struct __attribute__((aligned(PDO_CACHE_LINE))) {
+        uint32_t id;
+        float availableCapacity;
+        float totalCapacity;
+        float stateOfCharge;
+        float stateOfHealth;
+        float cycleCount;
     };
-    float prechargeResistorI2t;
-
-    float current;
-    float fastCurrent;
-    float cells[NUMBER_OF_CELLS];
-    float ntcTemperature[4];
-    float dieTemperature;
-    float voltage;
-    float pvddVoltage;
-    float availableChargeCurrent;
-    float availableDischargeCurrent;
-    float availableCapacity;
-    float totalCapacity;
-    float stateOfCharge;
-    float stateOfHealth;
-    float cycleCount;
-} PACK_PDO_t;
+} __attribute__((aligned(PDO_CACHE_LINE))) PACK_PDO_t;
 
 typedef struct {
     uint32_t ChargeEnable;
@@ -203,6 +297,47 @@ typedef struct {
     uint32_t ResetStateMachine;
 } PACK_SDO_t;
 
+/***************** Kommandoqueue (SHMEM /battery_sdo_shm) *****************/
+#define SDO_QUEUE_DEPTH 32       // Zweierpotenz
+#define SDO_CMDS_PER_TICK 4      // max. übernommene Kommandos je Tick
+
+typedef enum {
+    SDO_CMD_NONE = 0,
+    SDO_CMD_CHARGE_ENABLE,       // arg: 0/1
+    SDO_CMD_DISCHARGE_ENABLE,    // arg: 0/1
+    SDO_CMD_CLEAR_ALERTS,        // arg: Maske swAlertFlags, 0 = alle
+    SDO_CMD_RESET,               // Statemachine neu starten (Userconfig, Diagnose)
+    SDO_CMD_COUNT
+} ESdoCommand_t;
+
+typedef enum {
+    SDO_STATUS_PENDING = 0,
+    SDO_STATUS_DONE,
+    SDO_STATUS_BAD_COMMAND,
+    SDO_STATUS_BAD_PACK,
+} ESdoStatus_t;
+
+// Segment: PACK_SDO_t[numberOfPacks], SDO_QUEUE_t, SDO_CMD_t[depth], SDO_ACK_t[depth].
+// Mehrere Erzeuger (CAS auf enqueuePos), einziger Verbraucher ist bmsd.
+typedef struct {
+    uint32_t depth;
+    uint32_t enqueuePos;         // nächste freie Kommandonummer
+    uint32_t dequeuePos;         // nur bmsd
+    uint32_t reserved;
+} SDO_QUEUE_t;
+
+typedef struct {
+    uint32_t seq;                // == pos: frei für Kommando pos, == pos + 1: belegt
+    uint32_t cmd;                // ESdoCommand_t
+    uint32_t pack;               // PACK_PDO.id, 0 = alle aktiven Packs
+    uint32_t arg;
+} SDO_CMD_t;
+
+typedef struct {
+    uint32_t id;                 // quittierte Kommandonummer, Eintrag id % depth
+    uint32_t status;             // ESdoStatus_t
+} SDO_ACK_t;
+
 /**************** Konfigurationsdateien ****************/
 typedef struct __attribute__((packed)) {
     uint8_t address;
@@ -244,10 +379,61 @@ typedef struct {
     float tdieGain;
 } PACK_CALIBRATION_t;
 
+/***************** Zeitmessung (SHMEM /battery_timing_shm) *****************/
+#define TIMING_BUCKETS 32        // log2(ns), Bucket b: 2^b <= ns < 2^(b+1)
+#define TIMING_GLOBAL_PHASES 4   // ETimingGlobalPhase_t
+#define TIMING_PACK_PHASES 8     // ETimingPackPhase_t
+
+// Segment: TIMING_GLOBAL_t, TIMING_PHASE_t[TIMING_GLOBAL_PHASES],
+// dann TIMING_PHASE_t[TIMING_PACK_PHASES] je Pack
+typedef struct {
+    uint32_t numberOfPacks;
+    uint32_t globalPhases;
+    uint32_t packPhases;
+    uint32_t buckets;
+    uint32_t tickNs;             // Solltakt Scheduler
+    uint32_t ticks;
+    uint32_t overruns;           // Ticks mit timerExpirations > 1
+    uint32_t missedTicks;        // Summe der verpassten Ticks
+} TIMING_GLOBAL_t;
+
+typedef struct {
+    uint64_t sumNs;
+    uint32_t count;
+    uint32_t minNs;
+    uint32_t maxNs;
+    uint32_t hist[TIMING_BUCKETS];
+} TIMING_PHASE_t;
+
+/***************** Verlauf (SHMEM /battery_history_shm) *****************/
+#define HISTORY_DEPTH 128        // Zyklen im Ring (~8 s bei TICK_TIME_MS)
+
+// Segment: HISTORY_HEADER_t, dann depth Einträge zu je recordSize Bytes,
+// jeweils HISTORY_RECORD_t gefolgt von PACK_PDO_t[numberOfPacks].
+// Zyklus c liegt in Eintrag c % depth.
+typedef struct {
+    uint32_t depth;
+    uint32_t numberOfPacks;
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t cycle;              // zuletzt veröffentlichter Zyklus, 0 = noch keiner
+} __attribute__((aligned(PDO_CACHE_LINE))) HISTORY_HEADER_t;
+
+typedef struct {
+    uint32_t seq;                // Seqlock des Eintrags
+    uint32_t reserved;
+    uint64_t cycle;
+    uint64_t timeNs;             // CLOCK_REALTIME am Zyklusende
+} __attribute__((aligned(PDO_CACHE_LINE))) HISTORY_RECORD_t;
+
 extern GLOBAL_CONF_t g_GlobalConfig;
 extern GLOBAL_PDO_t* g_GlobalPdoData;
 extern PACK_PDO_t* g_PackPdoData;
 extern PACK_SDO_t* g_PackSdoData;
+extern SDO_QUEUE_t* g_SdoQueue;
+extern TIMING_GLOBAL_t* g_TimingData;
+extern TIMING_PHASE_t* g_TimingPhase;
+extern HISTORY_HEADER_t* g_History;
 extern PACK_USERCONF_t* g_PackUserConfig[MAX_BATTERY_PACKS];
 extern PACK_GENERALCONF_t* g_PackGeneralConfig[MAX_BATTERY_PACKS];
 extern PACK_CALIBRATION_t* g_PackCalibration[MAX_BATTERY_PACKS];
@@ -255,5 +441,18 @@ extern uint16_t g_packEnabled;
 
 int dob_LoadPackConfigs(void);
 void dob_Cleanup();
+void dob_WriteBegin(uint32_t *seq);
+void dob_WriteEnd(uint32_t *seq);
+int dob_ReadConsistent(const uint32_t *seq, const void *src, void *dst, size_t len, uint32_t maxRetries);
+const PDO_FIELD_t* dob_FindField(const PDO_HEADER_t *hdr, const char *name, uint32_t scope);
+void dob_HistoryPush(void);
+void dob_NotifyCycle(void);
+int64_t dob_WaitCycle(const GLOBAL_PDO_t *glob, uint32_t lastCycle, int timeoutMs);
+void dob_CommandQueueInit(SDO_QUEUE_t *queue, uint32_t depth);
+int dob_CommandPush(SDO_QUEUE_t *queue, uint32_t cmd, uint32_t pack, uint32_t arg, uint32_t *id);
+uint32_t dob_CommandStatus(const SDO_QUEUE_t *queue, uint32_t id);
+int dob_CommandPop(SDO_CMD_t *cmd, uint32_t *id);
+void dob_CommandAck(uint32_t id, uint32_t status);
+int dob_HistoryRead(const HISTORY_HEADER_t *hist, uint64_t *next, void *dst, uint32_t maxRecords, uint64_t *lost);
 
 #endif
\ No newline at end of file
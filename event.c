@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sched.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "event.h"
+#include "timing.h"
+
+/*
+ * Ereignisse des Steuerthreads (Single Producer) gehen über einen lock-freien
+ * Ring an den Housekeeping-Thread (Single Consumer), der sie formatiert und an
+ * syslog weitergibt. evt_Post blockiert nie, bei vollem Ring wird das Ereignis
+ * verworfen und gezählt. Der Housekeeping-Thread läuft ohne Echtzeitpriorität
+ * und übernimmt auch sonstige periodische Arbeit (Laufzeitbericht).
+ */
+#define EVT_POLL_MS 50           // Ring leeren
+#define EVT_REPORT_S 3600        // tim_Report
+
+static EVENT_t s_evtRing[EVT_RING_SIZE];
+static _Atomic uint32_t s_evtHead;     // nur Producer schreibt
+static _Atomic uint32_t s_evtTail;     // nur Consumer schreibt
+static _Atomic uint32_t s_evtDropped;
+static volatile int s_evtStop;
+static pthread_t s_evtThread;
+static int s_evtRunning;
+
+static const struct {
+    int priority;
+    const char *text;            // Pack-Ereignisse: %u Pack, %u arg; global: %u arg
+} s_evtFormat[EVT_COUNT] = {
+    [EVT_AFE_FOUND]           = { LOG_INFO,    "PACK%u: PB7170 gefunden, initialisiere..." },
+    [EVT_CALIBRATION_FAILED]  = { LOG_WARNING, "PACK%u: Taktkalibrierung fehlgeschlagen" },
+    [EVT_SPI_SPEED]           = { LOG_INFO,    "PACK%u: SPI-Takt %u kHz" },
+    [EVT_USER_WRITTEN]        = { LOG_INFO,    "PACK%u: Userconfig erfolgreich geschrieben" },
+    [EVT_USER_WRITE_FAILED]   = { LOG_INFO,    "PACK%u: Fehler beim Schreiben der Userconfig" },
+    [EVT_DIAG_FAILED]         = { LOG_ALERT,   "PACK%u: Diagnose fehlerhaft, deaktiviere Pack" },
+    [EVT_DIAG_OK]             = { LOG_INFO,    "PACK%u: Diagnose erfolgreich" },
+    [EVT_RUN]                 = { LOG_INFO,    "PACK%u: Konfiguration fertig, RUN-Mode" },
+    [EVT_SANITY_FAILED]       = { LOG_ALERT,   "PACK%u: Sanity-Check fehlerhaft, deaktiviere Pack" },
+    [EVT_USER_CHANGED]        = { LOG_ALERT,   "PACK%u: Userconfig verändert, deaktiviere Pack" },
+    [EVT_SPI_ERROR_BURST]     = { LOG_ALERT,   "PACK%u: %u SPI-Fehler in Folge" },
+    [EVT_TIMER_OVERRUN]       = { LOG_ALERT,   "Timerüberlauf %u mal" },
+    [EVT_TIMER_ERROR]         = { LOG_ERR,     "Fehler beim Warten auf den Timer: errno %u" },
+    [EVT_ALERTS_CLEARED]      = { LOG_NOTICE,  "PACK%u: Fehler quittiert (0x%08x)" },
+    [EVT_RESET]               = { LOG_NOTICE,  "PACK%u: Statemachine zurückgesetzt, initialisiere..." },
+};
+
+int evt_Post(EEvent_t code, uint8_t pack, uint8_t state, uint32_t alert, uint32_t arg)
+{
+    uint32_t head = atomic_load_explicit(&s_evtHead, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&s_evtTail, memory_order_acquire);
+
+    if (head - tail >= EVT_RING_SIZE) {
+        atomic_fetch_add_explicit(&s_evtDropped, 1, memory_order_relaxed);
+        return -1; // Ring voll
+    }
+
+    EVENT_t *e = &s_evtRing[head & (EVT_RING_SIZE - 1)];
+    e->timeNs = tim_Now();
+    e->alert = alert;
+    e->arg = arg;
+    e->code = code;
+    e->pack = pack;
+    e->state = state;
+    atomic_store_explicit(&s_evtHead, head + 1, memory_order_release);
+    return 0;
+}
+
+static void EvtFormat(const EVENT_t *e)
+{
+    char text[160];
+    size_t len;
+
+    if (e->code >= EVT_COUNT)
+        return;
+    if (e->pack == EVT_GLOBAL)
+        len = snprintf(text, sizeof(text), s_evtFormat[e->code].text, e->arg);
+    else
+        len = snprintf(text, sizeof(text), s_evtFormat[e->code].text, e->pack, e->arg);
+
+    // Verzögerung durch den Ring nur erwähnen, wenn sie auffällt
+    uint64_t ageMs = (tim_Now() - e->timeNs) / 1000000;
+    if (ageMs >= 1000 && len < sizeof(text))
+        snprintf(text + len, sizeof(text) - len, " (vor %llu ms)", (unsigned long long)ageMs);
+
+    syslog(s_evtFormat[e->code].priority, "%s", text);
+}
+
+static void EvtDrain(void)
+{
+    uint32_t tail = atomic_load_explicit(&s_evtTail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&s_evtHead, memory_order_acquire);
+
+    while (tail != head) {
+        EVENT_t e = s_evtRing[tail & (EVT_RING_SIZE - 1)];
+        atomic_store_explicit(&s_evtTail, ++tail, memory_order_release);
+        EvtFormat(&e);
+    }
+
+    uint32_t dropped = atomic_exchange_explicit(&s_evtDropped, 0, memory_order_relaxed);
+    if (dropped)
+        syslog(LOG_WARNING, "%u Ereignisse verworfen (Ring voll)", dropped);
+}
+
+static void* EvtThread(void *arg)
+{
+    const struct timespec poll = {0, EVT_POLL_MS * 1000000L};
+    uint64_t nextReport = tim_Now() + EVT_REPORT_S * 1000000000ull;
+
+    while (!s_evtStop) {
+        EvtDrain();
+        if (tim_Now() >= nextReport) {
+            tim_Report();
+            nextReport += EVT_REPORT_S * 1000000000ull;
+        }
+        nanosleep(&poll, NULL);
+    }
+    EvtDrain();
+    return NULL;
+}
+
+/*
+ * Vor SetupTask/SetupRealtime starten: der Thread läuft explizit mit
+ * SCHED_OTHER und behält die volle CPU-Maske, Signale bleiben beim
+ * Hauptthread.
+ */
+int evt_Start(void)
+{
+    pthread_attr_t attr;
+    struct sched_param sp = { .sched_priority = 0 };
+    sigset_t block, old;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &sp);
+
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int ret = pthread_create(&s_evtThread, &attr, EvtThread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    pthread_attr_destroy(&attr);
+    if (ret)
+        return -1;
+    s_evtRunning = 1;
+    return 0;
+}
+
+// Restliche Ereignisse ausgeben und Thread beenden
+void evt_Stop(void)
+{
+    if (!s_evtRunning)
+        return;
+    s_evtStop = 1;
+    pthread_join(s_evtThread, NULL);
+    s_evtRunning = 0;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+
+#define EVT_RING_SIZE 256        // Zweierpotenz
+#define EVT_GLOBAL 0             // Pack-Id für Ereignisse ohne Pack
+
+typedef enum {
+    EVT_AFE_FOUND = 0,
+    EVT_CALIBRATION_FAILED,
+    EVT_SPI_SPEED,               // arg: kHz
+    EVT_USER_WRITTEN,
+    EVT_USER_WRITE_FAILED,
+    EVT_DIAG_FAILED,
+    EVT_DIAG_OK,
+    EVT_RUN,
+    EVT_SANITY_FAILED,
+    EVT_USER_CHANGED,
+    EVT_SPI_ERROR_BURST,         // arg: Fehler in Folge
+    EVT_TIMER_OVERRUN,           // arg: timerExpirations
+    EVT_TIMER_ERROR,             // arg: errno
+    EVT_ALERTS_CLEARED,          // arg: gelöschte swAlertFlags
+    EVT_RESET,
+    EVT_COUNT
+} EEvent_t;
+
+// Festes Binärformat, Text erzeugt erst der Housekeeping-Thread
+typedef struct {
+    uint64_t timeNs;             // CLOCK_MONOTONIC
+    uint32_t alert;              // swAlertFlags
+    uint32_t arg;
+    uint16_t code;               // EEvent_t
+    uint8_t pack;                // PACK_PDO.id, EVT_GLOBAL ohne Pack
+    uint8_t state;               // EStateMachine_t
+} EVENT_t;
+
+int evt_Post(EEvent_t code, uint8_t pack, uint8_t state, uint32_t alert, uint32_t arg);
+int evt_Start(void);
+void evt_Stop(void);
+
+#endif
\ No newline at end of file
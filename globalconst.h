@@ -1 +1,7 @@
-#define CYCLE_TIME_MS 252
+#define TICK_TIME_MS 63          // Grundtakt Scheduler
+#define CYCLE_TIME_MS 252        // Zell-/Packspannung, Limits, Init/Diagnose
+#define FAST_TIME_MS 50          // Strom, Flags, Fehler, MosControl
+#define TEMP_TIME_MS 1000        // NTC, Chiptemperatur
+#define BALANCE_TIME_MS 10000    // Balancer planen
+#define VERIFY_TIME_MS 60000     // Userconfig im Hintergrund prüfen
+#define PRECHARGE_TIME_MS 1000   // Vorladung des ersten Packs (keine Busmessung)
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // sched_setaffinity
 #include <stdio.h>
 #include <unistd.h>
 #include <stdint.h>
@@ -5,15 +6,20 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <sys/timerfd.h>
+#include <sys/mman.h>
 #include <sched.h>
-#include <syslog.h>
-
-#ifdef TIME_IT
+#include <string.h>
 #include <time.h>
-#endif
+#include <syslog.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #include "globalconst.h"
 #include "spi.h"
+#include "crc8.h"
+#include "timing.h"
+#include "event.h"
 #include "bms.h"
 #include "dataobjects.h"
 
@@ -22,13 +28,31 @@
 static volatile sig_atomic_t g_shutdownRequest = 0;
 static int g_timerFd = -1;
 
+// Taktgeber: timerfd oder clock_nanosleep(TIMER_ABSTIME) auf absolute Deadlines
+#define RT_STACK_PREFAULT (64 * 1024)
+static int s_useNanosleep = 0;
+static uint64_t s_cycleNs;
+static uint64_t s_deadline; // nächster Tick
+
+// I/O-Thread: liest die Messdaten des nächsten Packs während das aktuelle gerechnet wird
+static pthread_t s_ioThread;
+static int s_ioThreadRunning = 0;
+static sem_t s_ioRequest;
+static sem_t s_ioDone;
+static int32_t s_ioPack = -1; // -1 beendet den Thread
+
+// Übernommene SDO-Kommandos, quittiert erst nach den Packs
+static uint32_t s_cmdId[SDO_CMDS_PER_TICK];
+static uint32_t s_cmdStatus[SDO_CMDS_PER_TICK];
+static uint32_t s_cmdCount;
+
 // Signal-Handler-Funktion
 static void SignalHandler(int sig) {
     printf("!!! Signal %d - Herunterfahren erzwingen...\n", sig);
     g_shutdownRequest = 1;
 }
 
-static int SetupTask(int cycletimeMs) {
+static int SetupTask(long cycletimeNs) {
     /************** Setup Priority **************/
     struct sched_param sp;
     sp.sched_priority = 20; // Wertebereich: 1–99 (höher = wichtiger)
@@ -36,15 +60,83 @@ static int SetupTask(int cycletimeMs) {
         return -1;
 
     /************** Setup Timer **************/
+    s_cycleNs = cycletimeNs;
+    if (s_useNanosleep)
+        return 0;
     g_timerFd = timerfd_create(CLOCK_MONOTONIC, 0);
     if (g_timerFd < 0)
         return -2;
+    return 0;
+}
+
+// Erster Tick eine Periode nach dem Start der Hauptschleife
+static int StartTimer(void) {
+    s_deadline = tim_Now() + s_cycleNs;
+    if (s_useNanosleep)
+        return 0;
     struct itimerspec period = {
-        .it_interval = {0, cycletimeMs * 1000000},
-        .it_value = {0, cycletimeMs * 1000000}
+        .it_interval = {s_cycleNs / 1000000000, s_cycleNs % 1000000000},
+        .it_value = {s_deadline / 1000000000, s_deadline % 1000000000}
     };
-    if (timerfd_settime(g_timerFd, 0, &period, NULL))
-        return -3;
+    return timerfd_settime(g_timerFd, TFD_TIMER_ABSTIME, &period, NULL) ? -1 : 0;
+}
+
+// Wartet auf den nächsten Tick, liefert wie timerfd die Anzahl abgelaufener Perioden
+static int WaitTick(uint64_t *expirations) {
+    if (s_useNanosleep) {
+        struct timespec ts = {s_deadline / 1000000000, s_deadline % 1000000000};
+        int err;
+        // liefert den Fehler zurück statt errno zu setzen, EINTR ohne Shutdown: weiter warten
+        while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) == EINTR && !g_shutdownRequest)
+            ;
+        if (err) {
+            errno = err;
+            return -1;
+        }
+        *expirations = 1 + (tim_Now() - s_deadline) / s_cycleNs;
+    } else {
+        ssize_t n;
+        while ((n = read(g_timerFd, expirations, sizeof(*expirations))) < 0 && errno == EINTR && !g_shutdownRequest)
+            ;
+        if (n != sizeof(*expirations)) {
+            if (n >= 0)
+                errno = EIO;
+            return -1;
+        }
+    }
+
+    // Weckverzögerung gegenüber dem zuletzt abgelaufenen Tick
+    uint64_t due = s_deadline + (*expirations - 1) * s_cycleNs;
+    tim_Global(TIMING_WAKEUP, due);
+    s_deadline = due + s_cycleNs;
+    return 0;
+}
+
+// Stack seitenweise anfassen, damit im Zyklus kein Page-Fault mehr auftritt
+static void PrefaultStack(void) {
+    volatile uint8_t stack[RT_STACK_PREFAULT];
+    long page = sysconf(_SC_PAGESIZE);
+    for (size_t i = 0; i < sizeof(stack); i += page)
+        stack[i] = 0;
+}
+
+/*
+ * Echtzeitmodus: alle Seiten sperren (Config-Puffer, SHMEM, Heap und alle
+ * späteren Mappings wie der Stack des I/O-Threads werden dabei eingelagert),
+ * Stack vorab anfassen und optional auf eine isolierte CPU festlegen. Der
+ * I/O-Thread erbt die CPU-Maske, daher vor SetupIoThread aufrufen.
+ */
+static int SetupRealtime(int cpu) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE))
+        return -1;
+    PrefaultStack();
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set))
+            return -2;
+    }
     return 0;
 }
 
@@ -80,8 +172,85 @@ static int SetupSignalHandlers(void) {
     return 0;
 }
 
+static void* IoThread(void *arg) {
+    for (;;) {
+        while (sem_wait(&s_ioRequest) && errno == EINTR)
+            ;
+        if (s_ioPack < 0)
+            break;
+        spi_SelectDevice(s_ioPack);
+        bms_Prefetch(s_ioPack);
+        sem_post(&s_ioDone);
+    }
+    return NULL;
+}
+
+// Erbt SCHED_FIFO vom Hauptthread, daher nach SetupTask starten
+static int SetupIoThread(void) {
+    sigset_t block, old;
+
+    if (sem_init(&s_ioRequest, 0, 0) || sem_init(&s_ioDone, 0, 0))
+        return -1;
+
+    // Signale nur im Hauptthread behandeln
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    sigaddset(&block, SIGQUIT);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int ret = pthread_create(&s_ioThread, NULL, IoThread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret)
+        return -2;
+    s_ioThreadRunning = 1;
+    return 0;
+}
+
+static inline void IoPrefetch(int32_t id) {
+    s_ioPack = id;
+    sem_post(&s_ioRequest);
+}
+
+static inline void IoWait(void) {
+    uint64_t t0 = tim_Now();
+    while (sem_wait(&s_ioDone) && errno == EINTR)
+        ;
+    tim_Global(TIMING_IOWAIT, t0);
+}
+
+// Höchstens SDO_CMDS_PER_TICK Kommandos aus der Queue übernehmen
+static void TakeCommands(void) {
+    SDO_CMD_t cmd;
+
+    for (s_cmdCount = 0; s_cmdCount < SDO_CMDS_PER_TICK; s_cmdCount++) {
+        if (dob_CommandPop(&cmd, &s_cmdId[s_cmdCount]))
+            break;
+        s_cmdStatus[s_cmdCount] = bms_Command(cmd.cmd, cmd.pack, cmd.arg);
+    }
+}
+
+static void AckCommands(void) {
+    for (uint32_t i = 0; i < s_cmdCount; i++)
+        dob_CommandAck(s_cmdId[i], s_cmdStatus[i]);
+    s_cmdCount = 0;
+}
+
+// Nächstes aktives Pack nach id, -1 wenn keins mehr
+static int32_t NextPack(int32_t id) {
+    for (id++; id < (int32_t)g_GlobalConfig.numberOfPacks; id++)
+        if (g_packEnabled & (1 << id))
+            return id;
+    return -1;
+}
+
 // Ressourcen-Cleanup Funktion
 static void CleanupResources(void) {
+    if (s_ioThreadRunning) {
+        IoPrefetch(-1);
+        pthread_join(s_ioThread, NULL);
+        s_ioThreadRunning = 0;
+    }
+    evt_Stop();
     spi_Cleanup();
     dob_Cleanup();
     if (g_timerFd >= 0) {
@@ -89,8 +258,56 @@ static void CleanupResources(void) {
     }
 }
 
-int main(void) {
+static void Usage(const char *name) {
+    printf("Usage: %s [-s szenario] [-x zeitfaktor] [-r] [-c cpu] [-n]\n", name);
+    printf("  -s szenario   PB7170-Simulator statt /dev/spidev0.0 verwenden\n");
+    printf("  -x faktor     Simulationszeit um faktor beschleunigen (nur mit -s)\n");
+    printf("  -r            Echtzeitmodus: mlockall, Stack vorab einlagern\n");
+    printf("  -c cpu        Steuer- und I/O-Thread auf CPU festlegen (mit -r)\n");
+    printf("  -n            clock_nanosleep auf absolute Deadlines statt timerfd\n");
+}
+
+int main(int argc, char **argv) {
     uint64_t timerExpirations;
+    uint64_t lastWake = 0;
+    const char *simScenario = NULL;
+    float timeScale = 1.0f;
+    int realtime = 0;
+    int cpu = -1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:x:rc:nh")) != -1) {
+        switch (opt) {
+            case 's':
+                simScenario = optarg;
+                break;
+            case 'x':
+                timeScale = strtof(optarg, NULL);
+                break;
+            case 'r':
+                realtime = 1;
+                break;
+            case 'c':
+                cpu = atoi(optarg);
+                break;
+            case 'n':
+                s_useNanosleep = 1;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+#ifdef SPI_NO_HW
+    if (!simScenario) {
+        printf("Build ohne Hardware-Transport, Szenario mit -s angeben\n");
+        return 1;
+    }
+#endif
+    if (timeScale <= 0 || (!simScenario && timeScale != 1.0f) || (cpu >= 0 && !realtime)) {
+        Usage(argv[0]);
+        return 1;
+    }
         
     // Signal-Handler setup
     if (SetupSignalHandlers()) {
@@ -99,7 +316,7 @@ int main(void) {
     }
     
     // Task Initialisierung
-    if (SetupTask(CYCLE_TIME_MS)) {
+    if (SetupTask((long)(TICK_TIME_MS * 1000000L / timeScale))) {
         printf("Failed to set up task\n");
         return 1;
     }
@@ -107,9 +324,32 @@ int main(void) {
     openlog("pb7170_bmsd", LOG_PID | LOG_CONS, LOG_DAEMON);
     syslog(LOG_INFO, "PB7170 BMS Controller (Build: %s %s)\n", __DATE__, __TIME__);
 
+    // Housekeeping vor SetupRealtime starten, damit er nicht auf der
+    // Steuer-CPU landet. Ab hier meldet die Hauptschleife nur noch Ereignisse.
+    if (evt_Start()) {
+        syslog(LOG_ERR, "Initialisierungsfehler Housekeeping-Thread");
+        CleanupResources();
+        return 1;
+    }
+
+    // CRC Kernel prüfen
+    crc8_Init();
+    if (crc8_SelfCheck()) {
+        syslog(LOG_ERR, "CRC8 Selbsttest fehlgeschlagen (Kernel %s)", crc8_KernelName());
+        CleanupResources();
+        return 1;
+    }
+
     // SPI Initialisierung
     const unsigned int GPIO_PINS[3] = {24, 25, 26};
-    if (spi_Init("/dev/spidev0.0", 1250000, 0, 8, "/dev/gpiochip1", GPIO_PINS, 3)) {
+    const char *spiDevice = "/dev/spidev0.0";
+    if (simScenario) {
+        syslog(LOG_INFO, "Simulator: %s (Zeitfaktor %.1f)", simScenario, timeScale);
+        spi_SetTransport(&g_spiTransportSim);
+        spisim_SetTimeScale(timeScale);
+        spiDevice = simScenario;
+    }
+    if (spi_Init(spiDevice, 1250000, 0, 8, "/dev/gpiochip1", GPIO_PINS, 3)) {
         syslog(LOG_ERR, "Initialisierungsfehler SPI");
         CleanupResources();
         return 1;
@@ -122,53 +362,88 @@ int main(void) {
         return 1;
     }
     
+    spi_SetRetryPolicy(g_GlobalConfig.spiMaxRetries, g_GlobalConfig.spiRetryBudgetUs);
+    tim_Init((uint32_t)(TICK_TIME_MS * 1000000L / timeScale));
+
+    if (realtime) {
+        if (SetupRealtime(cpu)) {
+            syslog(LOG_ERR, "Initialisierungsfehler Echtzeitmodus: %m");
+            CleanupResources();
+            return 1;
+        }
+        syslog(LOG_INFO, "Echtzeitmodus aktiv (CPU %d)", cpu);
+    }
+    syslog(LOG_INFO, "Taktgeber: %s", s_useNanosleep ? "clock_nanosleep" : "timerfd");
+
+    if (SetupIoThread()) {
+        syslog(LOG_ERR, "Initialisierungsfehler I/O-Thread");
+        CleanupResources();
+        return 1;
+    }
+
     syslog(LOG_INFO, "--- Starte Task mit %u Packs ---", g_GlobalConfig.numberOfPacks);
     
     // Hauptschleife
+    if (StartTimer()) {
+        syslog(LOG_ERR, "Timer konnte nicht gestartet werden");
+        CleanupResources();
+        return 1;
+    }
     while (!g_shutdownRequest) {
-        ssize_t bytesRead = read(g_timerFd, &timerExpirations, sizeof(timerExpirations));
-        
-        if (bytesRead != sizeof(timerExpirations)) {
+        if (WaitTick(&timerExpirations)) {
             if (g_shutdownRequest) {
                 // Bei Shutdown ist das normal
                 break;
             }
-            syslog(LOG_ERR, "Fehler beim Lesen des Timers: %zd bytes\n", bytesRead);
+            evt_Post(EVT_TIMER_ERROR, EVT_GLOBAL, 0, 0, errno);
             continue;
         }
         
+        uint64_t wake = tim_Now();
+        if (lastWake)
+            tim_Global(TIMING_PERIOD, lastWake);
+        lastWake = wake;
+        tim_Tick(timerExpirations);
+
         if (timerExpirations != 1) {
-            syslog(LOG_ALERT, "Timerüberlauf %llu mal\n", (unsigned long long)timerExpirations);
+            evt_Post(EVT_TIMER_OVERRUN, EVT_GLOBAL, 0, 0, (uint32_t)timerExpirations);
         }
         
-#ifdef TIME_IT
-        struct timespec t_start, t_end;
-        clock_gettime(CLOCK_MONOTONIC, &t_start);
-#endif
-        
-        // BMS Aufgaben für alle aktiven Packs
-        g_GlobalPdoData->sync = 0;
-        for (uint32_t curId = 0; curId < g_GlobalConfig.numberOfPacks && !g_shutdownRequest; curId++) {
-            if ((g_packEnabled & (1 << curId)) == 0) {
-                continue;
-            }
-            
+        // BMS Aufgaben für alle aktiven Packs. Der I/O-Thread holt die
+        // Messdaten von Pack N+1 während Pack N gerechnet wird, Schreibzugriffe
+        // (MosControl) von Pack N laufen weiter in dessen bms_CyclicTask.
+        dob_WriteBegin(&g_GlobalPdoData->seq);
+        bms_Tick();
+        TakeCommands();
+        int32_t curId = NextPack(-1);
+        if (curId >= 0)
+            IoPrefetch(curId);
+        while (curId >= 0) {
+            IoWait();
+            if (g_shutdownRequest)
+                break;
+            int32_t nextId = NextPack(curId);
+            if (nextId >= 0)
+                IoPrefetch(nextId);
+
             spi_SelectDevice(curId);
+            dob_WriteBegin(&g_PackPdoData[curId].seq);
             bms_CyclicTask(curId);
+            dob_WriteEnd(&g_PackPdoData[curId].seq);
             // CYCLE_TASK
+            curId = nextId;
         }
-        g_GlobalPdoData->sync = 1;
-        
-#ifdef TIME_IT
-        if (clock_gettime(CLOCK_MONOTONIC, &t_end) == 0) {
-            double elapsed_ms = (t_end.tv_sec - t_start.tv_sec) * 1e3 + (t_end.tv_nsec - t_start.tv_nsec) / 1e6;
-            printf("loop duration: %.3f ms\n", elapsed_ms);
-        }
-#endif
+        bms_Aggregate();
+        dob_WriteEnd(&g_GlobalPdoData->seq);
+        dob_HistoryPush();
+        AckCommands();
+        dob_NotifyCycle();
+        tim_Global(TIMING_LOOP, wake);
     }
     
     // Kontrolliertes Herunterfahren
     syslog(LOG_INFO, "BMS Controller herunterfahren... ");
+    tim_Report();
     CleanupResources();
     closelog();
     return 0;
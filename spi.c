@@ -1,80 +1,335 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
 #include <linux/spi/spidev.h>
-#include <sys/ioctl.h>
-#include <gpiod.h>
+
+#include "spi.h"
+#include "crc8.h"
+#include "timing.h"
 
 // ---------------- Globals ----------------
-int g_spiFd = -1;                        // globales SPI-Filedescriptor
+#ifdef SPI_NO_HW
+static const SPI_TRANSPORT_t *s_spiTransport = &g_spiTransportSim;
+#else
+static const SPI_TRANSPORT_t *s_spiTransport = &g_spiTransportHw;
+#endif
 static uint8_t s_spiTxBuf[67];          // globaler TX-Buffer
 static uint8_t s_spiRxBuf[67];          // globaler RX-Buffer
 static struct spi_ioc_transfer s_SpiTr;  // globaler SPI-Transfer struct
 
-static unsigned int s_gpioNrPins;
-static struct gpiod_line_request *s_gpioRequest;
-
-// ---------------- CRC8 ----------------
-static const uint8_t s_afeCrc8Table[256] =
-{
-    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15, 0x38, 0x3F, 0x36, 0x31, 
-    0x24, 0x23, 0x2A, 0x2D, 0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65, 
-    0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D, 0xE0, 0xE7, 0xEE, 0xE9, 
-    0xFC, 0xFB, 0xF2, 0xF5, 0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD, 
-    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85, 0xA8, 0xAF, 0xA6, 0xA1, 
-    0xB4, 0xB3, 0xBA, 0xBD, 0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2, 
-    0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA, 0xB7, 0xB0, 0xB9, 0xBE, 
-    0xAB, 0xAC, 0xA5, 0xA2, 0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A, 
-    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32, 0x1F, 0x18, 0x11, 0x16, 
-    0x03, 0x04, 0x0D, 0x0A, 0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42, 
-    0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A, 0x89, 0x8E, 0x87, 0x80, 
-    0x95, 0x92, 0x9B, 0x9C, 0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4, 
-    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC, 0xC1, 0xC6, 0xCF, 0xC8, 
-    0xDD, 0xDA, 0xD3, 0xD4, 0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C, 
-    0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44, 0x19, 0x1E, 0x17, 0x10, 
-    0x05, 0x02, 0x0B, 0x0C, 0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34, 
-    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B, 0x76, 0x71, 0x78, 0x7F, 
-    0x6A, 0x6D, 0x64, 0x63, 0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B, 
-    0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13, 0xAE, 0xA9, 0xA0, 0xA7, 
-    0xB2, 0xB5, 0xBC, 0xBB, 0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83, 
-    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB, 0xE6, 0xE1, 0xE8, 0xEF, 
-    0xFA, 0xFD, 0xF4, 0xF3
-};
-
-static inline uint8_t AFECrc8(const void *data, uint_fast8_t len)
-{
-    const uint8_t *p = (const uint8_t *)data;
-    uint8_t crc = 0x00;
-
-    while (len >= 4)
+/*
+ * Steuer- und I/O-Thread teilen sich den Bus. Jeder Thread wählt sein AFE
+ * selbst (s_spiDevice ist thread-lokal), der Mux wird erst beim Transfer unter
+ * s_spiBusLock umgeschaltet. Globale Puffer oben und Wiederholungspuffer
+ * werden nur unter der Sperre benutzt, Transaktionen werden je Thread
+ * aufgebaut. Ein AFE darf nur von einem Thread gleichzeitig angesprochen
+ * werden (Registerschatten, Takt und Zähler sind je AFE ungeschützt).
+ */
+static pthread_mutex_t s_spiBusLock = PTHREAD_MUTEX_INITIALIZER;
+static uint_fast8_t s_spiBusDevice = 0xff; // aktuell am Mux ausgewählt
+
+// Transaktionen: mehrere Frames in einem SPI_IOC_MESSAGE(N)
+typedef struct {
+    uint16_t *output;                    // Ziel für Lesedaten, NULL bei Schreibzugriff
+    uint8_t addr;                        // Startadresse
+    uint8_t count;                       // Anzahl Register (Lesen)
+    uint16_t data;                       // Schreibwert
+} SPI_BATCH_FRAME_t;
+
+static __thread struct spi_ioc_transfer s_spiBatchTr[SPI_BATCH_MAX_FRAMES];
+static __thread SPI_BATCH_FRAME_t s_spiBatchFrame[SPI_BATCH_MAX_FRAMES];
+static __thread uint8_t s_spiBatchTxBuf[SPI_BATCH_MAX_BYTES];
+static __thread uint8_t s_spiBatchRxBuf[SPI_BATCH_MAX_BYTES];
+static __thread uint_fast8_t s_spiBatchFrames;
+static __thread size_t s_spiBatchBytes;
+static __thread int s_spiBatchError;
+
+// Registerschatten je AFE (letzter geschriebener oder gelesener Wert)
+static __thread uint_fast8_t s_spiDevice;
+static uint16_t s_afeShadow[SPI_MAX_DEVICES][AFE_SHADOW_SIZE];
+static uint8_t s_afeShadowValid[SPI_MAX_DEVICES][AFE_SHADOW_SIZE];
+
+// Fehlerzählung und Wiederholungen je AFE
+static SPI_STATS_t s_spiStats[SPI_MAX_DEVICES];
+static uint32_t s_spiMaxRetries = 2;
+static uint32_t s_spiRetryBudgetUs = 2000;
+static struct spi_ioc_transfer s_spiRetryTr[SPI_BATCH_MAX_FRAMES];
+static uint8_t s_spiRetryIdx[SPI_BATCH_MAX_FRAMES];
+
+// SPI-Takt je AFE
+#define SPI_CALIB_PROBES 8        // Testlesungen je Taktstufe
+#define SPI_BACKOFF_ERRORS 4      // CRC Fehler ...
+#define SPI_BACKOFF_WINDOW 256    // ... innerhalb so vieler Aufrufe -> Takt eine Stufe zurück
+static uint32_t s_spiMinSpeedHz;
+static uint32_t s_spiSpeedHz[SPI_MAX_DEVICES];
+static uint16_t s_spiBackoffCalls[SPI_MAX_DEVICES];
+static uint8_t s_spiBackoffErrors[SPI_MAX_DEVICES];
+
+// ---------------- Framing ----------------
+// Lesekommando: 2 Byte Header, count*2 Byte Daten, 1 Byte CRC
+static inline size_t AFEFrameRead(uint8_t *tx, uint8_t addr, uint_fast8_t count)
+{
+    tx[0] = (addr & 0x7F) << 1;
+    tx[1] = ((count - 1) & 0x1F) | (addr & 0x80);
+    return 2 + (size_t)count * 2 + 1;
+}
+
+// Schreibkommando: 1 Byte Header, 2 Byte Daten, 1 Byte CRC
+static inline size_t AFEFrameWrite(uint8_t *tx, uint8_t addr, uint16_t data)
+{
+    tx[0] = ((addr & 0x7F) << 1) | 1;
+    tx[1] = data >> 8;
+    tx[2] = data & 0xFF;
+    tx[3] = crc8_Calc(tx, 3);
+    return 4;
+}
+
+// CRC der Antwort prüfen und Daten big-endian entpacken
+static inline int AFEUnpackRead(const uint8_t *tx, uint8_t *rx, uint16_t *output, uint_fast8_t count)
+{
+    // Header für CRC prüfen
+    rx[0] = tx[0];
+    rx[1] = tx[1];
+    if (crc8_Calc(rx, 2 + (size_t)count * 2 + 1))
+        return -3; // CRC Fehler
+
+    // Pointer-basiert Daten aus RX extrahieren (big-endian)
+    const uint8_t *p = &rx[2];
+    for (uint_fast8_t i = 0; i < count; i++)
     {
-        crc = s_afeCrc8Table[crc ^ *p++];
-        crc = s_afeCrc8Table[crc ^ *p++];
-        crc = s_afeCrc8Table[crc ^ *p++];
-        crc = s_afeCrc8Table[crc ^ *p++];
-        len -= 4;
+        output[i] = ((uint16_t)p[0] << 8) | p[1];
+        p += 2;
     }
-    while (len--)
-    {
-        crc = s_afeCrc8Table[crc ^ *p++];
+    return 0;
+}
+
+// ---------------- Registerschatten ----------------
+/*
+ * Nur Konfigurationsregister, die das AFE nicht selbst verändert, werden
+ * gespiegelt: BLSW_CTRL/BLSW_CFG 0x0c-0x0d, MOS_TRIG 0x13 und die
+ * Userconfig 0x14-0x3d. Flags (W1C), Zähler wie BLSW_CMD 0x0f, Watchdog,
+ * Schlüsselregister und Diagnoseregister werden immer geschrieben.
+ */
+static inline int AFEShadowCacheable(uint8_t addr)
+{
+    return addr == 0x0c || addr == 0x0d || (addr >= 0x13 && addr <= 0x3d);
+}
+
+// 1 wenn der Schreibzugriff nichts ändern würde
+static inline int AFEShadowMatch(uint8_t addr, uint16_t data)
+{
+    return AFEShadowCacheable(addr) &&
+        s_afeShadowValid[s_spiDevice][addr] &&
+        s_afeShadow[s_spiDevice][addr] == data;
+}
+
+static inline void AFEShadowStore(uint8_t addr, uint16_t data)
+{
+    if (!AFEShadowCacheable(addr))
+        return;
+    s_afeShadow[s_spiDevice][addr] = data;
+    s_afeShadowValid[s_spiDevice][addr] = 1;
+}
+
+static inline void AFEShadowStoreBlock(uint8_t addr, const uint16_t *data, uint_fast8_t count)
+{
+    for (uint_fast8_t i = 0; i < count && addr + i < AFE_SHADOW_SIZE; i++)
+        AFEShadowStore(addr + i, data[i]);
+}
+
+static inline void AFEShadowDrop(uint8_t addr)
+{
+    if (addr < AFE_SHADOW_SIZE)
+        s_afeShadowValid[s_spiDevice][addr] = 0;
+}
+
+void spi_ShadowInvalidate(void)
+{
+    memset(s_afeShadowValid[s_spiDevice], 0, sizeof(s_afeShadowValid[s_spiDevice]));
+}
+
+// ---------------- Bus ----------------
+// Bus sperren und Mux auf das AFE des aufrufenden Threads schalten
+static int BusAcquire(void)
+{
+    pthread_mutex_lock(&s_spiBusLock);
+    s_SpiTr.speed_hz = s_spiSpeedHz[s_spiDevice];
+    if (s_spiBusDevice == s_spiDevice)
+        return 0;
+    uint64_t t0 = tim_Now();
+    if (s_spiTransport->select(s_spiDevice)) {
+        s_spiBusDevice = 0xff;
+        pthread_mutex_unlock(&s_spiBusLock);
+        return -1;
     }
-    return crc;
+    tim_Pack(s_spiDevice, TIMING_SELECT, t0);
+    s_spiBusDevice = s_spiDevice;
+    return 0;
+}
+
+static inline int BusRelease(int ret)
+{
+    pthread_mutex_unlock(&s_spiBusLock);
+    return ret;
+}
+
+// ---------------- Taktanpassung ----------------
+/*
+ * Jedes Pack hängt über einen eigenen Pfad am 74HC154/74HC244 Mux und
+ * verträgt einen anderen SPI-Takt. Die Taktstufen liegen 25 % auseinander,
+ * ausgehend vom Takt aus spi_Init(), der auch die Untergrenze ist.
+ */
+static inline uint32_t SpeedStepUp(uint32_t hz)
+{
+    return hz + hz / 4;
+}
+
+static inline uint32_t SpeedStepDown(uint32_t hz)
+{
+    hz -= hz / 5; // Umkehrung von SpeedStepUp
+    return hz < s_spiMinSpeedHz ? s_spiMinSpeedHz : hz;
+}
+
+static void SetSpeed(uint32_t hz)
+{
+    s_spiSpeedHz[s_spiDevice] = hz;
+    s_spiStats[s_spiDevice].speedHz = hz;
+    s_SpiTr.speed_hz = hz;
+    s_spiBackoffCalls[s_spiDevice] = 0;
+    s_spiBackoffErrors[s_spiDevice] = 0;
+}
+
+// Gehäufte CRC Fehler im Betrieb: eine Stufe langsamer
+static void SpeedBackoff(void)
+{
+    if (++s_spiBackoffErrors[s_spiDevice] >= SPI_BACKOFF_ERRORS && s_spiSpeedHz[s_spiDevice] > s_spiMinSpeedHz)
+        SetSpeed(SpeedStepDown(s_spiSpeedHz[s_spiDevice]));
+}
+
+static void SpeedAccount(void)
+{
+    if (++s_spiBackoffCalls[s_spiDevice] >= SPI_BACKOFF_WINDOW) {
+        s_spiBackoffCalls[s_spiDevice] = 0;
+        s_spiBackoffErrors[s_spiDevice] = 0;
+    }
+}
+
+// Längster Lesezugriff (32 Register), ohne Wiederholungen und Fehlerzählung
+static int CalibrateProbe(void)
+{
+    uint16_t data[32];
+
+    s_SpiTr.len = AFEFrameRead(s_spiTxBuf, 0x00, 32);
+    for (int i = 0; i < SPI_CALIB_PROBES; i++) {
+        if (s_spiTransport->transfer(&s_SpiTr, 1) < 0)
+            return -1; // SPI Fehler
+        if (AFEUnpackRead(s_spiTxBuf, s_spiRxBuf, data, 32))
+            return -3; // CRC Fehler
+    }
+    return 0;
+}
+
+/*
+ * Takt des aktuellen AFE einmessen: stufenweise bis maxSpeed erhöhen, bis
+ * eine Testlesung fehlschlägt. Übernommen wird eine Stufe unter dem höchsten
+ * fehlerfreien Takt. Liest schon der Mindesttakt nicht fehlerfrei, bleibt
+ * dieser eingestellt.
+ */
+int spi_Calibrate(uint32_t maxSpeed)
+{
+    uint32_t best = 0;
+
+    if (BusAcquire())
+        return -1; // SPI Fehler
+
+    for (uint32_t hz = s_spiMinSpeedHz; hz <= maxSpeed; hz = SpeedStepUp(hz)) {
+        s_SpiTr.speed_hz = hz;
+        if (CalibrateProbe())
+            break;
+        best = hz;
+    }
+
+    if (best == 0) {
+        SetSpeed(s_spiMinSpeedHz);
+        return BusRelease(-3); // CRC Fehler
+    }
+    SetSpeed(best > s_spiMinSpeedHz ? SpeedStepDown(best) : best);
+    return BusRelease(0);
+}
+
+// ---------------- Wiederholungen ----------------
+/*
+ * Fehlgeschlagene Transfers werden wiederholt, solange maxRetries nicht
+ * erreicht ist und ein weiterer Versuch voraussichtlich noch ins Zeitbudget
+ * des Aufrufs passt. So kann ein gestörtes Pack den Zyklus nicht auffressen.
+ */
+static inline uint32_t ElapsedUs(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000 + (now.tv_nsec - start->tv_nsec) / 1000;
+}
+
+static int RetryAllowed(int err, uint32_t attempt, const struct timespec *start)
+{
+    SPI_STATS_t *st = &s_spiStats[s_spiDevice];
+    if (err == -3) {
+        st->crcErrors++;
+        SpeedBackoff();
+    } else {
+        st->ioctlErrors++;
+    }
+
+    // Dauer eines Versuchs aus den bisherigen schätzen
+    uint32_t elapsed = ElapsedUs(start);
+    if (attempt >= s_spiMaxRetries || elapsed + elapsed / (attempt + 1) > s_spiRetryBudgetUs)
+        return 0;
+    st->retries++;
+    return 1;
+}
+
+static int AccountCall(int err, const struct timespec *start)
+{
+    SPI_STATS_t *st = &s_spiStats[s_spiDevice];
+    uint32_t us = ElapsedUs(start);
+    st->calls++;
+    SpeedAccount();
+    if (us > st->maxTransferUs)
+        st->maxTransferUs = us;
+    if (err) {
+        st->failedCalls++;
+        st->errorBurst++;
+    } else {
+        st->errorBurst = 0;
+    }
+    return err;
+}
+
+void spi_SetRetryPolicy(uint32_t maxRetries, uint32_t budgetUs)
+{
+    s_spiMaxRetries = maxRetries;
+    s_spiRetryBudgetUs = budgetUs;
+}
+
+const SPI_STATS_t* spi_GetStats(void)
+{
+    return &s_spiStats[s_spiDevice];
 }
 
 // ---------------- SPI Functions ----------------
-int spi_SelectDevice(uint_fast8_t spiDevice)
+void spi_SetTransport(const SPI_TRANSPORT_t *transport)
 {
-    enum gpiod_line_value values[s_gpioNrPins];
-    for (int i = 0; i < s_gpioNrPins; i++)
-        values[i] = (spiDevice >> i) & 1;
-    
-    return gpiod_line_request_set_values(s_gpioRequest, values);
+    s_spiTransport = transport;
 }
 
-//static const unsigned int s_gpioAddrPins[NUM_ADDR_PINS] = {24, 25, 26};
-//static const char *const s_gpioChipPath = "/dev/gpiochip1";
+int spi_SelectDevice(uint_fast8_t spiDevice)
+{
+    s_spiDevice = spiDevice & (SPI_MAX_DEVICES - 1);
+    return 0; // Mux wird beim nächsten Transfer umgeschaltet
+}
 
 int spi_Init(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits, const char *gpioDevice, const unsigned int *gpioPins, const unsigned int gpioNrPins)
 {
@@ -86,128 +341,218 @@ int spi_Init(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits,
     s_SpiTr.speed_hz = speed;
     s_SpiTr.bits_per_word = bits;
 
-    g_spiFd = open(spiDevice, O_RDWR);
-    if (g_spiFd < 0) 
-        return -1;
-    if (ioctl(g_spiFd, SPI_IOC_WR_MODE, &mode) < 0)
-        goto error;
-    if (ioctl(g_spiFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
-        goto error;
-    if (ioctl(g_spiFd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
-        goto error;
-
-    // GPIO Init
-    s_gpioNrPins = gpioNrPins;
-
-    struct gpiod_chip *chip;
-    chip = gpiod_chip_open(gpioDevice);
-	if (!chip)
-		goto error;
-
-    struct gpiod_line_settings *settings;
-    settings = gpiod_line_settings_new();
-	if (!settings)
-		goto error_chip;
-    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
-
-    struct gpiod_line_config *lconfig;
-    lconfig = gpiod_line_config_new();
-	if (!lconfig)
-		goto error_linesettings;
-    for (uint32_t i = 0; i < gpioNrPins; i++)
-		if (gpiod_line_config_add_line_settings(lconfig, &gpioPins[i], 1, settings))
-			goto error_lineconfig;
-
-    struct gpiod_request_config *rconfig = NULL;
-    rconfig = gpiod_request_config_new();
-    if (!rconfig)
-        goto error_lineconfig;
-    gpiod_request_config_set_consumer(rconfig, "bmsd");
-
-    s_gpioRequest = gpiod_chip_request_lines(chip, rconfig, lconfig);
-    if (!s_gpioRequest)
-        goto error_lineconfig;
-    
-    return 0;
-error_lineconfig:
-    gpiod_line_config_free(lconfig);
-error_linesettings:
-    gpiod_line_settings_free(settings);
-error_chip:
-	gpiod_chip_close(chip);
-error:
-    close(g_spiFd);
-    return -1;
+    s_spiBusDevice = 0xff;
+    s_spiMinSpeedHz = speed;
+    for (int i = 0; i < SPI_MAX_DEVICES; i++) {
+        s_spiSpeedHz[i] = speed;
+        s_spiStats[i].speedHz = speed;
+    }
+
+    return s_spiTransport->init(spiDevice, speed, mode, bits, gpioDevice, gpioPins, gpioNrPins);
 }
 
 int spi_AFEReadRegister(uint8_t addr, uint16_t* output, uint_fast8_t count) 
 {
-    if (count > 32) 
+    if (count == 0 || count > 32) 
         return -1; // Maximale Anzahl überschritten
 
-    size_t tx_len = 2 + (size_t)count * 2 + 1; // 2 Byte Kommando + count*2 Byte Daten + 1 Byte CRC
-    s_SpiTr.len = tx_len;
+    if (BusAcquire())
+        return -1; // SPI Fehler
 
-    // Header setzen
-    s_spiTxBuf[0] = (addr & 0x7F) << 1;
-    s_spiTxBuf[1] = ((count - 1) & 0x1F) | (addr & 0x80);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    s_SpiTr.len = AFEFrameRead(s_spiTxBuf, addr, count);
 
-    // SPI-Transfer durchführen
-    if (ioctl(g_spiFd, SPI_IOC_MESSAGE(1), &s_SpiTr) < 0)
+    for (uint32_t attempt = 0; ; attempt++) {
+        int err;
+        // SPI-Transfer durchführen
+        if (s_spiTransport->transfer(&s_SpiTr, 1) < 0)
+            err = -1; // SPI Fehler
+        else if (AFEUnpackRead(s_spiTxBuf, s_spiRxBuf, output, count))
+            err = -3; // CRC Fehler
+        else
+            break;
+
+        if (!RetryAllowed(err, attempt, &start))
+            return BusRelease(AccountCall(err, &start));
+    }
+
+    AFEShadowStoreBlock(addr, output, count);
+    return BusRelease(AccountCall(0, &start)); // Erfolg
+}
+
+int spi_AFEWriteRegister(uint8_t addr, uint16_t data) 
+{
+    if (AFEShadowMatch(addr, data))
+        return 0; // Register hat bereits den Wert
+
+    if (BusAcquire())
         return -1; // SPI Fehler
 
-        // Header für CRC prüfen
-    s_spiRxBuf[0] = s_spiTxBuf[0];
-    s_spiRxBuf[1] = s_spiTxBuf[1];
-    if (AFECrc8(s_spiRxBuf, tx_len))
-        return -3; // CRC Fehler
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    s_SpiTr.len = AFEFrameWrite(s_spiTxBuf, addr, data);
 
-    // Pointer-basiert Daten aus RX extrahieren (big-endian)
-    const uint8_t *p = &s_spiRxBuf[2];
-    for (uint_fast8_t i = 0; i < count; i++)
-    {
-        output[i] = ((uint16_t)p[0] << 8) | p[1];
-        p += 2;
+    // SPI-Transfer durchführen, Schreibzugriffe haben keine CRC-Rückmeldung
+    for (uint32_t attempt = 0; s_spiTransport->transfer(&s_SpiTr, 1) < 0; attempt++) {
+        if (!RetryAllowed(-1, attempt, &start)) {
+            AFEShadowDrop(addr);
+            return BusRelease(AccountCall(-1, &start)); // SPI Fehler
+        }
     }
 
-    return 0; // Erfolg
+    AFEShadowStore(addr, data);
+    return BusRelease(AccountCall(0, &start)); // Erfolg
 }
 
-int spi_AFEWriteRegister(uint8_t addr, uint16_t data) 
+// ---------------- SPI Transaktionen ----------------
+/*
+ * Sammelt Lese- und Schreibzugriffe auf das aktuell ausgewählte AFE und
+ * überträgt sie mit einem einzigen Transfer (ioctl). Jeder Frame bekommt einen
+ * eigenen CS-Puls (cs_change), CRC-Prüfung und Entpacken erfolgen nach dem Commit
+ * über den gesamten Batch. Ausgabepuffer der Lesezugriffe müssen bis zum
+ * Commit gültig bleiben.
+ */
+void spi_TransactionBegin(void)
 {
-    s_SpiTr.len = 4;
+    s_spiBatchFrames = 0;
+    s_spiBatchBytes = 0;
+    s_spiBatchError = 0;
+}
 
-    // Header setzen
-    s_spiTxBuf[0] = ((addr & 0x7F) << 1) | 1;
-    // Daten setzen
-    s_spiTxBuf[1] = data >> 8;
-    s_spiTxBuf[2] = data & 0xFF;
-    // CRC setzen
-    s_spiTxBuf[3] = AFECrc8(s_spiTxBuf, 3);
+static struct spi_ioc_transfer* TransactionAddFrame(size_t len)
+{
+    if (s_spiBatchFrames >= SPI_BATCH_MAX_FRAMES || s_spiBatchBytes + len > SPI_BATCH_MAX_BYTES) {
+        s_spiBatchError = -2; // Batch voll
+        return NULL;
+    }
 
-    // SPI-Transfer durchführen
-    if (ioctl(g_spiFd, SPI_IOC_MESSAGE(1), &s_SpiTr) < 0)
-        return -1; // SPI Fehler
+    struct spi_ioc_transfer *tr = &s_spiBatchTr[s_spiBatchFrames];
+    memset(tr, 0, sizeof(*tr));
+    tr->speed_hz = s_spiSpeedHz[s_spiDevice];
+    tr->bits_per_word = s_SpiTr.bits_per_word;
+    tr->tx_buf = (unsigned long)&s_spiBatchTxBuf[s_spiBatchBytes];
+    tr->rx_buf = (unsigned long)&s_spiBatchRxBuf[s_spiBatchBytes];
+    tr->len = len;
+    tr->cs_change = 1; // CS zwischen den Frames deaktivieren
+    return tr;
+}
 
-    return 0; // Erfolg
+int spi_TransactionRead(uint8_t addr, uint16_t* output, uint_fast8_t count)
+{
+    if (count == 0 || count > 32) {
+        s_spiBatchError = -1; // Maximale Anzahl überschritten
+        return -1;
+    }
+
+    size_t len = 2 + (size_t)count * 2 + 1;
+    if (!TransactionAddFrame(len))
+        return -2;
+
+    AFEFrameRead(&s_spiBatchTxBuf[s_spiBatchBytes], addr, count);
+    s_spiBatchFrame[s_spiBatchFrames].output = output;
+    s_spiBatchFrame[s_spiBatchFrames].addr = addr;
+    s_spiBatchFrame[s_spiBatchFrames].count = count;
+    s_spiBatchFrames++;
+    s_spiBatchBytes += len;
+    return 0;
 }
 
-void spi_Cleanup(void)
+int spi_TransactionWrite(uint8_t addr, uint16_t data)
 {
-    // GPIO-Ressourcen freigeben
-    if (s_gpioRequest)
-    {
-        gpiod_line_request_release(s_gpioRequest);
-        s_gpioRequest = NULL;
+    if (AFEShadowMatch(addr, data))
+        return 0; // Register hat bereits den Wert
+
+    if (!TransactionAddFrame(4))
+        return -2;
+
+    AFEFrameWrite(&s_spiBatchTxBuf[s_spiBatchBytes], addr, data);
+    s_spiBatchFrame[s_spiBatchFrames].output = NULL;
+    s_spiBatchFrame[s_spiBatchFrames].addr = addr;
+    s_spiBatchFrame[s_spiBatchFrames].count = 0;
+    s_spiBatchFrame[s_spiBatchFrames].data = data;
+    s_spiBatchFrames++;
+    s_spiBatchBytes += 4;
+    return 0;
+}
+
+int spi_TransactionCommit(void)
+{
+    int ret = s_spiBatchError;
+    uint_fast8_t frames = s_spiBatchFrames;
+    s_spiBatchFrames = 0;
+    s_spiBatchBytes = 0;
+    s_spiBatchError = 0;
+
+    if (ret)
+        return ret; // Batch wurde nicht vollständig aufgebaut
+    if (frames == 0)
+        return 0;
+    if (BusAcquire())
+        return -1; // SPI Fehler
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Letzter Frame: CS nach der Nachricht nicht aktiv lassen
+    s_spiBatchTr[frames - 1].cs_change = 0;
+
+    // SPI-Transfer durchführen, bei ioctl-Fehler den ganzen Batch wiederholen
+    for (uint32_t attempt = 0; s_spiTransport->transfer(s_spiBatchTr, frames) < 0; attempt++) {
+        if (!RetryAllowed(-1, attempt, &start)) {
+            for (uint_fast8_t i = 0; i < frames; i++)
+                if (!s_spiBatchFrame[i].output)
+                    AFEShadowDrop(s_spiBatchFrame[i].addr);
+            return BusRelease(AccountCall(-1, &start)); // SPI Fehler
+        }
     }
-    
-    // SPI-Filedescriptor schließen
-    if (g_spiFd >= 0)
-    {
-        close(g_spiFd);
-        g_spiFd = -1;
+
+    // Schreibzugriffe sind übertragen, Schatten nachführen
+    uint_fast8_t pending = 0;
+    for (uint_fast8_t i = 0; i < frames; i++) {
+        if (s_spiBatchFrame[i].output)
+            s_spiRetryIdx[pending++] = i;
+        else
+            AFEShadowStore(s_spiBatchFrame[i].addr, s_spiBatchFrame[i].data);
     }
-    
-    // Globale Variablen zurücksetzen
-    s_gpioNrPins = 0;
+
+    // CRC prüfen und Lesedaten entpacken, nur gestörte Lesezugriffe wiederholen
+    for (uint32_t attempt = 0; ; attempt++) {
+        uint_fast8_t failed = 0;
+        for (uint_fast8_t j = 0; j < pending; j++) {
+            uint_fast8_t i = s_spiRetryIdx[j];
+            const SPI_BATCH_FRAME_t *f = &s_spiBatchFrame[i];
+            if (AFEUnpackRead(
+                    (const uint8_t *)(uintptr_t)s_spiBatchTr[i].tx_buf,
+                    (uint8_t *)(uintptr_t)s_spiBatchTr[i].rx_buf,
+                    f->output,
+                    f->count)) {
+                s_spiRetryIdx[failed++] = i; // CRC Fehler, restliche Frames trotzdem entpacken
+                continue;
+            }
+            AFEShadowStoreBlock(f->addr, f->output, f->count);
+        }
+        pending = failed;
+        if (pending == 0)
+            break;
+        if (!RetryAllowed(-3, attempt, &start))
+            return BusRelease(AccountCall(-3, &start)); // CRC Fehler
+
+        for (uint_fast8_t j = 0; j < pending; j++) {
+            s_spiRetryTr[j] = s_spiBatchTr[s_spiRetryIdx[j]];
+            s_spiRetryTr[j].speed_hz = s_SpiTr.speed_hz; // evtl. zurückgeschaltet
+            s_spiRetryTr[j].cs_change = (j + 1 < pending);
+        }
+        while (s_spiTransport->transfer(s_spiRetryTr, pending) < 0)
+            if (!RetryAllowed(-1, ++attempt, &start))
+                return BusRelease(AccountCall(-1, &start)); // SPI Fehler
+    }
+
+    return BusRelease(AccountCall(0, &start)); // Erfolg
+}
+
+void spi_Cleanup(void)
+{
+    s_spiTransport->cleanup();
+    memset(s_afeShadowValid, 0, sizeof(s_afeShadowValid));
 }
\ No newline at end of file
@@ -1,12 +1,52 @@
 #ifndef SPI_H
 #define SPI_H
 
+#include <linux/spi/spidev.h>
+
+#define SPI_BATCH_MAX_FRAMES 64   // max. Frames pro SPI_IOC_MESSAGE(N)
+#define SPI_BATCH_MAX_BYTES 1024  // max. Bytes pro Batch (spidev bufsiz: 4096)
+#define SPI_MAX_DEVICES 16        // 74HC154: 4 Adressleitungen
+#define AFE_SHADOW_SIZE 0x80      // gespiegelter Registerbereich 0x00-0x7f
+
+// Fehlerzählung je AFE
+typedef struct {
+    uint32_t calls;           // Aufrufe (Einzelzugriff oder Transaktion)
+    uint32_t retries;         // Wiederholungen
+    uint32_t crcErrors;       // CRC Fehler der Antwort
+    uint32_t ioctlErrors;     // Transportfehler
+    uint32_t failedCalls;     // Aufrufe ohne Erfolg nach allen Wiederholungen
+    uint32_t errorBurst;      // aufeinanderfolgende fehlgeschlagene Aufrufe
+    uint32_t maxTransferUs;   // längster Aufruf inkl. Wiederholungen
+    uint32_t speedHz;         // aktueller SPI-Takt
+} SPI_STATS_t;
+
+// Transport-Backend (spidev/libgpiod oder Simulator)
+typedef struct {
+    int (*init)(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits, const char *gpioDevice, const unsigned int *gpioPins, const unsigned int gpioNrPins);
+    int (*select)(uint_fast8_t device);
+    int (*transfer)(struct spi_ioc_transfer *tr, unsigned int count); // <0 bei Fehler
+    void (*cleanup)(void);
+} SPI_TRANSPORT_t;
+
 extern int g_spiFd;
+extern const SPI_TRANSPORT_t g_spiTransportHw;
+extern const SPI_TRANSPORT_t g_spiTransportSim;
 
+void spi_SetTransport(const SPI_TRANSPORT_t *transport);
 int spi_SelectDevice(uint_fast8_t device);
 int spi_Init(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits, const char *gpioDevice, const unsigned int *gpioPins, const unsigned int gpioNrPins);
 int spi_AFEReadRegister(uint8_t addr, uint16_t* output, uint_fast8_t count);
 int spi_AFEWriteRegister(uint8_t addr, uint16_t data);
+void spi_TransactionBegin(void);
+int spi_TransactionRead(uint8_t addr, uint16_t* output, uint_fast8_t count);
+int spi_TransactionWrite(uint8_t addr, uint16_t data);
+int spi_TransactionCommit(void);
+void spi_ShadowInvalidate(void);
+void spi_SetRetryPolicy(uint32_t maxRetries, uint32_t budgetUs);
+const SPI_STATS_t* spi_GetStats(void);
+int spi_Calibrate(uint32_t maxSpeed);
 void spi_Cleanup(void);
 
+void spisim_SetTimeScale(float scale);
+
 #endif
\ No newline at end of file
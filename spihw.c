@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/spi/spidev.h>
+#include <sys/ioctl.h>
+#include <gpiod.h>
+
+#include "spi.h"
+
+// ---------------- Globals ----------------
+int g_spiFd = -1;                        // globales SPI-Filedescriptor
+
+static unsigned int s_gpioNrPins;
+static struct gpiod_line_request *s_gpioRequest;
+
+// ---------------- Transport spidev + libgpiod ----------------
+static int HwSelectDevice(uint_fast8_t spiDevice)
+{
+    enum gpiod_line_value values[s_gpioNrPins];
+    for (int i = 0; i < s_gpioNrPins; i++)
+        values[i] = (spiDevice >> i) & 1;
+    
+    return gpiod_line_request_set_values(s_gpioRequest, values);
+}
+
+//static const unsigned int s_gpioAddrPins[NUM_ADDR_PINS] = {24, 25, 26};
+//static const char *const s_gpioChipPath = "/dev/gpiochip1";
+
+static int HwInit(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits, const char *gpioDevice, const unsigned int *gpioPins, const unsigned int gpioNrPins)
+{
+    // SPI Init
+    g_spiFd = open(spiDevice, O_RDWR);
+    if (g_spiFd < 0) 
+        return -1;
+    if (ioctl(g_spiFd, SPI_IOC_WR_MODE, &mode) < 0)
+        goto error;
+    if (ioctl(g_spiFd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+        goto error;
+    if (ioctl(g_spiFd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
+        goto error;
+
+    // GPIO Init
+    s_gpioNrPins = gpioNrPins;
+
+    struct gpiod_chip *chip;
+    chip = gpiod_chip_open(gpioDevice);
+	if (!chip)
+		goto error;
+
+    struct gpiod_line_settings *settings;
+    settings = gpiod_line_settings_new();
+	if (!settings)
+		goto error_chip;
+    gpiod_line_settings_set_direction(settings, GPIOD_LINE_DIRECTION_OUTPUT);
+
+    struct gpiod_line_config *lconfig;
+    lconfig = gpiod_line_config_new();
+	if (!lconfig)
+		goto error_linesettings;
+    for (uint32_t i = 0; i < gpioNrPins; i++)
+		if (gpiod_line_config_add_line_settings(lconfig, &gpioPins[i], 1, settings))
+			goto error_lineconfig;
+
+    struct gpiod_request_config *rconfig = NULL;
+    rconfig = gpiod_request_config_new();
+    if (!rconfig)
+        goto error_lineconfig;
+    gpiod_request_config_set_consumer(rconfig, "bmsd");
+
+    s_gpioRequest = gpiod_chip_request_lines(chip, rconfig, lconfig);
+    if (!s_gpioRequest)
+        goto error_lineconfig;
+    
+    return 0;
+error_lineconfig:
+    gpiod_line_config_free(lconfig);
+error_linesettings:
+    gpiod_line_settings_free(settings);
+error_chip:
+	gpiod_chip_close(chip);
+error:
+    close(g_spiFd);
+    return -1;
+}
+
+static int HwTransfer(struct spi_ioc_transfer *tr, unsigned int count)
+{
+    return ioctl(g_spiFd, SPI_IOC_MESSAGE(count), tr);
+}
+
+static void HwCleanup(void)
+{
+    // GPIO-Ressourcen freigeben
+    if (s_gpioRequest)
+    {
+        gpiod_line_request_release(s_gpioRequest);
+        s_gpioRequest = NULL;
+    }
+    
+    // SPI-Filedescriptor schließen
+    if (g_spiFd >= 0)
+    {
+        close(g_spiFd);
+        g_spiFd = -1;
+    }
+    
+    // Globale Variablen zurücksetzen
+    s_gpioNrPins = 0;
+}
+
+const SPI_TRANSPORT_t g_spiTransportHw = {
+    .init = HwInit,
+    .select = HwSelectDevice,
+    .transfer = HwTransfer,
+    .cleanup = HwCleanup,
+};
\ No newline at end of file
@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <linux/spi/spidev.h>
+
+#include "spi.h"
+
+/*
+ * Softwaremodell des PB7170 als SPI-Transport. Bildet Registersatz,
+ * CRC8-Framing, USER-Lock (0x45), Diagnose-Pullup/-Pulldown (0x50-0x52)
+ * sowie Zell-, NTC- und Stromverläufe aus einer Szenariodatei nach.
+ *
+ * Szenariodatei, eine Anweisung pro Zeile, '#' leitet Kommentare ein:
+ *   packs <n>                          Anzahl vorhandener AFEs
+ *   pack <n|*> cell <wave>             Zellspannung [V]
+ *   pack <n|*> celloffset <zelle> <V>  Offset einer Zelle (1..16)
+ *   pack <n|*> current <wave>          CADC Rohwert (int16)
+ *   pack <n|*> fastcurrent <wave>      VADC Rohwert (mit Vorzeichen)
+ *   pack <n|*> ntc <wave>              NTC Rohwert (alle 4 Kanäle)
+ *   pack <n|*> die <wave>              Chiptemperatur [°C]
+ *   pack <n|*> wirebreak <zelle>       Kabelbruch an Zelle (1..16)
+ *   pack <n|*> crcerror <rate>         Anteil gestörter Frames (0..1)
+ *   pack <n|*> maxspeed <hz>           schnellerer SPI-Takt stört jeden Frame
+ * <wave> = const <v> | sine|square|ramp <offset> <amplitude> <periode_s>
+ */
+
+#define SIM_REGS 0x100
+#define SIM_CELLS 16
+#define SIM_DIAG_SHIFT 0.002f      // Zellverschiebung bei Diagnose, intakt [V]
+#define SIM_DIAG_SHIFT_BROKEN 0.5f // Zellverschiebung bei Kabelbruch [V]
+
+typedef enum {
+    SIM_WAVE_CONST = 0,
+    SIM_WAVE_SINE,
+    SIM_WAVE_SQUARE,
+    SIM_WAVE_RAMP,
+} ESimWave_t;
+
+typedef struct {
+    ESimWave_t type;
+    float offset;
+    float amplitude;
+    float period;
+} SIM_WAVE_t;
+
+typedef struct {
+    uint16_t reg[SIM_REGS];
+    SIM_WAVE_t cell;
+    SIM_WAVE_t current;
+    SIM_WAVE_t fastCurrent;
+    SIM_WAVE_t ntc;
+    SIM_WAVE_t die;
+    float cellOffset[SIM_CELLS];
+    uint32_t wireBreak;
+    float crcErrorRate;
+    uint32_t maxSpeed;
+    double balancerEnd;
+} SIM_AFE_t;
+
+static SIM_AFE_t s_simAfe[SPI_MAX_DEVICES];
+static uint_fast8_t s_simDevice;
+static uint_fast8_t s_simDevices = SPI_MAX_DEVICES;
+static struct timespec s_simStart;
+static float s_simTimeScale = 1.0f;
+
+// ---------------- Hilfsfunktionen ----------------
+static uint8_t SimCrc8(const uint8_t *p, size_t len)
+{
+    uint8_t crc = 0x00;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+static double SimTime(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double t = (now.tv_sec - s_simStart.tv_sec) + (now.tv_nsec - s_simStart.tv_nsec) * 1e-9;
+    return t * s_simTimeScale;
+}
+
+static float SimWave(const SIM_WAVE_t *w, double t)
+{
+    if (w->type == SIM_WAVE_CONST || w->period <= 0)
+        return w->offset;
+    double phase = fmod(t / w->period, 1.0);
+    switch (w->type) {
+        case SIM_WAVE_SINE:
+            return w->offset + w->amplitude * (float)sin(2 * M_PI * phase);
+        case SIM_WAVE_SQUARE:
+            return w->offset + (phase < 0.5 ? w->amplitude : -w->amplitude);
+        case SIM_WAVE_RAMP:
+            return w->offset + w->amplitude * (float)(2 * phase - 1);
+        default:
+            return w->offset;
+    }
+}
+
+static uint16_t SimClamp(float code)
+{
+    if (code < 0)
+        return 0;
+    if (code > 0xffff)
+        return 0xffff;
+    return (uint16_t)lrintf(code);
+}
+
+// ---------------- Registermodell ----------------
+static void SimPowerUp(SIM_AFE_t *afe)
+{
+    memset(afe->reg, 0, sizeof(afe->reg));
+    afe->reg[0x00] = 0x6000; // TOP_STATUS: Power-up complete
+    afe->reg[0x05] = 0x4000; // ALRT_STAT0: RESET
+    afe->balancerEnd = 0;
+}
+
+static void SimDefaults(SIM_AFE_t *afe)
+{
+    memset(afe, 0, sizeof(*afe));
+    afe->cell.offset = 3.3f;
+    afe->ntc.offset = 24500;  // ~26 °C mit Standard-NTC-Polynom
+    afe->die.offset = 25.0f;
+    SimPowerUp(afe);
+}
+
+static void SimMeasure(SIM_AFE_t *afe, double t)
+{
+    float sum = 0;
+    float base = SimWave(&afe->cell, t);
+    uint8_t diag = afe->reg[0x43] == 0xa8;
+
+    for (int i = 0; i < SIM_CELLS; i++) {
+        float v = base + afe->cellOffset[i];
+        float shift = (afe->wireBreak & (1 << i)) ? SIM_DIAG_SHIFT_BROKEN : SIM_DIAG_SHIFT;
+        sum += v;
+        if (diag && (afe->reg[0x52] & 0x4) && (afe->reg[0x50] & (1 << i)))
+            v += shift;
+        if (diag && (afe->reg[0x52] & 0x1) && (afe->reg[0x51] & (1 << i)))
+            v -= shift;
+        afe->reg[0x87 + i] = SimClamp(v / 100e-6f);
+    }
+
+    afe->reg[0x84] = (uint16_t)(int16_t)lrintf(SimWave(&afe->current, t));
+    afe->reg[0x85] = SimClamp(sum / 1.6e-3f);
+    afe->reg[0x86] = SimClamp(sum / 2.5e-3f);
+    for (int i = 0; i < 4; i++)
+        afe->reg[0x98 + i] = SimClamp(SimWave(&afe->ntc, t));
+    afe->reg[0x9e] = SimClamp(25437 - (SimWave(&afe->die, t) + 64.5f) * 59.17f);
+
+    float fast = SimWave(&afe->fastCurrent, t);
+    afe->reg[0x9f] = SimClamp(fabsf(fast)) & 0x7fff;
+    if (fast < 0)
+        afe->reg[0x9f] |= 0x8000;
+
+    // Balancer-Timer BLSW_CMD zählt in 0,25s Schritten ab
+    double remaining = afe->balancerEnd - t;
+    afe->reg[0x0f] = remaining > 0 ? (uint16_t)ceil(remaining / 0.25) : 0;
+    afe->reg[0x10] = afe->reg[0x0f] ? afe->reg[0x0c] : 0;
+}
+
+static void SimWrite(SIM_AFE_t *afe, uint8_t addr, uint16_t data, double t)
+{
+    switch (addr) {
+        case 0x02:
+        case 0x03:
+        case 0x05:
+        case 0x06:
+            afe->reg[addr] &= ~data; // Flags: write 1 to clear
+            return;
+        case 0x0f:
+            afe->balancerEnd = t + data * 0.25;
+            break;
+        default:
+            if (addr >= 0x14 && addr <= 0x3d && afe->reg[0x45] != 0x95)
+                return; // USER gesperrt
+            if (addr >= 0x50 && addr <= 0x52 && afe->reg[0x43] != 0xa8)
+                return; // Diagnose gesperrt
+            break;
+    }
+    afe->reg[addr] = data;
+}
+
+static void SimCrcError(SIM_AFE_t *afe)
+{
+    afe->reg[0x03] |= 0x0001; // ALRT_FLG1: SPI_CRC_ERR
+    afe->reg[0x06] |= 0x0080; // ALRT_STAT1: SPI_CRC_ERR
+}
+
+static int SimFrame(SIM_AFE_t *afe, const uint8_t *tx, uint8_t *rx, size_t len, uint32_t speed, double t)
+{
+    uint8_t disturbed = (afe->crcErrorRate > 0 && (float)rand() / RAND_MAX < afe->crcErrorRate) ||
+        (afe->maxSpeed && speed > afe->maxSpeed);
+
+    if (tx[0] & 1) {
+        // Schreibkommando
+        if (len != 4)
+            return -1;
+        memset(rx, 0, len);
+        if (disturbed || SimCrc8(tx, 4)) {
+            SimCrcError(afe);
+            return 0;
+        }
+        SimWrite(afe, tx[0] >> 1, ((uint16_t)tx[1] << 8) | tx[2], t);
+        return 0;
+    }
+
+    // Lesekommando
+    uint8_t addr = (tx[0] >> 1) | (tx[1] & 0x80);
+    uint_fast8_t count = (tx[1] & 0x1f) + 1;
+    if (len != 2 + (size_t)count * 2 + 1)
+        return -1;
+
+    SimMeasure(afe, t);
+    rx[0] = tx[0];
+    rx[1] = tx[1];
+    for (uint_fast8_t i = 0; i < count; i++) {
+        uint16_t v = afe->reg[(uint8_t)(addr + i)];
+        rx[2 + 2 * i] = v >> 8;
+        rx[3 + 2 * i] = v & 0xff;
+    }
+    rx[len - 1] = SimCrc8(rx, len - 1);
+    if (disturbed)
+        rx[2] ^= 0x10;
+    return 0;
+}
+
+// ---------------- Szenario ----------------
+static int SimParseWave(const char *s, SIM_WAVE_t *w)
+{
+    char type[16];
+    float a = 0, b = 0, c = 0;
+    int n = sscanf(s, "%15s %f %f %f", type, &a, &b, &c);
+
+    if (n == 2 && strcmp(type, "const") == 0) {
+        w->type = SIM_WAVE_CONST;
+        w->offset = a;
+        return 0;
+    }
+    if (n != 4)
+        return -1;
+    if (strcmp(type, "sine") == 0)
+        w->type = SIM_WAVE_SINE;
+    else if (strcmp(type, "square") == 0)
+        w->type = SIM_WAVE_SQUARE;
+    else if (strcmp(type, "ramp") == 0)
+        w->type = SIM_WAVE_RAMP;
+    else
+        return -1;
+    w->offset = a;
+    w->amplitude = b;
+    w->period = c;
+    return 0;
+}
+
+static int SimApply(SIM_AFE_t *afe, const char *key, const char *args)
+{
+    int cell;
+    float value;
+
+    if (strcmp(key, "cell") == 0)
+        return SimParseWave(args, &afe->cell);
+    if (strcmp(key, "current") == 0)
+        return SimParseWave(args, &afe->current);
+    if (strcmp(key, "fastcurrent") == 0)
+        return SimParseWave(args, &afe->fastCurrent);
+    if (strcmp(key, "ntc") == 0)
+        return SimParseWave(args, &afe->ntc);
+    if (strcmp(key, "die") == 0)
+        return SimParseWave(args, &afe->die);
+    if (strcmp(key, "celloffset") == 0) {
+        if (sscanf(args, "%d %f", &cell, &value) != 2 || cell < 1 || cell > SIM_CELLS)
+            return -1;
+        afe->cellOffset[cell - 1] = value;
+        return 0;
+    }
+    if (strcmp(key, "wirebreak") == 0) {
+        if (sscanf(args, "%d", &cell) != 1 || cell < 1 || cell > SIM_CELLS)
+            return -1;
+        afe->wireBreak |= 1 << (cell - 1);
+        return 0;
+    }
+    if (strcmp(key, "crcerror") == 0)
+        return sscanf(args, "%f", &afe->crcErrorRate) == 1 ? 0 : -1;
+    if (strcmp(key, "maxspeed") == 0)
+        return sscanf(args, "%u", &afe->maxSpeed) == 1 ? 0 : -1;
+    return -1;
+}
+
+static int SimLoadScenario(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    if (!f)
+        return -1;
+
+    char line[256];
+    int lineNr = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineNr++;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char pack[8], key[16];
+        int pos = 0;
+        unsigned int n;
+        if (sscanf(line, " %7s", pack) != 1)
+            continue; // Leerzeile
+
+        if (strcmp(pack, "packs") == 0) {
+            if (sscanf(line, " packs %u", &n) != 1 || n == 0 || n > SPI_MAX_DEVICES)
+                goto error;
+            s_simDevices = n;
+            continue;
+        }
+        if (sscanf(line, " pack %7s %15s %n", pack, key, &pos) != 2 || pos == 0)
+            goto error;
+
+        for (n = 0; n < SPI_MAX_DEVICES; n++) {
+            if (strcmp(pack, "*") != 0 && (unsigned int)atoi(pack) != n)
+                continue;
+            if (SimApply(&s_simAfe[n], key, line + pos))
+                goto error;
+        }
+    }
+    fclose(f);
+    return 0;
+error:
+    fprintf(stderr, "%s:%d: ungültige Anweisung\n", filename, lineNr);
+    fclose(f);
+    return -1;
+}
+
+// ---------------- Transport ----------------
+static int SimInit(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits, const char *gpioDevice, const unsigned int *gpioPins, const unsigned int gpioNrPins)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s_simStart);
+    s_simDevices = SPI_MAX_DEVICES;
+    for (int i = 0; i < SPI_MAX_DEVICES; i++)
+        SimDefaults(&s_simAfe[i]);
+    return SimLoadScenario(spiDevice);
+}
+
+static int SimSelectDevice(uint_fast8_t device)
+{
+    s_simDevice = device;
+    return 0;
+}
+
+static int SimTransfer(struct spi_ioc_transfer *tr, unsigned int count)
+{
+    double t = SimTime();
+
+    for (unsigned int i = 0; i < count; i++) {
+        const uint8_t *tx = (const uint8_t *)(uintptr_t)tr[i].tx_buf;
+        uint8_t *rx = (uint8_t *)(uintptr_t)tr[i].rx_buf;
+
+        if (s_simDevice >= s_simDevices) {
+            memset(rx, 0xff, tr[i].len); // kein AFE am Bus
+            continue;
+        }
+        if (SimFrame(&s_simAfe[s_simDevice], tx, rx, tr[i].len, tr[i].speed_hz, t))
+            return -1;
+    }
+    return 0;
+}
+
+static void SimCleanup(void)
+{
+    s_simDevice = 0;
+}
+
+void spisim_SetTimeScale(float scale)
+{
+    if (scale > 0)
+        s_simTimeScale = scale;
+}
+
+const SPI_TRANSPORT_t g_spiTransportSim = {
+    .init = SimInit,
+    .select = SimSelectDevice,
+    .transfer = SimTransfer,
+    .cleanup = SimCleanup,
+};
\ No newline at end of file
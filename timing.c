@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <time.h>
+#include <syslog.h>
+
+#include "dataobjects.h"
+#include "timing.h"
+
+/*
+ * Laufzeitmessung der Zyklusphasen in /battery_timing_shm: min/max/Summe
+ * und log2-Histogramm in ns. Jeder Eintrag hat genau einen Schreiber
+ * (Steuer- oder I/O-Thread, je Pack nie beide gleichzeitig), daher ohne
+ * Sperren. Leser können einen halb aktualisierten Eintrag sehen.
+ */
+_Static_assert(TIMING_GLOBAL_COUNT == TIMING_GLOBAL_PHASES, "TIMING_GLOBAL_PHASES anpassen");
+_Static_assert(TIMING_PACK_COUNT == TIMING_PACK_PHASES, "TIMING_PACK_PHASES anpassen");
+
+static void Record(TIMING_PHASE_t *p, uint64_t start)
+{
+    uint64_t d = tim_Now() - start;
+    uint32_t ns = d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+
+    p->sumNs += ns;
+    if (p->count++ == 0 || ns < p->minNs)
+        p->minNs = ns;
+    if (ns > p->maxNs)
+        p->maxNs = ns;
+    p->hist[ns ? 31 - __builtin_clz(ns) : 0]++;
+}
+
+void tim_Init(uint32_t tickNs)
+{
+    if (!g_TimingData)
+        return;
+    g_TimingData->numberOfPacks = g_GlobalConfig.numberOfPacks;
+    g_TimingData->globalPhases = TIMING_GLOBAL_PHASES;
+    g_TimingData->packPhases = TIMING_PACK_PHASES;
+    g_TimingData->buckets = TIMING_BUCKETS;
+    g_TimingData->tickNs = tickNs;
+}
+
+void tim_Tick(uint64_t timerExpirations)
+{
+    if (!g_TimingData)
+        return;
+    g_TimingData->ticks++;
+    if (timerExpirations > 1) {
+        g_TimingData->overruns++;
+        g_TimingData->missedTicks += timerExpirations - 1;
+    }
+}
+
+void tim_Global(ETimingGlobalPhase_t phase, uint64_t start)
+{
+    if (g_TimingData)
+        Record(&g_TimingPhase[phase], start);
+}
+
+void tim_Pack(uint32_t id, ETimingPackPhase_t phase, uint64_t start)
+{
+    if (g_TimingData && id < g_TimingData->numberOfPacks)
+        Record(&g_TimingPhase[TIMING_GLOBAL_PHASES + id * TIMING_PACK_PHASES + phase], start);
+}
+
+// Erreichte Weckgenauigkeit ins Log, z.B. beim Herunterfahren
+void tim_Report(void)
+{
+    if (!g_TimingData)
+        return;
+    const TIMING_PHASE_t *p = &g_TimingPhase[TIMING_WAKEUP];
+    syslog(LOG_INFO, "Weckverzögerung: min %u us, Mittel %u us, max %u us, %u Überläufe (%u Ticks verpasst) in %u Ticks",
+           p->minNs / 1000, p->count ? (uint32_t)(p->sumNs / p->count / 1000) : 0, p->maxNs / 1000,
+           g_TimingData->overruns, g_TimingData->missedTicks, g_TimingData->ticks);
+}
\ No newline at end of file
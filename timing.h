@@ -0,0 +1,41 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Reihenfolge = Index in /battery_timing_shm, siehe TIMING_GLOBAL_t
+typedef enum {
+    TIMING_LOOP = 0,         // alle Packs eines Ticks
+    TIMING_PERIOD,           // Abstand zweier Timer-Weckzeitpunkte (Jitter)
+    TIMING_IOWAIT,           // Warten auf den I/O-Thread
+    TIMING_WAKEUP,           // Weckverzögerung gegenüber der Deadline
+    TIMING_GLOBAL_COUNT
+} ETimingGlobalPhase_t;
+
+typedef enum {
+    TIMING_SELECT = 0,       // Mux umschalten
+    TIMING_BURST,            // Messdaten-Burst (SPI)
+    TIMING_CONVERT,          // Rohwerte umrechnen
+    TIMING_LIMITS,           // CalculateParametersAndLimits
+    TIMING_ERROR,            // ErrorHandler
+    TIMING_MOS,              // MosControl inkl. Schreibzugriff
+    TIMING_BALANCER,         // Balancer planen und schreiben
+    TIMING_TASK,             // bms_CyclicTask gesamt
+    TIMING_PACK_COUNT
+} ETimingPackPhase_t;
+
+static inline uint64_t tim_Now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000u + t.tv_nsec;
+}
+
+void tim_Init(uint32_t tickNs);
+void tim_Tick(uint64_t timerExpirations);
+void tim_Global(ETimingGlobalPhase_t phase, uint64_t start);
+void tim_Pack(uint32_t id, ETimingPackPhase_t phase, uint64_t start);
+void tim_Report(void);
+
+#endif
\ No newline at end of file
@@ -3,9 +3,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <float.h>
+#include <string.h>
 
 #include "bms.h"
 #include "dataobjects.h"
+#include "spi.h"
+#include "timing.h"
+#include "event.h"
 
 GLOBAL_PDO_t GlobalPdoData;
 PACK_PDO_t PackPdoData[MAX_BATTERY_PACKS];
@@ -14,15 +18,7 @@ PACK_USERCONF_t PackUserConfig[MAX_BATTERY_PACKS];
 PACK_GENERALCONF_t PackGeneralConfig[MAX_BATTERY_PACKS];
 PACK_CALIBRATION_t PackCalibration[MAX_BATTERY_PACKS];
 
-GLOBAL_CONF_t g_GlobalConfig;
-GLOBAL_PDO_t* g_GlobalPdoData = NULL;
-PACK_PDO_t* g_PackPdoData = NULL;
-PACK_SDO_t* g_PackSdoData = NULL;
-PACK_USERCONF_t* g_PackUserConfig[MAX_BATTERY_PACKS];
-PACK_GENERALCONF_t* g_PackGeneralConfig[MAX_BATTERY_PACKS];
-PACK_CALIBRATION_t* g_PackCalibration[MAX_BATTERY_PACKS];
-
-uint16_t SpiReg[0xff];
+uint16_t SpiReg[0x100];
 
 int spi_SelectDevice(uint_fast8_t device) {
     return 0;
@@ -31,15 +27,46 @@ int spi_Init(const char *spiDevice, uint32_t speed, uint8_t mode, uint8_t bits,
     return 0;
 };
 int spi_AFEReadRegister(uint8_t addr, uint16_t* output, uint_fast8_t count) {
-    *output = SpiReg[addr];
+    for (uint_fast8_t i = 0; i < count; i++)
+        output[i] = SpiReg[(uint8_t)(addr + i)];
     return 0;
 };
 int spi_AFEWriteRegister(uint8_t addr, uint16_t data) {
     SpiReg[addr] = data;
     return 0;
 };
+void spi_TransactionBegin(void) {
+};
+int spi_TransactionRead(uint8_t addr, uint16_t* output, uint_fast8_t count) {
+    return spi_AFEReadRegister(addr, output, count);
+};
+int spi_TransactionWrite(uint8_t addr, uint16_t data) {
+    return spi_AFEWriteRegister(addr, data);
+};
+int spi_TransactionCommit(void) {
+    return 0;
+};
+uint32_t ShadowInvalidations;
+void spi_ShadowInvalidate(void) {
+    ShadowInvalidations++;
+};
+void spi_SetRetryPolicy(uint32_t maxRetries, uint32_t budgetUs) {
+};
+int spi_Calibrate(uint32_t maxSpeed) {
+    return 0;
+};
+void tim_Pack(uint32_t id, ETimingPackPhase_t phase, uint64_t start) {
+};
+SPI_STATS_t SpiStats;
+const SPI_STATS_t* spi_GetStats(void) {
+    return &SpiStats;
+};
+int evt_Post(EEvent_t code, uint8_t pack, uint8_t state, uint32_t alert, uint32_t arg) {
+    return 0;
+};
 
 
+#include "dataobjects.c"        // Globals, Kommandoqueue
 #include "bms.c"
 
 int main() {
@@ -194,6 +221,9 @@ printf("CalculateParametersAndLimits\n");
             errors++; \
         }
     g_GlobalConfig.prechargeDeltaVoltage = 1.0f;
+    g_GlobalConfig.numberOfPacks = 2;
+    g_packEnabled = 0x3;
+    PackPdoData[1].mosfetStatus_bits.CHARGE = 1;                // Pack 2 am Bus, Busspannung gültig
     printf(" * Alles Aus, kein Fehler\n");
     /*           ChaEn  DisEn  swAlert  moCha moDis moPre  voltage  globvoltage  mos_tim*/
     TESTCASE( 1, 0,     0,     0,       0,    0,    0,       40.0f,       0.0f,  0)
@@ -259,9 +289,264 @@ printf("CalculateParametersAndLimits\n");
     TESTCASE( 8, 0,     1,     2,       0,    1,    0,       40.0f,       40.0f,  0)
     TESTCASE( 9, 1,     0,     2,       1,    0,    0,       40.0f,       40.0f,  2)
     TESTCASE(10, 1,     1,     2,       1,    1,    0,       40.0f,       40.0f,  2)
+#undef TESTCASE
+    printf(" * mosfetStatus folgt MOS_TRIG ohne Vorgabe\n");
+#define TESTCASE(nr, set1, expect1, expect2) \
+        g_GlobalPdoData->voltage = set1; \
+        MosControl(id); \
+        if( (SpiReg[0x13] != expect1) || (PACK_PDO.mosfetStatus != expect2) ) { \
+            printf("   TC%02u FAIL: global.voltage=%f\n",nr,set1); \
+            printf("              MOS_TRIG=%u (expect %u)\n",SpiReg[0x13],expect1); \
+            printf("              mosfetStatus=%u (expect %u)\n",PACK_PDO.mosfetStatus,expect2); \
+            errors++; \
+        }
+    PACK_SDO.ChargeEnable = 1;
+    PACK_SDO.DischargeEnable = 1;
+    g_PackPdoData[id].swAlertFlags = 0;
+    PACK_PDO.mosfetStatus = 0;
+    PACK_PDO.voltage = 40.0f;
+    /*           globvoltage  mos_tim  mosfetStatus (PRECHARGE=1 CHARGE=2 DISCHARGE=4) */
+    TESTCASE( 1, 0.0f,        4,       1)
+    TESTCASE( 2, 0.0f,        4,       1)   // Busspannung passt nicht, bleibt in Vorladung
+    TESTCASE( 3, 39.5f,       7,       7)
+    TESTCASE( 4, 39.5f,       3,       6)
+    PACK_SDO.ChargeEnable = 0;
+    TESTCASE( 5, 39.5f,       1,       4)
+    printf(" * Erstes Pack, kein Pack am Bus: schließt nach PRECHARGE_TIME_MS\n");
+    PACK_SDO.ChargeEnable = 1;
+    PackPdoData[1].mosfetStatus = 0;
+    PACK_PDO.mosfetStatus = 0;
+    for (uint32_t t = 1; t <= TICKS(PRECHARGE_TIME_MS); t++) {
+        TESTCASE(t, 0.0f,        4,       1)
+    }
+    TESTCASE(TICKS(PRECHARGE_TIME_MS) + 1, 0.0f, 7, 7)
+    TESTCASE(TICKS(PRECHARGE_TIME_MS) + 2, 0.0f, 3, 6)
+    g_GlobalConfig.numberOfPacks = 0;
+    g_packEnabled = 0;
+
+
+#undef TESTCASE
+/*********************************************************************************************/
+printf("bms_Command\n");
+    uint32_t status;
+    g_GlobalConfig.numberOfPacks = 2;
+    g_packEnabled = 0x1; // Pack 2 deaktiviert
+    PackPdoData[0].id = 1;
+    PackPdoData[1].id = 2;
+
+#define TESTCASE(nr, cmd, pack, arg, expectStatus, expectCharge, expectClear, expectReset) \
+        memset(PackSdoData, 0, sizeof(PackSdoData)); \
+        status = bms_Command(cmd, pack, arg); \
+        if( (status != expectStatus) || (PackSdoData[0].ChargeEnable != expectCharge) || \
+            (PackSdoData[0].swAlertFlagsClear != expectClear) || (PackSdoData[0].ResetStateMachine != expectReset) || \
+            PackSdoData[1].ChargeEnable || PackSdoData[1].swAlertFlagsClear || PackSdoData[1].ResetStateMachine ) { \
+            printf("   TC%02u FAIL: cmd=%u pack=%u arg=%u\n              status=%u (expect %u)\n",nr, cmd, pack, arg, status, expectStatus); \
+            errors++; \
+        }
+
+    //       nr  cmd                       pack  arg    status                  charge  clear        reset
+    TESTCASE( 1, SDO_CMD_CHARGE_ENABLE,    1,    1,     SDO_STATUS_DONE,        1,      0,           0)
+    TESTCASE( 2, SDO_CMD_CHARGE_ENABLE,    0,    5,     SDO_STATUS_DONE,        1,      0,           0)
+    TESTCASE( 3, SDO_CMD_CHARGE_ENABLE,    2,    1,     SDO_STATUS_BAD_PACK,    0,      0,           0)
+    TESTCASE( 4, SDO_CMD_CHARGE_ENABLE,    3,    1,     SDO_STATUS_BAD_PACK,    0,      0,           0)
+    TESTCASE( 5, SDO_CMD_CLEAR_ALERTS,     1,    0x20,  SDO_STATUS_DONE,        0,      0x20,        0)
+    TESTCASE( 6, SDO_CMD_CLEAR_ALERTS,     0,    0,     SDO_STATUS_DONE,        0,      UINT32_MAX,  0)
+    TESTCASE( 7, SDO_CMD_RESET,            1,    0,     SDO_STATUS_DONE,        0,      0,           1)
+    TESTCASE( 8, SDO_CMD_NONE,             1,    0,     SDO_STATUS_BAD_COMMAND, 0,      0,           0)
+    TESTCASE( 9, SDO_CMD_COUNT,            0,    0,     SDO_STATUS_BAD_COMMAND, 0,      0,           0)
+
+#undef TESTCASE
+/*********************************************************************************************/
+printf("dob_Command (Queue)\n");
+    // Queue der Tiefe 4 auf dem Heap, bmsd-Seite (Pop/Ack) arbeitet auf g_SdoQueue
+    enum { Q_PUSH, Q_POP, Q_ACK, Q_STATUS };
+    SDO_QUEUE_t *queue = malloc(sizeof(SDO_QUEUE_t) + (sizeof(SDO_CMD_t) + sizeof(SDO_ACK_t)) * SDO_QUEUE_DEPTH);
+    SDO_QUEUE_t *savedQueue = g_SdoQueue;
+    SDO_CMD_t queueCmd;
+    uint32_t queueId;
+    int queueRet;
+    g_SdoQueue = queue;
+    dob_CommandQueueInit(queue, 4);
+
+    // set2 bei Q_PUSH: Argument des Kommandos, Q_POP: erwartetes Argument,
+    // Q_ACK: Kommandonummer (Status DONE), Q_STATUS: Kommandonummer, expect1 = Status
+#define TESTCASE(nr, set1, set2, expect1, expect2) \
+        queueId = UINT32_MAX; \
+        queueCmd.arg = UINT32_MAX; \
+        switch (set1) { \
+            case Q_PUSH:   queueRet = dob_CommandPush(queue, SDO_CMD_RESET, 1, set2, &queueId); break; \
+            case Q_POP:    queueRet = dob_CommandPop(&queueCmd, &queueId); break; \
+            case Q_ACK:    dob_CommandAck(set2, SDO_STATUS_DONE); queueRet = 0; queueId = set2; break; \
+            default:       queueRet = dob_CommandStatus(queue, set2); queueId = set2; break; \
+        } \
+        if( (queueRet != (expect1)) || (queueRet == 0 && queueId != (expect2)) || \
+            (set1 == Q_POP && queueRet == 0 && queueCmd.arg != (set2)) ) { \
+            printf("   TC%02u FAIL: op=%u arg=%u\n              ret=%d (expect %d) id=%u (expect %u)\n", \
+                   nr, set1, set2, queueRet, expect1, queueId, expect2); \
+            errors++; \
+        }
+
+    printf(" * Neu: leer, alle Quittungen ausstehend\n");
+    //       nr  op        arg  ret                  id
+    TESTCASE( 1, Q_POP,    0,   -1,                  0)
+    TESTCASE( 2, Q_STATUS, 0,   SDO_STATUS_PENDING,  0)
+    TESTCASE( 3, Q_STATUS, 3,   SDO_STATUS_PENDING,  3)
+    printf(" * Voll nach 4 Kommandos\n");
+    TESTCASE( 1, Q_PUSH,   10,  0,                   0)
+    TESTCASE( 2, Q_PUSH,   11,  0,                   1)
+    TESTCASE( 3, Q_PUSH,   12,  0,                   2)
+    TESTCASE( 4, Q_PUSH,   13,  0,                   3)
+    TESTCASE( 5, Q_PUSH,   14,  -1,                  0)
+    printf(" * Übernehmen gibt Slots frei, Nummern laufen über depth weiter\n");
+    TESTCASE( 1, Q_POP,    10,  0,                   0)
+    TESTCASE( 2, Q_STATUS, 0,   SDO_STATUS_PENDING,  0)
+    TESTCASE( 3, Q_ACK,    0,   0,                   0)
+    TESTCASE( 4, Q_STATUS, 0,   SDO_STATUS_DONE,     0)
+    TESTCASE( 5, Q_PUSH,   14,  0,                   4)
+    TESTCASE( 6, Q_PUSH,   15,  -1,                  0)
+    TESTCASE( 7, Q_POP,    11,  0,                   1)
+    TESTCASE( 8, Q_POP,    12,  0,                   2)
+    TESTCASE( 9, Q_POP,    13,  0,                   3)
+    TESTCASE(10, Q_POP,    14,  0,                   4)
+    TESTCASE(11, Q_POP,    0,   -1,                  0)
+    TESTCASE(12, Q_STATUS, 4,   SDO_STATUS_PENDING,  4)
+    TESTCASE(13, Q_ACK,    4,   0,                   4)
+    TESTCASE(14, Q_STATUS, 4,   SDO_STATUS_DONE,     4)
+    TESTCASE(15, Q_STATUS, 0,   SDO_STATUS_PENDING,  0)   // Quittung 0 von 4 überschrieben
+
+    printf(" * Mehrfacher Umlauf mit SDO_QUEUE_DEPTH\n");
+    dob_CommandQueueInit(queue, SDO_QUEUE_DEPTH);
+    for (uint32_t i = 0; i < 3 * SDO_QUEUE_DEPTH + 1; i++) {
+        TESTCASE(i, Q_PUSH,   i,   0,                   i)
+        TESTCASE(i, Q_STATUS, i,   SDO_STATUS_PENDING,  i)
+        TESTCASE(i, Q_POP,    i,   0,                   i)
+        TESTCASE(i, Q_ACK,    i,   0,                   i)
+        TESTCASE(i, Q_STATUS, i,   SDO_STATUS_DONE,     i)
+    }
+    g_SdoQueue = savedQueue;
+    free(queue);
 
+#undef TESTCASE
+/*********************************************************************************************/
+printf("SpiAccounting\n");
+    g_GlobalConfig.spiErrorBurst = 3;
+#define TESTCASE(nr, set1, set2, expect1, expect2) \
+        PACK_PDO.stateMachine = set1; \
+        PACK_PDO.swAlertFlags = 0; \
+        SpiStats.errorBurst = set2; \
+        SpiAccounting(id); \
+        if( (PACK_PDO.stateMachine != expect1) || (PACK_PDO_SWALERTFLAG_BITS.COMM_ERR != expect2) ) { \
+            printf("   TC%02u FAIL: stateMachine=%u errorBurst=%u\n",nr,set1,set2); \
+            printf("              stateMachine=%u (expect %u) COMM_ERR=%u (expect %u)\n", \
+                   PACK_PDO.stateMachine,expect1,PACK_PDO_SWALERTFLAG_BITS.COMM_ERR,expect2); \
+            errors++; \
+        }
+    //       nr  stateMachine            errorBurst  stateMachine            COMM_ERR
+    TESTCASE( 1, AFE_STATE_RUN,          2,          AFE_STATE_RUN,          0)
+    TESTCASE( 2, AFE_STATE_RUN,          3,          AFE_STATE_RUN,          1)   // MosControl schaltet ab
+    TESTCASE( 3, AFE_STATE_INIT,         3,          AFE_STATE_ERROR,        1)
+    TESTCASE( 4, AFE_STATE_WAIT_INIT,    3,          AFE_STATE_WAIT_INIT,    0)   // AFE fehlt, weiter suchen
+    TESTCASE( 5, AFE_STATE_WAIT_INIT,    100,        AFE_STATE_WAIT_INIT,    0)
+#undef TESTCASE
+
+    printf(" * AFE fehlt, bms_CyclicTask pollt weiter und findet es später\n");
+    memset(SpiReg, 0, sizeof(SpiReg));
+    PACK_PDO.stateMachine = AFE_STATE_WAIT_INIT;
+    PACK_PDO.swAlertFlags = 0;
+    SpiStats.errorBurst = 10;
+    for (int t = 0; t < 100; t++) {
+        bms_Tick();
+        bms_CyclicTask(id);
+    }
+    if (PACK_PDO.stateMachine != AFE_STATE_WAIT_INIT || PACK_PDO.swAlertFlags) {
+        printf("   TC01 FAIL: stateMachine=%u swAlertFlags=%u\n", PACK_PDO.stateMachine, PACK_PDO.swAlertFlags);
+        errors++;
+    }
+    SpiReg[0x00] = 0x6000;                                      // Power-up complete
+    SpiStats.errorBurst = 0;
+    for (int t = 0; t < 100 && PACK_PDO.stateMachine == AFE_STATE_WAIT_INIT; t++) {
+        bms_Tick();
+        bms_CyclicTask(id);
+    }
+    if (PACK_PDO.stateMachine != AFE_STATE_INIT) {
+        printf("   TC02 FAIL: stateMachine=%u (expect %u)\n", PACK_PDO.stateMachine, AFE_STATE_INIT);
+        errors++;
+    }
+    g_GlobalConfig.spiErrorBurst = 0;
 
+/*********************************************************************************************/
+printf("AFEReadData (Registerschatten)\n");
+    memset(SpiReg, 0, sizeof(SpiReg));
+    s_afeRaw[id].shadowEvents = 0;
+#define TESTCASE(nr, set1, set2, expect1) \
+        SpiReg[0x03] = set1; \
+        SpiReg[0x05] = set2; \
+        ShadowInvalidations = 0; \
+        AFEReadData(id, 0); \
+        if( ShadowInvalidations != expect1 ) { \
+            printf("   TC%02u FAIL: ALRT_FLG1=0x%04x ALRT_STAT0=0x%04x\n",nr,set1,set2); \
+            printf("              spi_ShadowInvalidate=%u (expect %u)\n",ShadowInvalidations,expect1); \
+            errors++; \
+        }
+    //       nr  ALRT_FLG1  ALRT_STAT0  spi_ShadowInvalidate
+    TESTCASE( 1, 0x0000,    0x0000,     0)
+    TESTCASE( 2, 0x0000,    0x4000,     1)      // RESET gesetzt
+    TESTCASE( 3, 0x0000,    0x4000,     0)      // RESET steht noch
+    TESTCASE( 4, 0x0001,    0x4000,     1)      // SPI_CRC_ERR kommt dazu
+    TESTCASE( 5, 0x0001,    0x4000,     0)
+    TESTCASE( 6, 0x0000,    0x0000,     0)      // gelöscht
+    TESTCASE( 7, 0x0001,    0x0000,     1)      // SPI_CRC_ERR erneut
 #undef TESTCASE
+
+/*********************************************************************************************/
+printf("bms_Aggregate\n");
+    g_GlobalConfig.numberOfPacks = 3;
+    g_packEnabled = 0x7;
+    memset(PackPdoData, 0, sizeof(PackPdoData));
+    for (int p = 0; p < 3; p++) {
+        PackPdoData[p].id = p + 1;
+        PackPdoData[p].stateMachine = AFE_STATE_RUN;
+        PackPdoData[p].voltage = 50.0f + p;
+        PackPdoData[p].current = 10.0f;
+        PackPdoData[p].availableChargeCurrent = 20.0f;
+        PackPdoData[p].stateOfCharge = 40.0f + 10 * p;
+        for (int c = 0; c < NUMBER_OF_CELLS; c++)
+            PackPdoData[p].cells[c] = 3.3f;
+        for (int n = 0; n < 4; n++)
+            PackPdoData[p].ntcTemperature[n] = 25.0f;
+    }
+    PackPdoData[0].mosfetStatus_bits.CHARGE = 1;
+    PackPdoData[2].mosfetStatus_bits.DISCHARGE = 1;
+    PackPdoData[1].cells[3] = 3.1f;
+    PackPdoData[2].cells[7] = 3.5f;
+    PackPdoData[2].ntcTemperature[1] = 40.0f;
+    PackPdoData[1].stateMachine = AFE_STATE_ERROR;  // Zellen/Temperaturen ungültig
+    PackPdoData[1].swAlertFlags = 0x4;
+    PackPdoData[2].swWarningFlags = 0x1;
+    PackPdoData[0].ntcTemperature[2] = 5.0f;
+
+#define CHECK(nr, cond) \
+        if (!(cond)) { \
+            printf("   TC%02u FAIL: %s\n", nr, #cond); \
+            errors++; \
+        }
+
+    bms_Aggregate();
+    CHECK( 1, GlobalPdoData.voltage == 51.0f)                   // Mittel aus Pack 1 und 3
+    CHECK( 2, GlobalPdoData.current == 30.0f && GlobalPdoData.availableChargeCurrent == 60.0f)
+    CHECK( 3, GlobalPdoData.runPacks == 0x5 && GlobalPdoData.errorPacks == 0x2 && GlobalPdoData.warningPacks == 0x4)
+    CHECK( 4, GlobalPdoData.cellMin == 3.3f && GlobalPdoData.cellMinPack == 1 && GlobalPdoData.cellMinCell == 0)
+    CHECK( 5, GlobalPdoData.cellMax == 3.5f && GlobalPdoData.cellMaxPack == 3 && GlobalPdoData.cellMaxCell == 7)
+    CHECK( 6, GlobalPdoData.temperatureMin == 5.0f && GlobalPdoData.temperatureMinPack == 1)
+    CHECK( 7, GlobalPdoData.temperatureMax == 40.0f && GlobalPdoData.temperatureMaxPack == 3)
+    CHECK( 8, GlobalPdoData.stateOfCharge == 50.0f)
+
+    g_packEnabled = 0x2;                                        // nur Pack 2, im Fehler
+    bms_Aggregate();
+    CHECK( 9, GlobalPdoData.voltage == 0 && GlobalPdoData.runPacks == 0 && GlobalPdoData.errorPacks == 0x2)
+    CHECK(10, GlobalPdoData.cellMin == 0 && GlobalPdoData.cellMax == 0 && GlobalPdoData.cellMinPack == 0)
+
+#undef CHECK
 /*********************************************************************************************/
     printf("%u Fehler\n",errors);
     return (errors != 0);
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""ctypes-Anbindung an libbmsclient.so (bmsclient.h).
+
+    with BmsClient() as bms:
+        cycle = 0
+        while True:
+            cycle = bms.wait_cycle(cycle, 1000) or cycle
+            snap = bms.snapshot()
+            print(snap.glob.cycle, [p.current for p in snap.pack])
+
+Bibliothek: $BMSCLIENT_LIB, sonst neben diesem Modul bzw. im Repo, sonst Systempfad.
+"""
+import os
+import ctypes
+import ctypes.util
+from ctypes import POINTER, Structure, c_char_p, c_int, c_int64, c_size_t, c_uint32, c_uint64, c_void_p, sizeof
+from dataobjects import GLOBAL_PDO_t, PACK_PDO_t, PDO_HEADER_t
+
+SDO_CMD_CHARGE_ENABLE, SDO_CMD_DISCHARGE_ENABLE, SDO_CMD_CLEAR_ALERTS, SDO_CMD_RESET = 1, 2, 3, 4
+SDO_STATUS_PENDING, SDO_STATUS_DONE, SDO_STATUS_BAD_COMMAND, SDO_STATUS_BAD_PACK = 0, 1, 2, 3
+PDO_SCOPE_GLOBAL, PDO_SCOPE_PACK = 0, 1
+
+def _load_library():
+    here = os.path.dirname(os.path.abspath(__file__))
+    for path in (os.environ.get("BMSCLIENT_LIB"), os.path.join(here, "libbmsclient.so"),
+                 os.path.join(here, "..", "libbmsclient.so"), ctypes.util.find_library("bmsclient")):
+        if path and (os.path.exists(path) or not os.path.dirname(path)):
+            return ctypes.CDLL(path, use_errno=True)
+    raise OSError("libbmsclient.so nicht gefunden (make libbmsclient)")
+
+_lib = _load_library()
+
+def _proto(name, restype, *argtypes):
+    fn = getattr(_lib, name)
+    fn.restype, fn.argtypes = restype, list(argtypes)
+    return fn
+
+_attach = _proto("bmsc_Attach", c_void_p)
+_detach = _proto("bmsc_Detach", None, c_void_p)
+_header = _proto("bmsc_Header", POINTER(PDO_HEADER_t), c_void_p)
+_snapshot_size = _proto("bmsc_SnapshotSize", c_size_t, c_void_p)
+_snapshot_copy = _proto("bmsc_SnapshotCopy", c_int, c_void_p, c_void_p)
+_snapshot = _proto("bmsc_Snapshot", c_void_p, c_void_p)
+_pack_copy = _proto("bmsc_PackCopy", c_int, c_void_p, c_uint32, c_void_p)
+_live = _proto("bmsc_Live", c_void_p, c_void_p)
+_wait_cycle = _proto("bmsc_WaitCycle", c_int64, c_void_p, c_uint32, c_int)
+_history_record_size = _proto("bmsc_HistoryRecordSize", c_size_t, c_void_p)
+_history_cycle = _proto("bmsc_HistoryCycle", c_uint64, c_void_p)
+_history_read = _proto("bmsc_HistoryRead", c_int, c_void_p, POINTER(c_uint64), c_void_p, c_uint32, POINTER(c_uint64))
+_command = _proto("bmsc_Command", c_int, c_void_p, c_uint32, c_uint32, c_uint32, POINTER(c_uint32))
+_command_status = _proto("bmsc_CommandStatus", c_uint32, c_void_p, c_uint32)
+_field_offset = _proto("bmsc_FieldOffset", c_int, c_void_p, c_char_p, c_uint32)
+
+def _errno_error(what):
+    err = ctypes.get_errno()
+    return OSError(err, f"{what}: {os.strerror(err)}")
+
+
+class BmsClient:
+    """Ein Handle je Thread, wie in bmsclient.h."""
+
+    def __init__(self):
+        self._handle = _attach()
+        if not self._handle:
+            raise _errno_error("bmsc_Attach")
+        self.header = _header(self._handle).contents
+        self.number_of_packs = self.header.numberOfPacks
+
+        # Gleiches Layout wie BMSC_SNAPSHOT_t
+        class Snapshot(Structure):
+            _fields_ = [("glob", GLOBAL_PDO_t), ("pack", PACK_PDO_t * self.number_of_packs)]
+        if sizeof(Snapshot) != _snapshot_size(self._handle):
+            self.close()
+            raise RuntimeError("dataobjects.py passt nicht zu libbmsclient.so")
+        self.Snapshot = Snapshot
+
+    def close(self):
+        if self._handle:
+            _detach(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def snapshot(self):
+        """Eigene Kopie des letzten konsistenten Zyklus (bmsc_Snapshot + eine Kopie nach Python)."""
+        ptr = _snapshot(self._handle)
+        if not ptr:
+            raise _errno_error("bmsc_Snapshot")
+        return self.Snapshot.from_buffer_copy(self.Snapshot.from_address(ptr))
+
+    def snapshot_into(self, target):
+        """Konsistente Kopie in eine vorhandene Snapshot-Instanz, ohne Zwischenpuffer."""
+        if _snapshot_copy(self._handle, ctypes.addressof(target)) < 0:
+            raise _errno_error("bmsc_SnapshotCopy")
+        return target
+
+    def pack(self, index):
+        target = PACK_PDO_t()
+        if _pack_copy(self._handle, index, ctypes.addressof(target)) < 0:
+            raise _errno_error("bmsc_PackCopy")
+        return target
+
+    def live(self):
+        """Sicht direkt auf das Segment, nur über wait_cycle/snapshot konsistent."""
+        return self.Snapshot.from_address(_live(self._handle))
+
+    def wait_cycle(self, last, timeout_ms=-1):
+        """Neuer Zyklus, None bei Timeout."""
+        cycle = _wait_cycle(self._handle, last, timeout_ms)
+        return None if cycle < 0 else cycle
+
+    def history_cycle(self):
+        """Zuletzt veröffentlichter Zyklus im Verlauf, 0 = keiner."""
+        return _history_cycle(self._handle)
+
+    def history_read(self, next_cycle=0, max_records=64):
+        """Einträge ab next_cycle (0 = ältester) wie bmsc_HistoryRead.
+        Rückgabe: (Puffer, Anzahl, Eintragsgröße, nächster Zyklus, verlorene Zyklen).
+        Eintrag: HISTORY_RECORD_t, danach PACK_PDO_t[number_of_packs]."""
+        size = _history_record_size(self._handle)
+        buf = ctypes.create_string_buffer(size * max_records)
+        cursor, lost = c_uint64(next_cycle), c_uint64(0)
+        count = _history_read(self._handle, ctypes.byref(cursor), buf, max_records, ctypes.byref(lost))
+        if count < 0:
+            raise _errno_error("bmsc_HistoryRead")
+        return buf, count, size, cursor.value, lost.value
+
+    def command(self, cmd, pack=0, arg=0):
+        """Kommando in die Queue, Rückgabe: id für command_status."""
+        cmd_id = c_uint32()
+        if _command(self._handle, cmd, pack, arg, ctypes.byref(cmd_id)) < 0:
+            raise _errno_error("bmsc_Command")
+        return cmd_id.value
+
+    def command_status(self, cmd_id):
+        return _command_status(self._handle, cmd_id)
+
+    def field_offset(self, name, scope=PDO_SCOPE_PACK):
+        offset = _field_offset(self._handle, name.encode(), scope)
+        return None if offset < 0 else offset
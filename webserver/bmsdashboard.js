@@ -1,25 +1,7 @@
 // ---------- Helpers ----------
-const safeArr = v => Array.isArray(v) ? v : [];
-const avg = arr => arr?.length ? arr.reduce((a, b) => a + b, 0) / arr.length : 0;
-const sum = arr => arr?.length ? arr.reduce((a, b) => a + b, 0) : 0;
-
-const progressBar = (value = 0, type = "primary") => {
-    const pct = Math.min(100, Math.max(0, Number(value) || 0));
-    return `
-        <div class="progress" style="height:20px">
-            <div class="progress-bar bg-${type}" role="progressbar" style="width:${pct}%"
-                aria-valuenow="${pct}" aria-valuemin="0" aria-valuemax="100">
-                ${pct.toFixed(1)}%
-            </div>
-        </div>`;
-};
-
-const decodeBits = (value = 0, texts = [], badgeClass) => {
-    const bits = texts
-        .map((text, i) => value & (1 << i) ? `<span class="${badgeClass} me-1">${text}</span>` : "")
-        .filter(Boolean);
-    return bits.length ? bits.join(" ") : `<span class="text-muted">Keine</span>`;
-};
+const safeArr = v => Array.isArray(v) ? v : ArrayBuffer.isView(v) ? Array.from(v) : [];
+const fixed = (value, digits) => Number.isFinite(value) ? value.toFixed(digits) : "—";
+const packName = id => `Pack ${id} - ${PACKNAMES_TEXT[id-1]}`;
 
 const getHeaderClass = (param) =>
     param=="DISABLED" ? "bg-dark text-white" :
@@ -28,85 +10,116 @@ const getHeaderClass = (param) =>
     param=="RUN" ? "bg-primary text-white" :
     "bg-secondary text-dark";
 
-const findCellLocation = (packs, targetVal) => {
-    for (const { name, cells } of packs) {
-        const idx = safeArr(cells).indexOf(targetVal);
-        if (idx >= 0) return `${name} (C${idx + 1})`;
-    }
-    return "—";
+// ---------- View ----------
+// Das Markup entsteht einmal je Pack-Layout (Pack-IDs, Zell- und NTC-Anzahl). Danach werden
+// nur noch Texte, Balkenbreiten und Klassen gesetzt, die sich geändert haben. Veränderliche
+// Elemente tragen data-k="<Schlüssel>", der zuletzt gesetzte Wert wird je Schlüssel gemerkt.
+let view = null;
+
+const setText = (key, value) => {
+    const n = view.nodes.get(key);
+    if (n && n.text !== value) { n.el.textContent = value; n.text = value; }
 };
 
-const renderMOSGlobal = (index, packs) => {
-    const onStates = packs.map(p => !!(p.mosfetStatus & (1 << index)));
-    const allOn = onStates.every(Boolean);
-    const anyOn = onStates.some(Boolean);
-    const cls = allOn ? "badge-mos-on" : anyOn ? "badge-mos-part" : "badge-mos-off";
-    return `<span class="${cls} me-2">${MOS_BITS[index]}</span>`;
+const setClass = (key, value) => {
+    const n = view.nodes.get(key);
+    if (n && n.cls !== value) { n.el.className = value; n.cls = value; }
 };
 
-const renderPackBadges = (list, cls) =>
-    list?.length ? list.map(n => `<span class="${cls} me-1">${n}</span>`).join("") :
-    "<span class='text-muted'>Keine</span>";
+const setShown = (key, on) => {
+    const n = view.nodes.get(key);
+    if (n) setClass(key, on ? n.base : `${n.base} d-none`);
+};
 
-// ---------- Data Fetch ----------
-async function fetchData() {
-    try {
-        const res = await fetch("/api/bmsdata", { cache: "no-store" });
-        if (!res.ok) throw new Error(`HTTP ${res.status}`);
-        const data = CBOR.decode(await res.arrayBuffer());
-        renderPacks(data);
-    } catch (e) {
-        console.error("API Fehler:", e);
-        document.getElementById("packsContainer").innerHTML =
-            `<div class="col-12"><div class="alert alert-danger">Fehler beim Laden: ${e.message}</div></div>`;
-    }
+const setBackground = (key, value) => {
+    const n = view.nodes.get(key);
+    if (n && n.bg !== value) { n.el.style.background = value; n.bg = value; }
+};
+
+const setBar = (key, value) => {
+    const n = view.nodes.get(key);
+    const pct = Math.min(100, Math.max(0, Number(value) || 0)).toFixed(1);
+    if (!n || n.text === `${pct}%`) return;
+    n.el.style.width = `${pct}%`;
+    n.el.setAttribute("aria-valuenow", pct);
+    setText(key, `${pct}%`);
+};
+
+// Ein Badge je Bit, ungesetzte ausgeblendet, "Keine" wenn kein Bit gesetzt
+const bitsMarkup = (key, texts, badgeClass) =>
+    texts.map((text, i) => `<span data-k="${key}.${i}" class="${badgeClass} me-1 d-none">${text}</span>`).join("") +
+    `<span data-k="${key}.none" class="text-muted">Keine</span>`;
+
+const setBits = (key, value = 0, count) => {
+    for (let i = 0; i < count; i++)
+        setShown(`${key}.${i}`, value & (1 << i));
+    setShown(`${key}.none`, !(value & ((1 << count) - 1)));
+};
+
+const progressBar = (key, type) => `
+        <div class="progress" style="height:20px">
+            <div data-k="${key}" class="progress-bar bg-${type}" role="progressbar" style="width:0%"
+                aria-valuenow="0" aria-valuemin="0" aria-valuemax="100">0.0%</div>
+        </div>`;
+
+const showMessage = (text, type) => {
+    document.getElementById("packsContainer").innerHTML =
+        `<div class="col-12"><div class="alert alert-${type}">${text}</div></div>`;
+    view = null;
+};
+
+function buildView(packs, layout) {
+    const container = document.getElementById("packsContainer");
+    container.innerHTML = globalMarkup(packs) + packs.map(packMarkup).join("");
+    view = { layout, nodes: new Map() };
+    container.querySelectorAll("[data-k]").forEach(el =>
+        view.nodes.set(el.dataset.k, {
+            el, base: el.className.replace(/ d-none$/, ""), cls: el.className, text: el.textContent }));
 }
 
 // ---------- Main Render ----------
 function renderPacks(data) {
-    const container = document.getElementById("packsContainer");
-    const packs = safeArr(data?.pack)
-        .filter(p => p?.id)
-        .map(p => ({ ...p, name: `Pack ${p.id} - ${PACKNAMES_TEXT[p.id-1]}` }));
-
+    const packs = safeArr(data?.pack).filter(p => p?.id);
     if (!packs.length) {
-        container.innerHTML = `<div class="col-12"><div class="alert alert-secondary">Keine gültigen Packs</div></div>`;
+        showMessage("Keine gültigen Packs", "secondary");
         return;
     }
 
-    const allCells = packs.flatMap(p => safeArr(p.cells).filter(Number.isFinite));
-    const allTemps = packs.flatMap(p => safeArr(p.ntcTemperature).filter(Number.isFinite));
-    const [maxCellVal, minCellVal] = [Math.max(...allCells), Math.min(...allCells)];
-
-    const packsWithError = packs.filter(p => p.swAlertFlags).map(p => p.name);
-    const packsWithWarn = packs.filter(p => p.swWarningFlags).map(p => p.name);
+    const layout = packs.map(p => `${p.id}:${safeArr(p.cells).length}:${safeArr(p.ntcTemperature).length}`).join(",");
+    if (view?.layout !== layout)
+        buildView(packs, layout);
+    updateGlobal(data.glob ?? {}, packs);
+    packs.forEach(updatePack);
+}
 
-    const global = data.glob ?? {};
-    const mosStatus = MOS_BITS.map((_, i) => renderMOSGlobal(i, packs)).join("");
+function globalMarkup(packs) {
+    const packBadges = (key, cls) =>
+        packs.map(p => `<span data-k="${key}.${p.id}" class="${cls} me-1 d-none">${packName(p.id)}</span>`).join("") +
+        `<span data-k="${key}.none" class="text-muted">Keine</span>`;
 
-    container.innerHTML = `
+    return `
         <div class="col-12">
             <div class="card pack-card">
                 <div class="card-header bg-info text-white d-flex justify-content-between align-items-center">
                     <span class="pack-header">Global Status</span>
                 </div>
                 <div class="card-body">
-                    ${global.numberOfPacks !== undefined ? `
-                        <div><strong>Anzahl Packs:</strong> ${global.numberOfPacks}</div>
-                        <div><strong>Globale Spannung:</strong> ${global.voltage?.toFixed(3) ?? '—'} V</div>
-                        <hr>` : ""}
-                    <div><strong>Mittlere Spannung:</strong> ${avg(packs.map(p => p.voltage)).toFixed(3)} V</div>
-                    <div><strong>Summe Ströme:</strong> ${sum(packs.map(p => p.current)).toFixed(3)} A</div>
-                    <div><strong>Mittlere Temperatur:</strong> ${avg(allTemps).toFixed(1)} °C</div>
-                    <div class="mt-2"><strong>Max Zellspannung:</strong> ${maxCellVal.toFixed(3)} V (${findCellLocation(packs, maxCellVal)})</div>
-                    <div><strong>Min Zellspannung:</strong> ${minCellVal.toFixed(3)} V (${findCellLocation(packs, minCellVal)})</div>
+                    <div><strong>Anzahl Packs:</strong> <span data-k="g.numberOfPacks"></span></div>
+                    <div><strong>Busspannung:</strong> <span data-k="g.voltage"></span> V</div>
+                    <div><strong>Summe Ströme:</strong> <span data-k="g.current"></span> A</div>
+                    <div><strong>Verfügbar Laden / Entladen:</strong> <span data-k="g.available"></span> A</div>
+                    <div><strong>Temperatur:</strong> <span data-k="g.temperature"></span> °C (min/mittel/max)</div>
+                    <div class="mt-2"><strong>Max Zellspannung:</strong> <span data-k="g.cellMax"></span></div>
+                    <div><strong>Min Zellspannung:</strong> <span data-k="g.cellMin"></span></div>
+                    <div><strong>Mittlere Zellspannung:</strong> <span data-k="g.cellAvg"></span> V</div>
                     <hr>
                     <div><strong>MOS Status (global):</strong></div>
-                    <div class="d-flex flex-wrap align-items-center mb-2">${mosStatus}</div>
+                    <div class="d-flex flex-wrap align-items-center mb-2">
+                        ${MOS_BITS.map((t, i) => `<span data-k="g.mos.${i}" class="badge-mos-off me-2">${t}</span>`).join("")}
+                    </div>
                     <div class="mb-2">
                         ${["charge_on_all", "charge_off_all", "discharge_on_all", "discharge_off_all"]
                             .map(cmd => {
-                                const label = cmd.includes("on") ? "EIN" : "AUS";
                                 const type = cmd.includes("charge") ? "success" : "danger";
                                 const action = cmd.includes("off") ? "AUS" : "EIN";
                                 return `<button class="btn btn-sm btn-outline-${type} me-1"
@@ -114,76 +127,184 @@ function renderPacks(data) {
                             }).join("")}
                     </div>
                     <hr>
-                    <div><strong>Packs mit Fehler:</strong> ${renderPackBadges(packsWithError, 'badge bg-danger')}</div>
-                    <div><strong>Packs mit Warnung:</strong> ${renderPackBadges(packsWithWarn, 'badge bg-warning text-dark')}</div>
+                    <div><strong>Packs mit Fehler:</strong> ${packBadges("g.error", "badge bg-danger")}</div>
+                    <div><strong>Packs mit Warnung:</strong> ${packBadges("g.warning", "badge bg-warning text-dark")}</div>
                     <hr>
-                    <div><strong>Mittlerer SOC:</strong> ${progressBar(avg(packs.map(p => p.stateOfCharge)), 'success')}</div>
-                    <div class="mt-2"><strong>Mittlerer SOH:</strong> ${progressBar(avg(packs.map(p => p.stateOfHealth)), 'info')}</div>
+                    <div><strong>Mittlerer SOC:</strong> ${progressBar("g.soc", "success")}</div>
+                    <div class="mt-2"><strong>Mittlerer SOH:</strong> ${progressBar("g.soh", "info")}</div>
                 </div>
             </div>
-        </div>
-        ${packs.map(renderPackCard).join("")}
-    `;
+        </div>`;
 }
 
-function renderPackCard(pack) {
-    const cells = safeArr(pack.cells);
-    const ntcs = safeArr(pack.ntcTemperature);
-    const [maxVal, minVal] = [Math.max(...cells), Math.min(...cells)];
-    const diffCell = (maxVal - minVal).toFixed(3);
+// Aggregate rechnet bmsd (GLOBAL_PDO_t), Pack = id ab 1, Maske: Bit = id - 1
+function updateGlobal(global, packs) {
+    const cellLocation = (value, pack, cell) =>
+        `${fixed(value, 3)} V (${pack ? packName(pack) : "—"} C${(cell ?? 0) + 1})`;
+    const packMask = (key, mask = 0) => {
+        packs.forEach(p => setShown(`${key}.${p.id}`, mask & (1 << (p.id - 1))));
+        setShown(`${key}.none`, !packs.some(p => mask & (1 << (p.id - 1))));
+    };
 
-    const cellsHtml = cells.map((v, i) => {
-        const color = v === maxVal ? "#ff6b6b" : v === minVal ? "#4dabf7" : "#d3d3d3";
-        return `<div class="cell-field" style="background:${color}">C${i + 1}: ${v?.toFixed(3) ?? "—"} V</div>`;
-    }).join("");
+    setText("g.numberOfPacks", String(global.numberOfPacks ?? "—"));
+    setText("g.voltage", fixed(global.voltage, 3));
+    setText("g.current", fixed(global.current, 3));
+    setText("g.available", `${fixed(global.availableChargeCurrent, 1)} / ${fixed(global.availableDischargeCurrent, 1)}`);
+    setText("g.temperature",
+        `${fixed(global.temperatureMin, 1)} / ${fixed(global.temperatureAvg, 1)} / ${fixed(global.temperatureMax, 1)}`);
+    setText("g.cellMax", cellLocation(global.cellMax, global.cellMaxPack, global.cellMaxCell));
+    setText("g.cellMin", cellLocation(global.cellMin, global.cellMinPack, global.cellMinCell));
+    setText("g.cellAvg", fixed(global.cellAvg, 3));
 
-    const mosHtml = MOS_BITS.map((t, i) => {
-        const on = !!(pack.mosfetStatus & (1 << i));
-        return `
-            <div class="me-3 d-inline-flex align-items-center mb-1">
-                <span class="${on ? "badge-mos-on" : "badge-mos-off"} me-1">${t}</span>
-                <button class="btn btn-sm btn-outline-success me-1" onclick="sendCommand('${t.toLowerCase()}_on','${pack.name}')">EIN</button>
-                <button class="btn btn-sm btn-outline-danger" onclick="sendCommand('${t.toLowerCase()}_off','${pack.name}')">AUS</button>
-            </div>`;
-    }).join("");
+    MOS_BITS.forEach((_, i) => {
+        const on = packs.filter(p => p.mosfetStatus & (1 << i)).length;
+        const cls = on === packs.length ? "badge-mos-on" : on ? "badge-mos-part" : "badge-mos-off";
+        setClass(`g.mos.${i}`, `${cls} me-2`);
+    });
 
-    const ntcHtml = ntcs.map((t, i) => `<div class="ntc-field">T${i + 1}: ${t?.toFixed(1) ?? "—"} °C</div>`).join("");
+    packMask("g.error", global.errorPacks);
+    packMask("g.warning", global.warningPacks);
+    setBar("g.soc", global.stateOfCharge);
+    setBar("g.soh", global.stateOfHealth);
+}
+
+function packMarkup(pack) {
+    const k = `p${pack.id}`;
+    const cellsHtml = safeArr(pack.cells)
+        .map((_, i) => `<div class="cell-field">C${i + 1}: <span data-k="${k}.cell.${i}"></span> V</div>`).join("");
+    const ntcHtml = safeArr(pack.ntcTemperature)
+        .map((_, i) => `<div class="ntc-field">T${i + 1}: <span data-k="${k}.ntc.${i}"></span> °C</div>`).join("");
+
+    const mosHtml = MOS_BITS.map((t, i) => `
+            <div class="me-3 d-inline-flex align-items-center mb-1">
+                <span data-k="${k}.mos.${i}" class="badge-mos-off me-1">${t}</span>
+                ${MOS_COMMANDS[i] ? `
+                <button class="btn btn-sm btn-outline-success me-1" onclick="sendCommand('${MOS_COMMANDS[i]}_on',${pack.id})">EIN</button>
+                <button class="btn btn-sm btn-outline-danger" onclick="sendCommand('${MOS_COMMANDS[i]}_off',${pack.id})">AUS</button>` : ""}
+            </div>`).join("");
 
     return `
         <div class="col-lg-6 col-12">
             <div class="card pack-card">
-                <div class="card-header ${getHeaderClass(STATEMACHINE_TEXT[pack.stateMachine])} d-flex justify-content-between align-items-center">
-                    <span class="pack-header">${pack.name}</span>
-                    <small>SOC: ${pack.stateOfCharge?.toFixed(1)}% | SOH: ${pack.stateOfHealth?.toFixed(1)}%</small>
+                <div data-k="${k}.header" class="card-header d-flex justify-content-between align-items-center">
+                    <span class="pack-header">${packName(pack.id)}</span>
+                    <small data-k="${k}.summary"></small>
                 </div>
                 <div class="card-body">
-                    <div><strong>Spannung:</strong> ${pack.voltage?.toFixed(3)} V</div>
-                    <div><strong>Strom:</strong> ${pack.current?.toFixed(3)} A</div>
-                    <div><strong>Zyklen:</strong> ${pack.cycleCount ?? "—"}</div>
-                    <div><strong>State Machine:</strong> ${STATEMACHINE_TEXT[pack.stateMachine] ?? "—"}</div>
-                    <div><strong>Verfügbare Kapazität:</strong> ${pack.availableCapacity?.toFixed(1) ?? "—"} mAh</div>
+                    <div><strong>Spannung:</strong> <span data-k="${k}.voltage"></span> V</div>
+                    <div><strong>Strom:</strong> <span data-k="${k}.current"></span> A</div>
+                    <div><strong>Zyklen:</strong> <span data-k="${k}.cycleCount"></span></div>
+                    <div><strong>State Machine:</strong> <span data-k="${k}.stateMachine"></span></div>
+                    <div><strong>Verfügbare Kapazität:</strong> <span data-k="${k}.availableCapacity"></span> mAh</div>
                     <hr>
-                    <div><strong>Alarme:</strong> ${decodeBits(pack.swAlertFlags, SWALERTFLAGS_TEXT, 'badge bg-danger')}</div>
-                    <div><strong>Warnungen:</strong> ${decodeBits(pack.swWarningFlags, SWALERTFLAGS_TEXT, 'badge bg-warning text-dark')}</div>
+                    <div><strong>Alarme:</strong> ${bitsMarkup(`${k}.alert`, SWALERTFLAGS_TEXT, "badge bg-danger")}</div>
+                    <div><strong>Warnungen:</strong> ${bitsMarkup(`${k}.warning`, SWALERTFLAGS_TEXT, "badge bg-warning text-dark")}</div>
                     <hr>
                     <div><strong>MOS Status:</strong></div>
                     <div class="d-flex flex-wrap mb-2">${mosHtml}</div>
                     <hr>
-                    <div><strong>SOC:</strong></div>${progressBar(pack.stateOfCharge, 'success')}
-                    <div class="mt-2"><strong>SOH:</strong></div>${progressBar(pack.stateOfHealth, 'info')}
+                    <div><strong>SOC:</strong></div>${progressBar(`${k}.soc`, "success")}
+                    <div class="mt-2"><strong>SOH:</strong></div>${progressBar(`${k}.soh`, "info")}
                     <hr>
-                    <div><strong>Zellen:</strong> (Δ: ${diffCell} V)</div>
+                    <div><strong>Zellen:</strong> (Δ: <span data-k="${k}.cellDiff"></span> V)</div>
                     <div class="d-flex flex-wrap mt-1">${cellsHtml}</div>
                     <hr>
                     <div><strong>NTCs:</strong></div>
                     <div class="d-flex flex-wrap">${ntcHtml}</div>
                     <hr>
-                    <div><strong>Die:</strong> ${pack.dieTemperature?.toFixed(1)} °C | <strong>PVDD:</strong> ${pack.pvddVoltage?.toFixed(3)} V</div>
+                    <div><strong>Die:</strong> <span data-k="${k}.die"></span> °C | <strong>PVDD:</strong> <span data-k="${k}.pvdd"></span> V</div>
                 </div>
             </div>
         </div>`;
 }
 
+function updatePack(pack) {
+    const k = `p${pack.id}`;
+    const cells = safeArr(pack.cells);
+    const [maxVal, minVal] = [Math.max(...cells), Math.min(...cells)];
+    const state = STATEMACHINE_TEXT[pack.stateMachine];
+
+    setClass(`${k}.header`, `card-header ${getHeaderClass(state)} d-flex justify-content-between align-items-center`);
+    setText(`${k}.summary`, `SOC: ${fixed(pack.stateOfCharge, 1)}% | SOH: ${fixed(pack.stateOfHealth, 1)}%`);
+    setText(`${k}.voltage`, fixed(pack.voltage, 3));
+    setText(`${k}.current`, fixed(pack.current, 3));
+    setText(`${k}.cycleCount`, String(pack.cycleCount ?? "—"));
+    setText(`${k}.stateMachine`, state ?? "—");
+    setText(`${k}.availableCapacity`, fixed(pack.availableCapacity, 1));
+
+    setBits(`${k}.alert`, pack.swAlertFlags, SWALERTFLAGS_TEXT.length);
+    setBits(`${k}.warning`, pack.swWarningFlags, SWALERTFLAGS_TEXT.length);
+    MOS_BITS.forEach((_, i) =>
+        setClass(`${k}.mos.${i}`, `${pack.mosfetStatus & (1 << i) ? "badge-mos-on" : "badge-mos-off"} me-1`));
+    setBar(`${k}.soc`, pack.stateOfCharge);
+    setBar(`${k}.soh`, pack.stateOfHealth);
+
+    setText(`${k}.cellDiff`, fixed(maxVal - minVal, 3));
+    cells.forEach((v, i) => {
+        const key = `${k}.cell.${i}`;
+        setText(key, fixed(v, 3));
+        setBackground(key, v === maxVal ? "#ff6b6b" : v === minVal ? "#4dabf7" : "");
+    });
+    safeArr(pack.ntcTemperature).forEach((t, i) => setText(`${k}.ntc.${i}`, fixed(t, 1)));
+    setText(`${k}.die`, fixed(pack.dieTemperature, 1));
+    setText(`${k}.pvdd`, fixed(pack.pvddVoltage, 3));
+}
+
+// Höchstens ein Render je Frame, gerendert wird immer der neueste Stand
+let renderData = null;
+let framePending = false;
+
+const scheduleRender = data => {
+    renderData = data;
+    if (framePending) return;
+    framePending = true;
+    requestAnimationFrame(() => {
+        framePending = false;
+        renderPacks(renderData);
+    });
+};
+
+// ---------- Data Fetch ----------
+// CBOR dekodiert bmsworker.js, ohne Worker-Unterstützung direkt hier
+const BMSDATA_URL = `/api/bmsdata?fields=${DASHBOARD_FIELDS.join(",")}&typed=1`;
+let fetchPending = false;
+
+const onBmsData = msg => {
+    fetchPending = false;
+    if (msg.error) {
+        console.error("API Fehler:", msg.error);
+        showMessage(`Fehler beim Laden: ${msg.error}`, "danger");
+        return;
+    }
+    scheduleRender(msg.data);
+};
+
+const decoder = (() => {
+    try {
+        const worker = new Worker("bmsworker.js");
+        worker.onmessage = e => onBmsData(e.data);
+        return worker;
+    } catch (e) {
+        return null;
+    }
+})();
+
+async function fetchData() {
+    if (fetchPending) return; // langsame Antwort, keine zweite Anfrage stapeln
+    fetchPending = true;
+    if (decoder) {
+        decoder.postMessage({ url: BMSDATA_URL });
+        return;
+    }
+    try {
+        const res = await fetch(BMSDATA_URL, { cache: "no-store" });
+        if (!res.ok) throw new Error(`HTTP ${res.status}`);
+        onBmsData({ data: CBOR.decode(await res.arrayBuffer()) });
+    } catch (e) {
+        onBmsData({ error: e.message });
+    }
+}
+
 // ---------- Command sender ----------
 window.sendCommand = (cmd, pack = null) => {
     console.log("sendCommand", cmd, pack);
@@ -194,6 +315,41 @@ window.sendCommand = (cmd, pack = null) => {
     }).catch(e => console.error("Command Error", e));
 };
 
-// ---------- Polling ----------
-setInterval(fetchData, 1000);
-fetchData();
+// ---------- Live-Stream ----------
+// /api/stream (bmsweb): "full" mit allen Feldern, danach "delta" je Zyklus mit den
+// geänderten Feldern. Ohne Stream (pywebbms.py) weiter Polling über /api/bmsdata.
+let streamState = null;
+let pollTimer = null;
+
+const startPolling = () => {
+    if (pollTimer) return;
+    pollTimer = setInterval(fetchData, 1000);
+    fetchData();
+};
+
+function startStream() {
+    if (!window.EventSource) return startPolling();
+    const source = new EventSource("/api/stream");
+    let opened = false;
+
+    source.addEventListener("open", () => { opened = true; });
+    source.addEventListener("full", e => {
+        streamState = JSON.parse(e.data);
+        scheduleRender(streamState);
+    });
+    source.addEventListener("delta", e => {
+        const delta = JSON.parse(e.data);
+        if (!streamState || delta.base !== streamState.cycle) return; // Server schickt dann full
+        streamState.cycle = delta.cycle;
+        Object.assign(streamState.glob, delta.glob);
+        delta.pack.forEach((p, i) => Object.assign(streamState.pack[i], p));
+        scheduleRender(streamState);
+    });
+    source.addEventListener("error", () => {
+        if (opened) return; // Verbindung unterbrochen, EventSource verbindet neu
+        source.close();
+        startPolling();
+    });
+}
+
+startStream();
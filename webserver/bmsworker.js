@@ -0,0 +1,23 @@
+// ---------- CBOR Worker ----------
+// Holt /api/bmsdata und dekodiert außerhalb des UI-Threads. Anfrage: { url },
+// Antwort: { data } oder { error }. Die Puffer der Typed Arrays werden übergeben, nicht kopiert.
+importScripts("cbor.js");
+
+const collectBuffers = (value, list) => {
+    if (ArrayBuffer.isView(value))
+        list.push(value.buffer);
+    else if (value && typeof value === "object")
+        Object.values(value).forEach(v => collectBuffers(v, list));
+    return list;
+};
+
+self.onmessage = async e => {
+    try {
+        const res = await fetch(e.data.url, { cache: "no-store" });
+        if (!res.ok) throw new Error(`HTTP ${res.status}`);
+        const data = CBOR.decode(await res.arrayBuffer());
+        self.postMessage({ data }, collectBuffers(data, []));
+    } catch (err) {
+        self.postMessage({ error: err.message ?? String(err) });
+    }
+};
@@ -27,6 +27,41 @@ var POW_2_24 = Math.pow(2, -24),
     POW_2_32 = Math.pow(2, 32),
     POW_2_53 = Math.pow(2, 53);
 
+// RFC 8746 Typed Arrays: Tag -> [Konstruktor, DataView-Getter, Little Endian]
+var TYPED_ARRAY_TAGS = {
+  64: [Uint8Array, "getUint8", true],
+  65: [Uint16Array, "getUint16", false],
+  66: [Uint32Array, "getUint32", false],
+  68: [Uint8ClampedArray, "getUint8", true],
+  69: [Uint16Array, "getUint16", true],
+  70: [Uint32Array, "getUint32", true],
+  72: [Int8Array, "getInt8", true],
+  73: [Int16Array, "getInt16", false],
+  74: [Int32Array, "getInt32", false],
+  77: [Int16Array, "getInt16", true],
+  78: [Int32Array, "getInt32", true],
+  81: [Float32Array, "getFloat32", false],
+  82: [Float64Array, "getFloat64", false],
+  85: [Float32Array, "getFloat32", true],
+  86: [Float64Array, "getFloat64", true]
+};
+var HOST_LITTLE_ENDIAN = new Uint8Array(new Uint16Array([1]).buffer)[0] === 1;
+
+function decodeTypedArray(tag, bytes) {
+  var type = TYPED_ARRAY_TAGS[tag];
+  var size = type[0].BYTES_PER_ELEMENT;
+  if (bytes.length % size)
+    throw "Invalid typed array length";
+  // gleiche Byteorder: ein Kopiervorgang (slice richtet den Puffer aus)
+  if (type[2] === HOST_LITTLE_ENDIAN || size === 1)
+    return new type[0](bytes.slice().buffer);
+  var view = new DataView(bytes.buffer, bytes.byteOffset, bytes.length);
+  var result = new type[0](bytes.length / size);
+  for (var i = 0; i < result.length; ++i)
+    result[i] = view[type[1]](i * size, type[2]);
+  return result;
+}
+
 function encode(value) {
   var data = new ArrayBuffer(256);
   var dataView = new DataView(data);
@@ -371,7 +406,10 @@ function decode(data, tagger, simpleValue) {
         }
         return retObject;
       case 6:
-        return tagger(decodeItem(), length);
+        var tagged = decodeItem();
+        if (TYPED_ARRAY_TAGS[length] && tagged instanceof Uint8Array)
+          return decodeTypedArray(length, tagged);
+        return tagger(tagged, length);
       case 7:
         switch (length) {
           case 20:
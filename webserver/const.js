@@ -45,3 +45,13 @@ const SWALERTFLAGS_TEXT = [
     "Stromwert abnormal",           //CURRENT_ABNORMAL
 ];
 const MOS_BITS = ["Laden","Entladen","Vorladen"];
+const MOS_COMMANDS = ["charge","discharge",null]; // /api/cmd, Vorladen nicht schaltbar
+
+// Von renderPacks benutzte Felder, Projektion für /api/bmsdata?fields=
+const DASHBOARD_FIELDS = [
+    "numberOfPacks", "voltage", "runPacks", "errorPacks", "warningPacks", "availableChargeCurrent",
+    "availableDischargeCurrent", "cellMin", "cellMax", "cellAvg", "temperatureMin", "temperatureMax",
+    "temperatureAvg", "cellMinPack", "cellMinCell", "cellMaxPack", "cellMaxCell", "id", "stateMachine", "cells", "ntcTemperature", "current",
+    "mosfetStatus", "swAlertFlags", "swWarningFlags", "stateOfCharge", "stateOfHealth",
+    "availableCapacity", "cycleCount", "dieTemperature", "pvddVoltage",
+];
@@ -1,17 +1,47 @@
 from ctypes import *
 
+PDO_MAGIC = 1329877058
+PDO_LAYOUT_VERSION = 4
+
 class GLOBAL_PDO_t(Structure):
     _fields_ = [
         ("numberOfPacks", c_uint32),
-        ("sync", c_uint32),
+        ("seq", c_uint32),
         ("voltage", c_float),
+        ("cycle", c_uint32),
+        ("runPacks", c_uint32),
+        ("errorPacks", c_uint32),
+        ("warningPacks", c_uint32),
+        ("current", c_float),
+        ("availableChargeCurrent", c_float),
+        ("availableDischargeCurrent", c_float),
+        ("cellMin", c_float),
+        ("cellMax", c_float),
+        ("cellAvg", c_float),
+        ("temperatureMin", c_float),
+        ("temperatureMax", c_float),
+        ("temperatureAvg", c_float),
+        ("stateOfCharge", c_float),
+        ("stateOfHealth", c_float),
+        ("cellMinPack", c_uint8),
+        ("cellMinCell", c_uint8),
+        ("cellMaxPack", c_uint8),
+        ("cellMaxCell", c_uint8),
+        ("temperatureMinPack", c_uint8),
+        ("temperatureMaxPack", c_uint8),
+        ("_pad0", (c_uint8 * 50)),
     ]
 class PACK_PDO_t(Structure):
     _fields_ = [
-        ("id", c_uint32),
+        ("seq", c_uint32),
         ("stateMachine", c_uint32),
         ("aliveCounter", c_uint32),
         ("spiRetries", c_uint32),
+        ("spiCrcErrors", c_uint32),
+        ("spiIoctlErrors", c_uint32),
+        ("spiFailedCalls", c_uint32),
+        ("spiMaxTransferUs", c_uint32),
+        ("spiSpeedHz", c_uint32),
         ("swAlertFlags", c_uint32),
         ("swWarningFlags", c_uint32),
         ("hwStatus", c_uint32),
@@ -32,11 +62,16 @@ class PACK_PDO_t(Structure):
         ("pvddVoltage", c_float),
         ("availableChargeCurrent", c_float),
         ("availableDischargeCurrent", c_float),
+        ("_pad0", (c_uint8 * 4)),
+        ("rawCodes", (c_uint16 * 28)),
+        ("_pad1", (c_uint8 * 8)),
+        ("id", c_uint32),
         ("availableCapacity", c_float),
         ("totalCapacity", c_float),
         ("stateOfCharge", c_float),
         ("stateOfHealth", c_float),
         ("cycleCount", c_float),
+        ("_pad2", (c_uint8 * 40)),
     ]
 class PACK_SDO_t(Structure):
     _fields_ = [
@@ -45,3 +80,80 @@ class PACK_SDO_t(Structure):
         ("swAlertFlagsClear", c_uint32),
         ("ResetStateMachine", c_uint32),
     ]
+class TIMING_GLOBAL_t(Structure):
+    _fields_ = [
+        ("numberOfPacks", c_uint32),
+        ("globalPhases", c_uint32),
+        ("packPhases", c_uint32),
+        ("buckets", c_uint32),
+        ("tickNs", c_uint32),
+        ("ticks", c_uint32),
+        ("overruns", c_uint32),
+        ("missedTicks", c_uint32),
+    ]
+class TIMING_PHASE_t(Structure):
+    _fields_ = [
+        ("sumNs", c_uint64),
+        ("count", c_uint32),
+        ("minNs", c_uint32),
+        ("maxNs", c_uint32),
+        ("hist", (c_uint32 * 32)),
+    ]
+class HISTORY_HEADER_t(Structure):
+    _fields_ = [
+        ("depth", c_uint32),
+        ("numberOfPacks", c_uint32),
+        ("recordSize", c_uint32),
+        ("reserved", c_uint32),
+        ("cycle", c_uint64),
+        ("_pad0", (c_uint8 * 40)),
+    ]
+class HISTORY_RECORD_t(Structure):
+    _fields_ = [
+        ("seq", c_uint32),
+        ("reserved", c_uint32),
+        ("cycle", c_uint64),
+        ("timeNs", c_uint64),
+        ("_pad0", (c_uint8 * 40)),
+    ]
+class SDO_QUEUE_t(Structure):
+    _fields_ = [
+        ("depth", c_uint32),
+        ("enqueuePos", c_uint32),
+        ("dequeuePos", c_uint32),
+        ("reserved", c_uint32),
+    ]
+class SDO_CMD_t(Structure):
+    _fields_ = [
+        ("seq", c_uint32),
+        ("cmd", c_uint32),
+        ("pack", c_uint32),
+        ("arg", c_uint32),
+    ]
+class SDO_ACK_t(Structure):
+    _fields_ = [
+        ("id", c_uint32),
+        ("status", c_uint32),
+    ]
+class PDO_HEADER_t(Structure):
+    _fields_ = [
+        ("magic", c_uint32),
+        ("layoutVersion", c_uint32),
+        ("numberOfPacks", c_uint32),
+        ("fieldCount", c_uint32),
+        ("fieldOffset", c_uint32),
+        ("globalOffset", c_uint32),
+        ("globalSize", c_uint32),
+        ("packOffset", c_uint32),
+        ("packSize", c_uint32),
+        ("_pad0", (c_uint8 * 28)),
+    ]
+class PDO_FIELD_t(Structure):
+    _fields_ = [
+        ("name", (c_char * 32)),
+        ("offset", c_uint16),
+        ("count", c_uint16),
+        ("type", c_uint8),
+        ("scope", c_uint8),
+        ("reserved", c_uint16),
+    ]
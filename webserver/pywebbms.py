@@ -1,105 +1,82 @@
 #!/usr/bin/env python3
 # -*- coding: utf-8 -*-
-import os
 import io
+import errno
 import cbor2
 import ctypes
-import mmap
-from bottle import Bottle, run, response, static_file
-from dataobjects import GLOBAL_PDO_t, PACK_PDO_t
-from ctypes import Structure, addressof, sizeof
+import struct
+import time
+from bottle import Bottle, run, request, response, static_file
+from dataobjects import PDO_MAGIC, PDO_LAYOUT_VERSION, GLOBAL_PDO_t, PACK_PDO_t, PDO_FIELD_t, TIMING_GLOBAL_t, TIMING_PHASE_t, HISTORY_RECORD_t
+from bmsclient import BmsClient, PDO_SCOPE_GLOBAL, PDO_SCOPE_PACK, SDO_CMD_CHARGE_ENABLE, SDO_CMD_DISCHARGE_ENABLE, SDO_CMD_CLEAR_ALERTS, SDO_CMD_RESET, SDO_STATUS_PENDING
+from ctypes import addressof, sizeof
 
 # ====================================================
-# Shared Memory Setup
+# Zugriff auf bmsd über libbmsclient (Seqlock, Futex, Verlauf, Kommandos nur in C)
 # ====================================================
-PDO_SHM_NAME = "/dev/shm/battery_pdo_shm"
+_bms = BmsClient()  # bjoern bedient Anfragen in einem Thread, ein Handle genügt
 
-if not os.path.exists(PDO_SHM_NAME):
-    raise FileNotFoundError(f"Shared memory '{PDO_SHM_NAME}' not found.")
+# Header am Segmentanfang: Anzahl Packs, Strukturgrößen und Feldtabelle
+pdo_hdr = _bms.header
+if pdo_hdr.magic != PDO_MAGIC:
+    raise RuntimeError("PDO-Segment hat keinen gültigen PDO-Header")
+if pdo_hdr.layoutVersion != PDO_LAYOUT_VERSION:
+    raise RuntimeError(f"PDO-Layout {pdo_hdr.layoutVersion}, erwartet {PDO_LAYOUT_VERSION}: dataobjects.py neu erzeugen")
 
-_pdo_shm_file = open(PDO_SHM_NAME, "rb")  # Readonly!
-_pdo_shm_map = mmap.mmap(_pdo_shm_file.fileno(), 0, access=mmap.ACCESS_READ)
-
-# Erste globale Struktur lesen, um Anzahl der Packs zu kennen
-pdo_data_glob = GLOBAL_PDO_t.from_buffer_copy(_pdo_shm_map)
-
-class PDO_BATTERY_SYSTEM_t(Structure):
-    _fields_ = [
-        ("glob", GLOBAL_PDO_t),
-        ("pack", PACK_PDO_t * pdo_data_glob.numberOfPacks)
-    ]
+# ====================================================
+# Feldtabelle -> Decoder (Typen wie EPdoType_t, Bereiche wie EPdoScope_t)
+# ====================================================
+PDO_TYPE_FORMAT = {1: "B", 2: "H", 3: "I", 4: "Q", 5: "i", 6: "f"}
+
+def pdo_fields(hdr):
+    """Liest die Feldtabelle und erzeugt je Bereich eine Liste (Name, Offset, Struct, Anzahl)."""
+    table = (PDO_FIELD_t * hdr.fieldCount).from_address(addressof(hdr) + hdr.fieldOffset)
+    fields = {PDO_SCOPE_GLOBAL: [], PDO_SCOPE_PACK: []}
+    for f in table:
+        fmt = PDO_TYPE_FORMAT.get(f.type)
+        if fmt is None or f.scope not in fields:
+            continue  # unbekannter Typ (neueres bmsd): Feld auslassen
+        fields[f.scope].append((f.name.decode(), f.offset, struct.Struct(f"={f.count}{fmt}"), f.count))
+    return fields
+
+def decode_fields(fields, buf, base=0):
+    """Erzeugt ein dict aus den Rohdaten einer Struktur ab base."""
+    data = {}
+    for name, offset, st, count in fields:
+        values = st.unpack_from(buf, base + offset)
+        data[name] = values[0] if count == 1 else list(values)
+    return data
+
+def decode_packs(buf, base):
+    """PACK_PDO_t[numberOfPacks] ab base als Liste von dicts"""
+    return [decode_fields(_fields[PDO_SCOPE_PACK], buf, base + i * sizeof(PACK_PDO_t))
+            for i in range(_bms.number_of_packs)]
+
+_fields = pdo_fields(pdo_hdr)
+
+# Konsistente Kopie (bmsc_SnapshotCopy) in einen festen Puffer, Layout wie BMSC_SNAPSHOT_t
+_snap = _bms.Snapshot()
+
+def decode_snapshot(snap):
+    """BMSC_SNAPSHOT_t als {"glob": ..., "pack": [...]}"""
+    return {
+        "glob": decode_fields(_fields[PDO_SCOPE_GLOBAL], snap),
+        "pack": decode_packs(snap, _bms.Snapshot.pack.offset),
+    }
+
+pdo_dict = decode_snapshot(_bms.snapshot_into(_snap))
 
 # ====================================================
-# Ctypes -> Dict Hilfsfunktionen
-# ====================================================
-def struct_from_ctypes(name: str, ctypes_struct: type, depth=0, _cache=None) -> dict:
-    """Erzeugt eine Python-Datenbeschreibung (Schema) aus einer ctypes.Structure."""
-    if _cache is None:
-        _cache = {}
-    if ctypes_struct in _cache:
-        return _cache[ctypes_struct]
-
-    schema = {}
-    for field_name, field_type in ctypes_struct._fields_:
-        # Unterstruktur
-        if issubclass(field_type, Structure):
-            schema[field_name] = struct_from_ctypes(field_name, field_type, depth + 1, _cache)
-
-        # Array
-        elif hasattr(field_type, "_type_") and hasattr(field_type, "_length_"):
-            elem_type = field_type._type_
-            if issubclass(elem_type, Structure):
-                schema[field_name] = [struct_from_ctypes(field_name, elem_type, depth + 1, _cache)
-                                      for _ in range(field_type._length_)]
-            else:
-                schema[field_name] = [0 for _ in range(field_type._length_)]
-
-        # Primitive Typen
-        else:
-            schema[field_name] = 0
-
-    _cache[ctypes_struct] = schema
-    return schema
-
-
-def instance_from_ctypes(schema, c_obj):
-    """Erzeugt ein Python-Objekt (dict/list) aus ctypes-Daten anhand eines Schemas."""
-    if isinstance(schema, dict):
-        return {k: instance_from_ctypes(v, getattr(c_obj, k)) for k, v in schema.items()}
-    elif isinstance(schema, list):
-        if len(schema) == 0:
-            return []
-        elem_schema = schema[0]
-        return [instance_from_ctypes(elem_schema, elem) for elem in c_obj]
-    else:
-        return c_obj
-
-
-def update_from_ctypes(obj, schema, c_obj):
-    """Aktualisiert rekursiv bestehendes Python-Objekt (dict/list) aus ctypes-Daten."""
-    if isinstance(obj, dict):
-        for k, v in obj.items():
-            if isinstance(v, (dict, list)):
-                update_from_ctypes(v, schema[k], getattr(c_obj, k))
-            else:
-                obj[k] = getattr(c_obj, k)
-    elif isinstance(obj, list):
-        for i, v in enumerate(obj):
-            if isinstance(v, (dict, list)):
-                update_from_ctypes(v, schema[0], c_obj[i])
-            else:
-                obj[i] = c_obj[i]
-
-
-# ====================================================
-# Initiale Strukturen anlegen
-# ====================================================
-schema = struct_from_ctypes("pdo", PDO_BATTERY_SYSTEM_t)
-pdo_data = PDO_BATTERY_SYSTEM_t.from_buffer_copy(_pdo_shm_map)
-pdo_dict = instance_from_ctypes(schema, pdo_data)
+# Änderungsbenachrichtigung über libbmsclient (bmsc_WaitCycle, absolute Frist)
+# ====================================================
+_cycle = ctypes.c_uint32.from_address(addressof(_bms.live().glob) + GLOBAL_PDO_t.cycle.offset)
+
+def wait_cycle(last, timeout=None):
+    """Schläft, bis ein neuer Zyklus veröffentlicht ist. Rückgabe: Zyklus, None bei Timeout."""
+    return _bms.wait_cycle(last, -1 if timeout is None else int(timeout * 1000))
 
 print("Initialer Zustand geladen.")
-print(f"  Packs: {pdo_data.glob.numberOfPacks}")
+print(f"  Packs: {pdo_hdr.numberOfPacks}, Felder: {pdo_hdr.fieldCount}")
 
 # ====================================================
 # CBOR Encoder (optimiert)
@@ -120,18 +97,140 @@ def fast_cbor_dumps(obj):
 # ====================================================
 app = Bottle()
 
+_bms_cbor = None
+_bms_cycle = None
+
 @app.get("/api/bmsdata")
 def bms_data():
     """Liest alle gültigen Packs aus Shared Memory und gibt sie als CBOR aus"""
-    # Shared memory erneut auslesen → neue Werte
-    ctypes.memmove(addressof(pdo_data), _pdo_shm_map[:sizeof(pdo_data)], sizeof(pdo_data))
-
-    # Dictionary aktualisieren (in-place)
-    update_from_ctypes(pdo_dict, schema, pdo_data)
+    global _bms_cbor, _bms_cycle, pdo_dict
+
+    # Nur bei neuem Zyklus erneut auslesen (konsistenter Zyklus)
+    cycle = _cycle.value
+    if cycle != _bms_cycle:
+        try:
+            pdo_dict = decode_snapshot(_bms.snapshot_into(_snap))
+            _bms_cbor = fast_cbor_dumps(pdo_dict)
+            _bms_cycle = cycle
+        except OSError:
+            pass  # kein konsistenter Stand, letzten ausliefern
 
     # CBOR-Antwort senden
     response.content_type = "application/cbor"
-    return fast_cbor_dumps(pdo_dict)
+    return _bms_cbor if _bms_cbor is not None else fast_cbor_dumps(pdo_dict)
+
+
+# ====================================================
+# Zeitmessung (/battery_timing_shm), Reihenfolge wie ETimingGlobalPhase_t/ETimingPackPhase_t
+# ====================================================
+TIMING_SHM_NAME = "/dev/shm/battery_timing_shm"
+TIMING_GLOBAL_NAMES = ["loop", "period", "iowait", "wakeup"]
+TIMING_PACK_NAMES = ["select", "burst", "convert", "limits", "error", "mos", "balancer", "task"]
+
+def timing_phase_dict(p):
+    return {
+        "count": p.count,
+        "minNs": p.minNs if p.count else 0,
+        "maxNs": p.maxNs,
+        "meanNs": p.sumNs // p.count if p.count else 0,
+        "hist": list(p.hist),
+    }
+
+@app.get("/api/timing")
+def timing_data():
+    """Zeitmessung als CBOR: Header, globale Phasen und Phasen je Pack"""
+    with open(TIMING_SHM_NAME, "rb") as f:
+        buf = f.read()
+    glob = TIMING_GLOBAL_t.from_buffer_copy(buf)
+    phases = (TIMING_PHASE_t * (glob.globalPhases + glob.packPhases * glob.numberOfPacks)).from_buffer_copy(buf, sizeof(glob))
+
+    data = {k: getattr(glob, k) for k, _ in TIMING_GLOBAL_t._fields_}
+    data["global"] = {n: timing_phase_dict(phases[i]) for i, n in enumerate(TIMING_GLOBAL_NAMES)}
+    data["pack"] = [
+        {n: timing_phase_dict(phases[glob.globalPhases + pack * glob.packPhases + i]) for i, n in enumerate(TIMING_PACK_NAMES)}
+        for pack in range(glob.numberOfPacks)
+    ]
+    response.content_type = "application/cbor"
+    return fast_cbor_dumps(data)
+
+
+# ====================================================
+# Verlauf (/battery_history_shm) über bmsc_HistoryRead, Ring der letzten HISTORY_DEPTH Zyklen
+# ====================================================
+HISTORY_MAX_RECORDS = 64
+
+def history_read(next_cycle, max_records):
+    """Liefert (Einträge, nächster Zyklus, verlorene Zyklen), Semantik wie dob_HistoryRead."""
+    buf, count, size, next_cycle, lost = _bms.history_read(next_cycle, max_records)
+    records = []
+    for i in range(count):
+        rec = HISTORY_RECORD_t.from_buffer(buf, i * size)
+        records.append({
+            "cycle": rec.cycle,
+            "timeNs": rec.timeNs,
+            "pack": decode_packs(buf, i * size + sizeof(HISTORY_RECORD_t)),
+        })
+    return records, next_cycle, lost
+
+@app.get("/api/history")
+def history_data():
+    """Verlauf ab ?since=<Zyklus> (0 = ältester verfügbarer), max. ?max=<n> Einträge als CBOR"""
+    since = int(request.query.get("since", 0))
+    count = min(int(request.query.get("max", HISTORY_MAX_RECORDS)), HISTORY_MAX_RECORDS)
+    try:
+        records, next_cycle, lost = history_read(since, count)
+    except OSError as e:
+        response.status = 503
+        return {"error": str(e)}
+    response.content_type = "application/cbor"
+    return fast_cbor_dumps({"next": next_cycle, "lost": lost, "records": records})
+
+
+# ====================================================
+# Kommandoqueue (/battery_sdo_shm) über libbmsclient, Protokoll nur in dataobjects.c
+# ====================================================
+SDO_STATUS_TEXT = ["pending", "done", "bad_command", "bad_pack"]
+SDO_ACK_TIMEOUT = 0.5
+
+# Dashboard-Kommandos, "_all" bzw. pack = None für alle Packs
+WEB_COMMANDS = {
+    "charge_on":     [(SDO_CMD_CHARGE_ENABLE, 1)],
+    "charge_off":    [(SDO_CMD_CHARGE_ENABLE, 0)],
+    "discharge_on":  [(SDO_CMD_DISCHARGE_ENABLE, 1)],
+    "discharge_off": [(SDO_CMD_DISCHARGE_ENABLE, 0)],
+    "all_on":        [(SDO_CMD_CHARGE_ENABLE, 1), (SDO_CMD_DISCHARGE_ENABLE, 1)],
+    "all_off":       [(SDO_CMD_CHARGE_ENABLE, 0), (SDO_CMD_DISCHARGE_ENABLE, 0)],
+    "clear_alerts":  [(SDO_CMD_CLEAR_ALERTS, 0)],
+    "reset":         [(SDO_CMD_RESET, 0)],
+}
+
+@app.post("/api/cmd")
+def command():
+    """Kommando in die Queue stellen und auf die Quittung von bmsd warten (max. SDO_ACK_TIMEOUT)"""
+    body = request.json or {}
+    name = str(body.get("cmd", ""))
+    pack = int(body.get("pack") or 0)
+    if name.endswith("_all"):
+        name, pack = name[:-4], 0
+    if name not in WEB_COMMANDS:
+        response.status = 400
+        return {"error": f"unbekanntes Kommando {name}"}
+
+    ids = []
+    for cmd, arg in WEB_COMMANDS[name]:
+        try:
+            ids.append(_bms.command(cmd, pack, arg))
+        except OSError as e:
+            response.status = 503
+            return {"error": "Kommandoqueue voll" if e.errno == errno.EBUSY else str(e)}
+
+    deadline = time.monotonic() + SDO_ACK_TIMEOUT
+    status = [_bms.command_status(i) for i in ids]
+    cycle = _cycle.value
+    while SDO_STATUS_PENDING in status and time.monotonic() < deadline:
+        cycle = wait_cycle(cycle, SDO_ACK_TIMEOUT) or cycle
+        status = [_bms.command_status(i) for i in ids]
+    return {"ids": ids, "status": [SDO_STATUS_TEXT[s] if s < len(SDO_STATUS_TEXT) else s for s in status]}
 
 
 # ====================================================
@@ -0,0 +1,63 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""Durchsatz von /api/bmsdata messen, pywebbms.py (Bottle/bjoern) gegen bmsweb.
+
+    ./webbench.py http://127.0.0.1:80 -n 2000 -c 4 [-p PID]
+
+-c Verbindungen (Keep-Alive, je ein Thread), -p misst zusätzlich die CPU-Zeit
+des Servers je Anfrage aus /proc/PID/stat (Client auf dem Board verfälscht sonst).
+"""
+import argparse
+import http.client
+import os
+import threading
+import time
+from urllib.parse import urlparse
+
+def cpu_seconds(pid):
+    fields = open(f"/proc/{pid}/stat").read().rsplit(")", 1)[1].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+
+def worker(host, port, path, count, latencies):
+    conn = http.client.HTTPConnection(host, port)
+    for _ in range(count):
+        t = time.perf_counter()
+        conn.request("GET", path)
+        res = conn.getresponse()
+        res.read()
+        if res.status != 200:
+            raise RuntimeError(f"HTTP {res.status}")
+        latencies.append(time.perf_counter() - t)
+    conn.close()
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("url")
+    parser.add_argument("-n", type=int, default=2000, help="Anfragen je Verbindung")
+    parser.add_argument("-c", type=int, default=1, help="Verbindungen")
+    parser.add_argument("-p", type=int, help="PID des Servers")
+    parser.add_argument("--path", default="/api/bmsdata")
+    args = parser.parse_args()
+
+    url = urlparse(args.url)
+    latencies = []
+    threads = [threading.Thread(target=worker, args=(url.hostname, url.port or 80, args.path, args.n, latencies))
+               for _ in range(args.c)]
+    cpu0 = cpu_seconds(args.p) if args.p else 0
+    t0 = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    dt = time.perf_counter() - t0
+
+    latencies.sort()
+    total = len(latencies)
+    print(f"{args.url}{args.path}: {total} Anfragen, {args.c} Verbindungen, {dt:.2f} s")
+    print(f"  {total / dt:.0f} Anfragen/s, Latenz p50 {latencies[total // 2] * 1e3:.2f} ms, "
+          f"p99 {latencies[int(total * 0.99)] * 1e3:.2f} ms")
+    if args.p:
+        print(f"  Server-CPU {(cpu_seconds(args.p) - cpu0) / total * 1e6:.1f} us/Anfrage")
+
+if __name__ == "__main__":
+    main()